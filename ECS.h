@@ -22,12 +22,29 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
-#include <unordered_map>
 #include <functional>
 #include <vector>
 #include <algorithm>
 #include <stdint.h>
 #include <type_traits>
+#include <cstddef>
+#include <new>
+#include <map>
+#include <tuple>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <istream>
+#include <ostream>
+#include <chrono>
 
 //////////////////////////////////////////////////////////////////////////
 // SETTINGS //
@@ -54,1060 +71,9280 @@ SOFTWARE.
 // leaks.
 //#define ECS_TICK_NO_CLEANUP
 
-// Define ECS_NO_RTTI to turn off RTTI. This requires using the ECS_DEFINE_TYPE and ECS_DECLARE_TYPE macros on all types
-// that you wish to use as components or events. If you use ECS_NO_RTTI, also place ECS_TYPE_IMPLEMENTATION in a single cpp file.
-//#define ECS_NO_RTTI
+// Define ECS_TICK_NO_EVENT_FLUSH if you don't want the world to automatically deliver queued events (see World::enqueue())
+// at the end of each tick. You will have to call flushEvents() yourself.
+//#define ECS_TICK_NO_EVENT_FLUSH
 
-#ifndef ECS_NO_RTTI
+// Define ECS_TICK_NO_COMMAND_PLAYBACK if you don't want the world to automatically play back the commands recorded in its
+// command buffers (see World::getCommandBuffer()) at the end of each tick. You will have to call playbackCommands() yourself.
+//#define ECS_TICK_NO_COMMAND_PLAYBACK
 
-#include <typeindex>
-#include <typeinfo>
-#define ECS_TYPE_IMPLEMENTATION
+// Define ECS_ARCHETYPE_STORAGE to store components by archetype. Entities with the exact same set of components share
+// fixed-size chunks, with each component type laid out contiguously inside of a chunk. This makes each() much faster
+// for large worlds, at the cost of moving an entity's components every time a component is assigned to or removed from it.
+//#define ECS_ARCHETYPE_STORAGE
 
-#else
+// The size (in bytes) of a single archetype chunk when using ECS_ARCHETYPE_STORAGE. Archetypes whose components don't
+// fit in a chunk of this size will use bigger chunks holding a single entity each.
+#ifndef ECS_ARCHETYPE_CHUNK_SIZE
+#define ECS_ARCHETYPE_CHUNK_SIZE 16384
+#endif
 
-#define ECS_TYPE_IMPLEMENTATION \
-	ECS::TypeIndex ECS::Internal::TypeRegistry::nextIndex = 1; \
-	\
-	ECS_DEFINE_TYPE(ECS::Events::OnEntityCreated);\
-	ECS_DEFINE_TYPE(ECS::Events::OnEntityDestroyed); \
+// The alignment (in bytes) of the field arrays of components stored as structures of arrays (see SoA). The default fits
+// AVX-512 vectors and cache lines. Must be a power of two, and at least alignof(std::max_align_t).
+#ifndef ECS_SOA_ALIGNMENT
+#define ECS_SOA_ALIGNMENT 64
+#endif
 
+// The maximum number of component types. Every entity carries one bit per component type, so keep this to the number of
+// component types you actually need. Using more component types than this aborts the program.
+#ifndef ECS_MAX_COMPONENTS
+#define ECS_MAX_COMPONENTS 256
 #endif
 
-//////////////////////////////////////////////////////////////////////////
-// CODE //
-//////////////////////////////////////////////////////////////////////////
+// The default number of entities handed to a thread at once by World::parallelEach(). You can also change this per world
+// with World::setGrainSize(), or per call.
+#ifndef ECS_PARALLEL_GRAIN_SIZE
+#define ECS_PARALLEL_GRAIN_SIZE 1024
+#endif
 
-namespace ECS
-{
-#ifndef ECS_NO_RTTI
-	typedef std::type_index TypeIndex;
+// Define ECS_PROFILING to have the world record how long its systems take, how many entities each() visits and how many
+// events are emitted, see World::getProfiler(). None of this is compiled in without it.
+//#define ECS_PROFILING
+
+// The number of ticks that ECS_PROFILING keeps the stats of.
+#ifndef ECS_PROFILING_HISTORY
+#define ECS_PROFILING_HISTORY 256
+#endif
 
+// ECS doesn't use RTTI. ECS_DECLARE_TYPE, ECS_DEFINE_TYPE and ECS_TYPE_IMPLEMENTATION used to be required with ECS_NO_RTTI,
+// and are kept around (doing nothing) so that code using them still compiles.
 #define ECS_DECLARE_TYPE
 #define ECS_DEFINE_TYPE(name)
+#define ECS_TYPE_IMPLEMENTATION
 
-	template<typename T>
-	TypeIndex getTypeIndex()
-	{
-		return std::type_index(typeid(T));
-	}
+//////////////////////////////////////////////////////////////////////////
+// CODE //
+//////////////////////////////////////////////////////////////////////////
 
-#else
+namespace ECS
+{
+	// A small id for a type, see getTypeIndex().
 	typedef uint32_t TypeIndex;
 
 	namespace Internal
 	{
-		class TypeRegistry
+		/**
+		* Hands out dense ids (0, 1, 2, ...) to types, in the order the types are first asked for. Each family counts on its
+		* own, so that component ids stay small even if there are a lot of event types.
+		*
+		* Ids are cached in a function-local static, which means they are only shared across shared libraries if the
+		* function is exported by the platform (which is the default everywhere except on Windows).
+		*/
+		template<typename Family>
+		class TypeIdRegistry
 		{
 		public:
-			TypeRegistry()
+			template<typename T>
+			static uint32_t get()
 			{
-				index = nextIndex;
-				++nextIndex;
+				static const uint32_t id = next();
+				return id;
 			}
 
-			TypeIndex getIndex() const
+		private:
+			static uint32_t next()
 			{
-				return index;
+				static std::atomic<uint32_t> nextId(0);
+				return nextId++;
 			}
-
-		private:
-			static TypeIndex nextIndex;
-			TypeIndex index;
 		};
-	}
 
-#define ECS_DECLARE_TYPE public: static ECS::Internal::TypeRegistry __ecs_type_reg
-#define ECS_DEFINE_TYPE(name) ECS::Internal::TypeRegistry name::__ecs_type_reg
+		struct AnyTypeFamily {};
+		struct ComponentFamily {};
+		struct ResourceFamily {};
+	}
 
+	/**
+	* Get the id of a type. Ids are unique among all types that were asked for, and small enough to index an array with.
+	*/
 	template<typename T>
 	TypeIndex getTypeIndex()
 	{
-		return T::__ecs_type_reg.getIndex();
+		return Internal::TypeIdRegistry<Internal::AnyTypeFamily>::template get<T>();
 	}
-#endif
 
 	class World;
 	class Entity;
+	class EntitySystem;
+	class CommandBuffer;
+	class WorldSerializer;
 
-	typedef float DefaultTickData;
-	typedef ECS_ALLOCATOR_TYPE Allocator;
+	template<typename... Types>
+	class Query;
 
-	// Do not use anything in the Internal namespace yourself.
-	namespace Internal
+	/**
+	* A thread-safe slab allocator for ECS's own allocations. Allocations up to MaxSize bytes are rounded up to one of a few
+	* dozen size classes, and carved out of big slabs that hold blocks of a single class. Freed blocks go on a free list for
+	* their class, so churning through entities, archetype chunks and the like reuses the same memory instead of going back
+	* to malloc every time. Bigger allocations (such as the arrays behind large vectors) go straight to operator new.
+	*
+	* Every pool is split into shards, each with its own lock, free lists and slabs. A thread always uses the same shard, so
+	* threads rarely wait on each other. Blocks freed on one thread may be reused by another.
+	*
+	* Slabs are only returned to the system when the pool is destroyed, so a pool must outlive everything allocated from it.
+	* Use PoolAllocator to allocate from a pool through the standard allocator interface.
+	*/
+	class MemoryPool
 	{
-		template<typename... Types>
-		class EntityComponentView;
+	public:
+		// The biggest allocation served from slabs.
+		const static size_t MaxSize = 65536;
 
-		class EntityView;
+		// The smallest slab. Slabs of big size classes hold at least 8 blocks.
+		const static size_t MinSlabSize = 65536;
 
-		struct BaseComponentContainer
+		MemoryPool()
 		{
-		public:
-			virtual ~BaseComponentContainer() { }
+		}
 
-			// This should only ever be called by the entity itself.
-			virtual void destroy(World* world) = 0;
+		MemoryPool(const MemoryPool&) = delete;
+		MemoryPool& operator=(const MemoryPool&) = delete;
 
-			// This will be called by the entity itself
-			virtual void removed(Entity* ent) = 0;
-		};
+		~MemoryPool()
+		{
+			for (auto& shard : shards)
+			{
+				for (void* slab : shard.slabs)
+				{
+					::operator delete(slab);
+				}
+			}
+		}
 
-		class BaseEventSubscriber
+		/**
+		* Get the pool used by default constructed PoolAllocators. It is never destroyed, so that worlds may safely outlive
+		* static destructors.
+		*/
+		static MemoryPool& getDefault()
 		{
-		public:
-			virtual ~BaseEventSubscriber() {};
-		};
-		
-		template<typename... Types>
-		class EntityComponentIterator
+			static MemoryPool* pool = new MemoryPool();
+			return *pool;
+		}
+
+		void* allocate(size_t size)
 		{
-		public:
-			EntityComponentIterator(World* world, size_t index, bool bIsEnd, bool bIncludePendingDestroy);
+			if (size > MaxSize)
+				return ::operator new(size);
 
-			size_t getIndex() const
-			{
-				return index;
-			}
+			const size_t sizeClass = getSizeClass(size);
+			Shard& shard = shards[getThreadShard()];
+			std::lock_guard<std::mutex> lock(shard.mutex);
 
-			bool isEnd() const;
+			const size_t blockSize = getClassSize(sizeClass);
+			shard.handedOutBytes += blockSize;
+			shard.requestedBytes += size;
 
-			bool includePendingDestroy() const
+			FreeBlock* block = shard.freeBlocks[sizeClass];
+			if (block != nullptr)
 			{
-				return bIncludePendingDestroy;
+				shard.freeBlocks[sizeClass] = block->next;
+				shard.freeBytes -= blockSize;
+				return block;
 			}
 
-			World* getWorld() const
+			if (static_cast<size_t>(shard.slabEnd[sizeClass] - shard.slabCursor[sizeClass]) < blockSize)
 			{
-				return world;
+				const size_t slabSize = blockSize * 8 > MinSlabSize ? blockSize * 8 : MinSlabSize;
+				char* slab = static_cast<char*>(::operator new(slabSize));
+				shard.slabs.push_back(slab);
+				shard.slabCursor[sizeClass] = slab;
+				shard.slabEnd[sizeClass] = slab + slabSize / blockSize * blockSize;
+				reservedBytes += slabSize;
 			}
 
-			Entity* get() const;
+			void* result = shard.slabCursor[sizeClass];
+			shard.slabCursor[sizeClass] += blockSize;
+			return result;
+		}
 
-			Entity* operator*() const
+		void deallocate(void* ptr, size_t size)
+		{
+			if (ptr == nullptr)
+				return;
+
+			if (size > MaxSize)
 			{
-				return get();
+				::operator delete(ptr);
+				return;
 			}
 
-			bool operator==(const EntityComponentIterator<Types...>& other) const
-			{
-				if (world != other.world)
-					return false;
+			const size_t sizeClass = getSizeClass(size);
+			Shard& shard = shards[getThreadShard()];
+			std::lock_guard<std::mutex> lock(shard.mutex);
 
-				if (isEnd())
-					return other.isEnd();
+			const size_t blockSize = getClassSize(sizeClass);
+			shard.handedOutBytes -= blockSize;
+			shard.requestedBytes -= size;
+			shard.freeBytes += blockSize;
 
-				return index == other.index;
-			}
+			FreeBlock* block = static_cast<FreeBlock*>(ptr);
+			block->next = shard.freeBlocks[sizeClass];
+			shard.freeBlocks[sizeClass] = block;
+		}
 
-			bool operator!=(const EntityComponentIterator<Types...>& other) const
-			{
-				if (world != other.world)
-					return true;
+		/**
+		* Get the number of bytes of slabs that the pool got from the system.
+		*/
+		size_t getReservedBytes() const
+		{
+			return reservedBytes;
+		}
 
-				if (isEnd())
-					return !other.isEnd();
+		/**
+		* Get the number of bytes of the blocks that are handed out, which are the sizes asked for rounded up to their size
+		* class. Allocations bigger than MaxSize don't come from slabs, and aren't counted.
+		*/
+		size_t getHandedOutBytes()
+		{
+			return sumShards(&Shard::handedOutBytes);
+		}
 
-				return index != other.index;
+		/**
+		* Get the number of bytes asked for by the allocations that are handed out.
+		*/
+		size_t getRequestedBytes()
+		{
+			return sumShards(&Shard::requestedBytes);
+		}
+
+		/**
+		* Get the number of bytes of the freed blocks waiting on the free lists to be reused. The rest of the reserved bytes
+		* that aren't handed out were never used yet.
+		*/
+		size_t getFreeBytes()
+		{
+			return sumShards(&Shard::freeBytes);
+		}
+
+		/**
+		* Get the size class of an allocation of up to MaxSize bytes. Sizes are rounded up to a multiple of 16 up to 128 bytes,
+		* and to a quarter of a power of two above that, so that no more than a fifth of a block is ever wasted.
+		*/
+		static size_t getSizeClass(size_t size)
+		{
+			if (size <= 128)
+				return size > 0 ? (size - 1) / 16 : 0;
+
+			size_t shift = 7;
+			while (((size - 1) >> (shift + 1)) != 0)
+			{
+				++shift;
 			}
 
-			EntityComponentIterator<Types...>& operator++();
+			return 8 + (shift - 7) * 4 + ((size - 1) >> (shift - 2)) - 4;
+		}
 
-		private:
-			bool bIsEnd = false;
-			size_t index;
-			class ECS::World* world;
-			bool bIncludePendingDestroy;
+		static size_t getClassSize(size_t sizeClass)
+		{
+			if (sizeClass < 8)
+				return (sizeClass + 1) * 16;
+
+			const size_t shift = (sizeClass - 8) / 4 + 7;
+			return ((sizeClass - 8) % 4 + 5) << (shift - 2);
+		}
+
+	private:
+		const static size_t ClassCount = 44;
+		const static size_t ShardCount = 8;
+
+		struct FreeBlock
+		{
+			FreeBlock* next;
 		};
 
-		template<typename... Types>
-		class EntityComponentView
+		struct Shard
 		{
-		public:
-			EntityComponentView(const EntityComponentIterator<Types...>& first, const EntityComponentIterator<Types...>& last);
+			std::mutex mutex;
+			FreeBlock* freeBlocks[ClassCount] = {};
 
-			const EntityComponentIterator<Types...>& begin() const
-			{
-				return firstItr;
-			}
+			// The part of the newest slab of each size class that wasn't handed out yet.
+			char* slabCursor[ClassCount] = {};
+			char* slabEnd[ClassCount] = {};
 
-			const EntityComponentIterator<Types...>& end() const
+			std::vector<void*> slabs;
+
+			// Blocks are freed to the shard of the thread that frees them, so these only add up across all shards (and may
+			// wrap around on their own).
+			size_t handedOutBytes = 0;
+			size_t requestedBytes = 0;
+			size_t freeBytes = 0;
+
+			// Keeps the locks of different shards off of the same cache line.
+			char padding[64];
+		};
+
+		Shard shards[ShardCount];
+		std::atomic<size_t> reservedBytes{ 0 };
+
+		size_t sumShards(size_t Shard::* counter)
+		{
+			size_t sum = 0;
+			for (auto& shard : shards)
 			{
-				return lastItr;
+				std::lock_guard<std::mutex> lock(shard.mutex);
+				sum += shard.*counter;
 			}
 
-		private:
-			EntityComponentIterator<Types...> firstItr;
-			EntityComponentIterator<Types...> lastItr;
-		};
-	}
+			return sum;
+		}
+
+		static size_t getThreadShard()
+		{
+			static std::atomic<size_t> nextShard(0);
+			static thread_local size_t shard = nextShard++ % ShardCount;
+			return shard;
+		}
+	};
 
 	/**
-	* Think of this as a pointer to a component. Whenever you get a component from the world or an entity,
-	* it'll be wrapped in a ComponentHandle.
+	* A standard allocator that allocates from a MemoryPool. Default constructed allocators use MemoryPool::getDefault().
+	* This may be used as ECS_ALLOCATOR_TYPE:
+	*
+	*     #define ECS_ALLOCATOR_TYPE ECS::PoolAllocator<ECS::Entity>
+	*     #include "ECS.h"
 	*/
 	template<typename T>
-	class ComponentHandle
+	class PoolAllocator
 	{
 	public:
-		ComponentHandle()
-			: component(nullptr)
+		typedef T value_type;
+
+		PoolAllocator()
+			: pool(&MemoryPool::getDefault())
 		{
 		}
 
-		ComponentHandle(T* component)
-			: component(component)
+		PoolAllocator(MemoryPool* pool)
+			: pool(pool)
 		{
 		}
 
-		T* operator->() const
+		template<typename U>
+		PoolAllocator(const PoolAllocator<U>& other)
+			: pool(other.getPool())
 		{
-			return component;
 		}
 
-		operator bool() const
+		T* allocate(size_t n)
 		{
-			return isValid();
+			return static_cast<T*>(pool->allocate(n * sizeof(T)));
 		}
 
-		T& get()
+		void deallocate(T* ptr, size_t n)
 		{
-			return *component;
+			pool->deallocate(ptr, n * sizeof(T));
 		}
 
-		bool isValid() const
+		MemoryPool* getPool() const
+		{
+			return pool;
+		}
+
+		template<typename U>
+		bool operator==(const PoolAllocator<U>& other) const
+		{
+			return pool == other.getPool();
+		}
+
+		template<typename U>
+		bool operator!=(const PoolAllocator<U>& other) const
 		{
-			return component != nullptr;
+			return pool != other.getPool();
 		}
 
 	private:
-		T* component;
+		MemoryPool* pool;
 	};
 
 	/**
-	* A system that acts on entities. Generally, this will act on a subset of entities using World::each().
+	* A linear allocator: allocating moves a pointer forward, freeing does nothing, and reset() frees everything at once. This
+	* is by far the cheapest way to allocate memory that only lives for a short while, like the scratch arrays of a system.
+	* Every world has one that it resets at the start of every tick (see World::getTickArena()).
 	*
-	* Systems often will respond to events by subclassing EventSubscriber. You may use configure() to subscribe to events,
-	* but remember to unsubscribe in unconfigure().
+	* Allocating is thread-safe and lock-free unless the arena has to grow. reset() is not thread-safe. The arena keeps its
+	* memory when it is reset, so an arena that is reset regularly stops allocating once it has grown to fit.
 	*/
-	class EntitySystem
+	class LinearArena
 	{
 	public:
-		virtual ~EntitySystem() {}
+		explicit LinearArena(size_t blockSize = 65536)
+			: blockSize(blockSize)
+		{
+		}
 
-		/**
-		* Called when this system is added to a world.
-		*/
-		virtual void configure(World* world)
+		LinearArena(const LinearArena&) = delete;
+		LinearArena& operator=(const LinearArena&) = delete;
+
+		~LinearArena()
+		{
+			while (first != nullptr)
+			{
+				Block* next = first->next;
+				::operator delete(first);
+				first = next;
+			}
+		}
+
+		void* allocate(size_t size, size_t alignment = alignof(std::max_align_t))
 		{
+			Block* block = current.load(std::memory_order_acquire);
+			for (;;)
+			{
+				if (block != nullptr)
+				{
+					const uintptr_t begin = reinterpret_cast<uintptr_t>(block->data());
+					size_t used = block->used.load(std::memory_order_relaxed);
+					for (;;)
+					{
+						const uintptr_t address = (begin + used + alignment - 1) / alignment * alignment;
+						const size_t end = address - begin + size;
+						if (end > block->size)
+							break;
+
+						if (block->used.compare_exchange_weak(used, end, std::memory_order_relaxed))
+							return reinterpret_cast<void*>(address);
+					}
+				}
+
+				block = grow(block, size + alignment);
+			}
 		}
 
 		/**
-		* Called when this system is being removed from a world.
+		* Free everything allocated from the arena. Nothing may be allocated from the arena while it is reset.
 		*/
-		virtual void unconfigure(World* world)
+		void reset()
 		{
+			for (Block* block = first; block != nullptr; block = block->next)
+			{
+				block->used = 0;
+			}
+
+			current = first;
 		}
 
 		/**
-		* Called when World::tick() is called. See ECS_TICK_TYPE at the top of this file for more
-		* information about passing data to tick.
+		* Get the number of bytes of blocks that the arena got from the system.
 		*/
-#ifdef ECS_TICK_TYPE_VOID
-		virtual void tick(World* world)
-#else
-		virtual void tick(World* world, ECS_TICK_TYPE data)
-#endif
+		size_t getReservedBytes() const
 		{
+			return reservedBytes;
 		}
-	};
-
-	/**
-	* Subclass this as EventSubscriber<EventType> and then call World::subscribe() in order to subscribe to events. Make sure
-	* to call World::unsubscribe() or World::unsubscribeAll() when your subscriber is deleted!
-	*/
-	template<typename T>
-	class EventSubscriber : public Internal::BaseEventSubscriber
-	{
-	public:
-		virtual ~EventSubscriber() {}
 
 		/**
-		* Called when an event is emitted by the world.
+		* Get the number of bytes allocated from the arena since it was last reset, including alignment padding.
 		*/
-		virtual void receive(World* world, const T& event) = 0;
-	};
-
-	namespace Events
-	{
-		// Called when a new entity is created.
-		struct OnEntityCreated
+		size_t getUsedBytes() const
 		{
-			ECS_DECLARE_TYPE;
+			size_t used = 0;
+			for (Block* block = first; block != nullptr; block = block->next)
+			{
+				used += block->used.load(std::memory_order_relaxed);
+			}
 
-			Entity* entity;
-		};
+			return used;
+		}
 
-		// Called when an entity is about to be destroyed.
-		struct OnEntityDestroyed
+	private:
+		struct Block
 		{
-			ECS_DECLARE_TYPE;
+			Block* next;
+			size_t size;
+			std::atomic<size_t> used;
 
-			Entity* entity;
+			char* data()
+			{
+				return reinterpret_cast<char*>(this) + HeaderSize;
+			}
 		};
 
-		// Called when a component is assigned (not necessarily created).
-		template<typename T>
-		struct OnComponentAssigned
+		const static size_t HeaderSize = (sizeof(Block) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t);
+
+		size_t blockSize;
+		Block* first = nullptr;
+		std::atomic<Block*> current{ nullptr };
+		std::atomic<size_t> reservedBytes{ 0 };
+		std::mutex growMutex;
+
+		// Move on from a full block to one with room for at least size bytes, unless another thread already did.
+		Block* grow(Block* full, size_t size)
 		{
-			ECS_DECLARE_TYPE;
+			std::lock_guard<std::mutex> lock(growMutex);
 
-			Entity* entity;
-			ComponentHandle<T> component;
-		};
-
-		// Called when a component is removed
-		template<typename T>
-		struct OnComponentRemoved
-		{
-			ECS_DECLARE_TYPE;
-
-			Entity* entity;
-			ComponentHandle<T> component;
-		};
+			Block* block = current.load(std::memory_order_relaxed);
+			if (block != full)
+				return block;
 
-#ifdef ECS_NO_RTTI
-		template<typename T>
-		ECS_DEFINE_TYPE(ECS::Events::OnComponentAssigned<T>);
-		template<typename T>
-		ECS_DEFINE_TYPE(ECS::Events::OnComponentRemoved<T>);
-#endif
-	}
+			// Blocks after the current one are empty, either from an earlier tick or because a bigger block was needed.
+			Block* next = block != nullptr ? block->next : first;
+			if (next == nullptr || next->size < size)
+			{
+				const size_t dataSize = size > blockSize ? size : blockSize;
+				Block* created = static_cast<Block*>(::operator new(HeaderSize + dataSize));
+				created->next = next;
+				created->size = dataSize;
+				new (&created->used) std::atomic<size_t>(0);
+				reservedBytes += HeaderSize + dataSize;
+
+				if (block != nullptr)
+					block->next = created;
+				else
+					first = created;
+
+				next = created;
+			}
 
+			current.store(next, std::memory_order_release);
+			return next;
+		}
+	};
 
 	/**
-	* A container for components. Entities do not have any logic of their own, except of that which to manage
-	* components. Components themselves are generally structs that contain data with which EntitySystems can
-	* act upon, but technically any data type may be used as a component, though only one of each data type
-	* may be on a single Entity at a time.
+	* A standard allocator that allocates from a LinearArena, and never frees anything itself. Default constructed allocators
+	* don't have an arena, and use operator new and delete instead.
+	*
+	* Use this for containers that only live until the arena is reset:
+	*
+	*     std::vector<Entity*, ArenaAllocator<Entity*>> targets(ArenaAllocator<Entity*>(&world->getTickArena()));
+	*
+	* This may also be used as ECS_ALLOCATOR_TYPE, for worlds that are thrown away before their arena is reset (say, a world
+	* built to simulate a few ticks ahead). Keep in mind that nothing the world frees is reused until then.
 	*/
-	class Entity
+	template<typename T>
+	class ArenaAllocator
 	{
 	public:
-		friend class World;
+		typedef T value_type;
 
-		const static size_t InvalidEntityId = 0;
+		ArenaAllocator()
+			: arena(nullptr)
+		{
+		}
 
-		// Do not create entities yourself, use World::create().
-		Entity(World* world, size_t id)
-			: world(world), id(id)
+		ArenaAllocator(LinearArena* arena)
+			: arena(arena)
 		{
 		}
 
-		// Do not delete entities yourself, use World::destroy().
-		~Entity()
+		template<typename U>
+		ArenaAllocator(const ArenaAllocator<U>& other)
+			: arena(other.getArena())
 		{
-			removeAll();
 		}
 
-		/**
-		* Get the world associated with this entity.
-		*/
-		World* getWorld() const
+		T* allocate(size_t n)
 		{
-			return world;
+			if (arena == nullptr)
+				return static_cast<T*>(::operator new(n * sizeof(T)));
+
+			return static_cast<T*>(arena->allocate(n * sizeof(T), alignof(T)));
 		}
 
-		/**
-		* Does this entity have a component?
-		*/
-		template<typename T>
-		bool has() const
+		void deallocate(T* ptr, size_t n)
 		{
-			auto index = getTypeIndex<T>();
-			return components.find(index) != components.end();
+			if (arena == nullptr)
+				::operator delete(ptr);
 		}
 
-		/**
-		* Does this entity have this list of components? The order of components does not matter.
-		*/
-		template<typename T, typename V, typename... Types>
-		bool has() const
+		LinearArena* getArena() const
 		{
-			return has<T>() && has<V, Types...>();
+			return arena;
 		}
 
-		/**
-		* Assign a new component (or replace an old one). All components must have a default constructor, though they
-		* may have additional constructors. You may pass arguments to this function the same way you would to a constructor.
-		*
-		* It is recommended that components be simple types (not const, not references, not pointers). If you need to store
-		* any of the above, wrap it in a struct.
-		*/
-		template<typename T, typename... Args>
-		ComponentHandle<T> assign(Args&&... args);
+		template<typename U>
+		bool operator==(const ArenaAllocator<U>& other) const
+		{
+			return arena == other.getArena();
+		}
 
-		/**
-		* Remove a component of a specific type. Returns whether a component was removed.
-		*/
-		template<typename T>
-		bool remove()
+		template<typename U>
+		bool operator!=(const ArenaAllocator<U>& other) const
 		{
-			auto found = components.find(getTypeIndex<T>());
-			if (found != components.end())
-			{
-				found->second->removed(this);
-				found->second->destroy(world);
+			return arena != other.getArena();
+		}
 
-				components.erase(found);
+	private:
+		LinearArena* arena;
+	};
 
-				return true;
-			}
+	typedef float DefaultTickData;
+	typedef ECS_ALLOCATOR_TYPE Allocator;
 
-			return false;
-		}
+	/**
+	* Bytes of memory counted by World::memoryStats(). Used bytes hold live data, and whatever else was allocated is slack:
+	* the spare capacity of arrays, the empty rows of chunks, the unused entries of sparse pages and so on.
+	*
+	* These are the sizes the world asked its allocator for, so they don't include the allocator's own overhead. See
+	* MemoryStats::allocator for that.
+	*/
+	struct MemoryUsage
+	{
+		size_t used = 0;
+		size_t allocated = 0;
 
-		/**
-		* Remove all components from this entity.
-		*/
-		void removeAll()
+		size_t getSlack() const
 		{
-			for (auto pair : components)
-			{
-				pair.second->removed(this);
-				pair.second->destroy(world);
-			}
-
-			components.clear();
+			return allocated - used;
 		}
 
-		/**
-		* Get a component from this entity.
-		*/
-		template<typename T>
-		ComponentHandle<T> get();
-
-		/**
-		* Call a function with components from this entity as arguments. This will return true if this entity has
-		* all specified components attached, and false if otherwise.
-		*/
-		template<typename... Types>
-		bool with(typename std::common_type<std::function<void(ComponentHandle<Types>...)>>::type view)
+		void add(size_t usedBytes, size_t allocatedBytes)
 		{
-			if (!has<Types...>())
-				return false;
-
-			view(get<Types>()...); // variadic template expansion is fun
-			return true;
+			used += usedBytes;
+			allocated += allocatedBytes;
 		}
 
-		/**
-		* Get this entity's id. Entity ids aren't too useful at the moment, but can be used to tell the difference between entities when debugging.
-		*/
-		size_t getEntityId() const
+		void add(const MemoryUsage& other)
 		{
-			return id;
+			add(other.used, other.allocated);
 		}
 
-		bool isPendingDestroy() const
+		// Count the elements of a vector as used, and its spare capacity as slack.
+		template<typename T, typename Alloc>
+		void addVector(const std::vector<T, Alloc>& vector)
 		{
-			return bPendingDestroy;
+			add(vector.size() * sizeof(T), vector.capacity() * sizeof(T));
 		}
+	};
 
-	private:
-		std::unordered_map<TypeIndex, Internal::BaseComponentContainer*> components;
-		World* world;
+	/**
+	* The memory used by a single component type, see MemoryStats::getComponent().
+	*/
+	struct ComponentMemoryStats
+	{
+		// The id the world stores the component type by.
+		uint32_t componentId = 0;
 
-		size_t id;
-		bool bPendingDestroy = false;
+		// The number of entities with the component.
+		size_t count = 0;
+
+		// The size of a single component, which is 0 for tags as they aren't stored per entity.
+		size_t size = 0;
+
+		// The components themselves.
+		MemoryUsage components;
+
+		// What the world keeps per component to find it and track its changes: the sparse set of a pool, or the change ticks
+		// of a chunk.
+		MemoryUsage bookkeeping;
 	};
 
 	/**
-	* The world creates, destroys, and manages entities. The lifetime of entities and _registered_ systems are handled by the world
-	* (don't delete a system without unregistering it from the world first!), while event subscribers have their own lifetimes
-	* (the world doesn't delete them automatically when the world is deleted).
+	* What the world's allocator does with the memory it gets from the system, see MemoryStats::allocator. Only a
+	* PoolAllocator reports these.
 	*/
-	class World
+	struct AllocatorMemoryStats
 	{
-	public:
-		using WorldAllocator = std::allocator_traits<Allocator>::template rebind_alloc<World>;
-		using EntityAllocator = std::allocator_traits<Allocator>::template rebind_alloc<Entity>;
-		using SystemAllocator = std::allocator_traits<Allocator>::template rebind_alloc<EntitySystem>;
-		using EntityPtrAllocator = std::allocator_traits<Allocator>::template rebind_alloc<Entity*>;
-		using SystemPtrAllocator = std::allocator_traits<Allocator>::template rebind_alloc<EntitySystem*>;
-		using SubscriberPtrAllocator = std::allocator_traits<Allocator>::template rebind_alloc<Internal::BaseEventSubscriber*>;
-		using SubscriberPairAllocator = std::allocator_traits<Allocator>::template rebind_alloc<std::pair<const TypeIndex, std::vector<Internal::BaseEventSubscriber*, SubscriberPtrAllocator>>>;
-
-		/**
-		* Use this function to construct the world with a custom allocator.
-		*/
-		static World* createWorld(Allocator alloc)
-		{
-			WorldAllocator worldAlloc(alloc);
-			World* world = std::allocator_traits<WorldAllocator>::allocate(worldAlloc, 1);
-			std::allocator_traits<WorldAllocator>::construct(worldAlloc, world, alloc);
+		// Is the world's allocator a PoolAllocator? Everything else is 0 if it isn't.
+		bool bPooled = false;
 
-			return world;
-		}
+		// These count everything allocated from the MemoryPool, which may be shared with other worlds. See MemoryPool.
+		size_t reserved = 0;
+		size_t handedOut = 0;
+		size_t requested = 0;
+		size_t free = 0;
 
-		/**
-		* Use this function to construct the world with the default allocator.
-		*/
-		static World* createWorld()
+		// The bytes lost to rounding allocations up to their size class.
+		size_t getRoundingSlack() const
 		{
-			return createWorld(Allocator());
+			return handedOut - requested;
 		}
 
-		// Use this to destroy the world instead of calling delete.
-		// This will emit OnEntityDestroyed events and call EntitySystem::unconfigure as appropriate.
-		void destroyWorld()
+		// The bytes of slabs that weren't handed out yet.
+		size_t getUntouched() const
 		{
-			WorldAllocator alloc(entAlloc);
-			std::allocator_traits<WorldAllocator>::destroy(alloc, this);
-			std::allocator_traits<WorldAllocator>::deallocate(alloc, this, 1);
+			return reserved - handedOut - free;
 		}
+	};
 
-		World(Allocator alloc)
-			: entAlloc(alloc), systemAlloc(alloc),
-			entities({}, EntityPtrAllocator(alloc)),
-			systems({}, SystemPtrAllocator(alloc)),
-			subscribers({}, 0, std::hash<TypeIndex>(), std::equal_to<TypeIndex>(), SubscriberPtrAllocator(alloc))
-		{
-		}
+	/**
+	* How much memory a world uses, as counted by World::memoryStats().
+	*/
+	struct MemoryStats
+	{
+		// Every component type the world has storage for, sorted by component id.
+		std::vector<ComponentMemoryStats> components;
 
-		/**
-		* Destroying the world will emit OnEntityDestroyed events and call EntitySystem::unconfigure() as appropriate.
-		*
-		* Use World::destroyWorld to destroy and deallocate the world, do not manually delete the world!
-		*/
-		~World();
+		size_t entityCount = 0;
 
-		/**
-		* Create a new entity. This will emit the OnEntityCreated event.
-		*/
-		Entity* create()
-		{
-			++lastEntityId;
-			Entity* ent = std::allocator_traits<EntityAllocator>::allocate(entAlloc, 1);
-			std::allocator_traits<EntityAllocator>::construct(entAlloc, ent, this, lastEntityId);
-			entities.push_back(ent);
+		// The Entity objects and the world's tables of entities, including the slots of destroyed entities waiting to be reused.
+		MemoryUsage entities;
 
-			emit<Events::OnEntityCreated>({ ent });
+		// The storage of the components besides the components themselves: archetypes, their chunks' arrays of entities and
+		// padding, or component pools.
+		MemoryUsage storage;
 
-			return ent;
-		}
+		// Subscriber tables and queued events.
+		MemoryUsage events;
 
-		/**
-		* Destroy an entity. This will emit the OnEntityDestroy event.
-		*
-		* If immediate is false (recommended), then the entity won't be immediately
-		* deleted but instead will be removed at the beginning of the next tick() or
-		* when cleanup() is called. OnEntityDestroyed will still be called immediately.
-		*
-		* This function is safe to call multiple times on a single entity. Note that calling
-		* this once with immediate = false and then calling it with immediate = true will
-		* remove the entity from the pending destroy queue and will immediately destroy it
-		* _without_ emitting a second OnEntityDestroyed event.
-		*
-		* A warning: Do not set immediate to true if you are currently iterating through entities!
-		*/
-		void destroy(Entity* ent, bool immediate = false);
+		MemoryUsage commands;
 
-		/**
-		* Delete all entities in the pending destroy queue. Returns true if any entities were cleaned up,
-		* false if there were no entities to clean up.
-		*/
-		bool cleanup();
+		// The tick arena (see World::getTickArena()). What was allocated from it this tick is used, the rest is slack.
+		MemoryUsage arena;
 
-		/**
-		* Reset the world, destroying all entities. Entity ids will be reset as well.
-		*/
-		void reset();
+		// Cached queries (see World::query()).
+		MemoryUsage queries;
 
-		/**
-		* Register a system. The world will manage the memory of the system unless you unregister the system.
-		*/
-		EntitySystem* registerSystem(EntitySystem* system)
-		{
-			systems.push_back(system);
-			system->configure(this);
+		MemoryUsage resources;
 
-            		return system;
-		}
+		// The lists of systems and their schedule. Systems themselves aren't counted, as the world doesn't know their size.
+		MemoryUsage systems;
+
+		// The sizes above are as the world asked its allocator for them. This is what the allocator made of that.
+		AllocatorMemoryStats allocator;
 
 		/**
-		* Unregister a system.
+		* Get the stats of a component type. Returns nullptr if the world has no storage for the type.
 		*/
-		void unregisterSystem(EntitySystem* system)
-		{
-			systems.erase(std::remove(systems.begin(), systems.end(), system), systems.end());
-			system->unconfigure(this);
-		}
+		template<typename T>
+		const ComponentMemoryStats* getComponent() const;
 
-		void enableSystem(EntitySystem* system)
+		MemoryUsage getTotal() const
 		{
-			auto it = std::find(disabledSystems.begin(), disabledSystems.end(), system);
-			if (it != disabledSystems.end())
+			MemoryUsage total;
+			for (auto& component : components)
 			{
-				disabledSystems.erase(it);
-				systems.push_back(system);
+				total.add(component.components);
+				total.add(component.bookkeeping);
 			}
-		}
 
-		void disableSystem(EntitySystem* system)
-		{
-			auto it = std::find(systems.begin(), systems.end(), system);
-			if (it != systems.end())
-			{
-				systems.erase(it);
-				disabledSystems.push_back(system);
-			}
+			total.add(entities);
+			total.add(storage);
+			total.add(events);
+			total.add(commands);
+			total.add(arena);
+			total.add(queries);
+			total.add(resources);
+			total.add(systems);
+			return total;
 		}
 
 		/**
-		* Subscribe to an event.
+		* Get the bytes allocated per entity for everything but the components themselves.
 		*/
-		template<typename T>
-		void subscribe(EventSubscriber<T>* subscriber)
+		double getOverheadPerEntity() const
 		{
-			auto index = getTypeIndex<T>();
-			auto found = subscribers.find(index);
-			if (found == subscribers.end())
-			{
-				std::vector<Internal::BaseEventSubscriber*, SubscriberPtrAllocator> subList(entAlloc);
-				subList.push_back(subscriber);
+			if (entityCount == 0)
+				return 0.0;
 
-				subscribers.insert({ index, subList });
-			}
-			else
+			size_t overhead = getTotal().allocated;
+			for (auto& component : components)
 			{
-				found->second.push_back(subscriber);
+				overhead -= component.components.used;
 			}
+
+			return static_cast<double>(overhead) / entityCount;
 		}
+	};
+
+	// Do not use anything in the Internal namespace yourself.
+	namespace Internal
+	{
+		template<typename... Types>
+		class EntityComponentView;
+
+		class EntityView;
+
+		class BaseQuery;
 
-		/**
-		* Unsubscribe from an event.
-		*/
 		template<typename T>
-		void unsubscribe(EventSubscriber<T>* subscriber)
+		struct VoidType
 		{
-			auto index = getTypeIndex<T>();
-			auto found = subscribers.find(index);
-			if (found != subscribers.end())
-			{
-				found->second.erase(std::remove(found->second.begin(), found->second.end(), subscriber), found->second.end());
-				if (found->second.size() == 0)
-				{
-					subscribers.erase(found);
-				}
-			}
-		}
+			typedef void type;
+		};
 
-		/**
-		* Unsubscribe from all events. Don't be afraid of the void pointer, just pass in your subscriber as normal.
-		*/
-		void unsubscribeAll(void* subscriber)
+		// Is a component type stored as a structure of arrays? See SoA.
+		template<typename T, typename = void>
+		struct IsSoA : std::false_type
 		{
-			for (auto kv : subscribers)
+		};
+
+		template<typename T>
+		struct IsSoA<T, typename VoidType<typename T::SoAFields>::type> : std::true_type
+		{
+		};
+
+		// Is a component type a tag? Tags are empty, trivial types, which the world only keeps track of the membership of
+		// rather than storing them.
+		template<typename T>
+		struct IsTag : std::integral_constant<bool, std::is_empty<T>::value && std::is_trivial<T>::value && !IsSoA<T>::value>
+		{
+		};
+
+		template<typename... Types>
+		struct AnySoA : std::false_type
+		{
+		};
+
+		template<typename First, typename... Rest>
+		struct AnySoA<First, Rest...> : std::integral_constant<bool, IsSoA<First>::value || AnySoA<Rest...>::value>
+		{
+		};
+
+		template<typename... Types>
+		struct AllSoA : std::true_type
+		{
+		};
+
+		template<typename First, typename... Rest>
+		struct AllSoA<First, Rest...> : std::integral_constant<bool, IsSoA<First>::value && AllSoA<Rest...>::value>
+		{
+		};
+
+		template<bool... Values>
+		struct AllTrue : std::true_type
+		{
+		};
+
+		template<bool First, bool... Rest>
+		struct AllTrue<First, Rest...> : std::integral_constant<bool, First && AllTrue<Rest...>::value>
+		{
+		};
+
+		template<typename M>
+		struct MemberTraits;
+
+		template<typename T, typename F>
+		struct MemberTraits<F T::*>
+		{
+			typedef T Class;
+			typedef F Type;
+		};
+
+		template<typename T, typename F>
+		bool isSameMember(F T::* a, F T::* b)
+		{
+			return a == b;
+		}
+
+		template<typename T, typename F, typename G>
+		bool isSameMember(F T::*, G T::*)
+		{
+			return false;
+		}
+
+#ifndef ECS_ARCHETYPE_STORAGE
+		class BaseComponentPool;
+
+		template<typename T, bool bSoA = IsSoA<T>::value, bool bTag = IsTag<T>::value>
+		class ComponentPool;
+#endif
+
+		class BaseEventSubscriber
+		{
+		public:
+			virtual ~BaseEventSubscriber() {};
+		};
+
+		/**
+		* A member function or callable subscribed to a single event type. The world calls these through plain function
+		* pointers to a thunk that knows the type of the object, instead of through a vtable.
+		*/
+		struct EventCallback
+		{
+			void* object;
+
+			// What World::unsubscribeAll() compares against.
+			const void* owner;
+
+			void (*receive)(void* object, World* world, const void* event);
+			void (*receiveBatch)(void* object, World* world, const void* events, size_t count);
+
+			// Only set if the world owns the object (for callables), in which case it is called once unsubscribed.
+			void (*destroy)(void* object, World* world);
+		};
+
+		struct EntitySlot
+		{
+			Entity* entity = nullptr;
+			uint32_t generation = 0;
+		};
+
+		template<size_t... Indices>
+		struct IndexSequence
+		{
+		};
+
+		template<size_t N, size_t... Indices>
+		struct MakeIndexSequence : MakeIndexSequence<N - 1, N - 1, Indices...>
+		{
+		};
+
+		template<size_t... Indices>
+		struct MakeIndexSequence<0, Indices...>
+		{
+			typedef IndexSequence<Indices...> Type;
+		};
+
+		// Is T one of Types?
+		template<typename T, typename... Types>
+		struct IsAnyOf : std::false_type
+		{
+		};
+
+		template<typename T, typename First, typename... Rest>
+		struct IsAnyOf<T, First, Rest...> : std::integral_constant<bool, std::is_same<T, First>::value || IsAnyOf<T, Rest...>::value>
+		{
+		};
+
+		// Is every type in Types different from the others?
+		template<typename... Types>
+		struct AreDistinct : std::true_type
+		{
+		};
+
+		template<typename First, typename... Rest>
+		struct AreDistinct<First, Rest...> : std::integral_constant<bool, !IsAnyOf<First, Rest...>::value && AreDistinct<Rest...>::value>
+		{
+		};
+
+		// How a component given to World::each() filters the entities it visits, see Changed and Added.
+		enum class TermFilter
+		{
+			None,
+			Changed,
+			Added
+		};
+
+		// Is change tick a newer than change tick b? Ticks wrap around, so this only holds for ticks less than 2^31 apart.
+		inline bool isTickNewer(uint32_t a, uint32_t b)
+		{
+			return static_cast<int32_t>(a - b) > 0;
+		}
+
+		/**
+		* A set of component types, stored as one bit per component id (see getComponentId()).
+		*/
+		class ComponentMask
+		{
+		public:
+			static const size_t WordCount = (ECS_MAX_COMPONENTS + 63) / 64;
+
+			ComponentMask()
+				: words()
+			{
+			}
+
+			void set(uint32_t id)
+			{
+				words[id / 64] |= uint64_t(1) << (id % 64);
+			}
+
+			void reset(uint32_t id)
+			{
+				words[id / 64] &= ~(uint64_t(1) << (id % 64));
+			}
+
+			bool test(uint32_t id) const
+			{
+				return (words[id / 64] & (uint64_t(1) << (id % 64))) != 0;
+			}
+
+			// Is every component in other also in this mask?
+			bool containsAll(const ComponentMask& other) const
+			{
+				for (size_t i = 0; i < WordCount; ++i)
+				{
+					if ((words[i] & other.words[i]) != other.words[i])
+						return false;
+				}
+
+				return true;
+			}
+
+			// Does this mask have any component in common with other?
+			bool intersects(const ComponentMask& other) const
+			{
+				for (size_t i = 0; i < WordCount; ++i)
+				{
+					if ((words[i] & other.words[i]) != 0)
+						return true;
+				}
+
+				return false;
+			}
+
+			bool operator==(const ComponentMask& other) const
+			{
+				return std::equal(words, words + WordCount, other.words);
+			}
+
+			bool operator!=(const ComponentMask& other) const
+			{
+				return !(*this == other);
+			}
+
+		private:
+			uint64_t words[WordCount];
+		};
+
+		// Component ids index fixed size masks and arrays, so running out of them can't go on, not even in release builds.
+		inline uint32_t checkComponentId(uint32_t id)
+		{
+			if (id >= ECS_MAX_COMPONENTS)
+			{
+				std::fprintf(stderr, "ECS: More than %u component types are used, increase ECS_MAX_COMPONENTS\n", static_cast<unsigned>(ECS_MAX_COMPONENTS));
+				std::abort();
+			}
+
+			return id;
+		}
+
+		/**
+		* Get the dense id of a component type. Ids are handed out in the order component types are first used, starting at 0.
+		* Using more than ECS_MAX_COMPONENTS component types aborts the program.
+		*/
+		template<typename T>
+		uint32_t getComponentId()
+		{
+			static const uint32_t id = checkComponentId(TypeIdRegistry<ComponentFamily>::template get<T>());
+			return id;
+		}
+
+		// Get the memory stats of a component type by id, adding them if the type wasn't counted yet.
+		inline ComponentMemoryStats& getComponentMemory(MemoryStats& stats, uint32_t id)
+		{
+			for (size_t i = stats.components.size(); i <= id; ++i)
+			{
+				stats.components.emplace_back();
+				stats.components.back().componentId = static_cast<uint32_t>(i);
+			}
+
+			return stats.components[id];
+		}
+
+		template<typename... Types>
+		ComponentMask makeComponentMask()
+		{
+			ComponentMask mask;
+			const uint32_t ids[] = { 0, getComponentId<Types>()... };
+			for (size_t i = 1; i < sizeof(ids) / sizeof(ids[0]); ++i)
+			{
+				mask.set(ids[i]);
+			}
+
+			return mask;
+		}
+
+		/**
+		* Get the mask of a list of component types. The mask is only built once per list.
+		*/
+		template<typename... Types>
+		const ComponentMask& getComponentMask()
+		{
+			static const ComponentMask mask = makeComponentMask<Types...>();
+			return mask;
+		}
+
+#ifdef ECS_ARCHETYPE_STORAGE
+		/**
+		* Type-erased operations on a component type, for storage that doesn't know the type of its components.
+		*/
+		struct ComponentInfo
+		{
+			uint32_t id;
+			size_t size;
+			size_t alignment;
+
+			void(*moveConstruct)(void* dest, void* src);
+			void(*destruct)(void* component);
+
+			// Emits OnComponentRemoved for the component.
+			void(*removed)(Entity* ent, void* component);
+
+			// Components stored as structures of arrays (see SoA) are moved field by field instead of with moveConstruct and
+			// destruct, which are nullptr for them. fieldCount is 0 for every other component.
+			size_t fieldCount;
+			const size_t* fieldSizes;
+
+			// Tags (see IsTag) aren't stored. Every row of an archetype shares the same component, which is never moved.
+			bool bTag;
+		};
+
+		template<typename T>
+		const ComponentInfo* getComponentInfo();
+
+		typedef std::max_align_t ArchetypeChunkBlock;
+
+		/**
+		* All entities with the exact same set of components. Components are stored in chunks, each of which holds an array of
+		* entities followed by one contiguous array per component type (or per field, for components stored as structures of
+		* arrays), and then by the change ticks of every component.
+		*/
+		class Archetype
+		{
+		public:
+			// The components must be sorted by id.
+			Archetype(const std::vector<const ComponentInfo*>& components)
+				: components(components)
+			{
+				size_t rowSize = sizeof(Entity*);
+				size_t padding = 0;
+				bool bHasFields = false;
+				for (size_t column = 0; column < components.size(); ++column)
+				{
+					const ComponentInfo* info = components[column];
+					if (info->id >= columns.size())
+						columns.resize(info->id + 1, -1);
+
+					columns[info->id] = static_cast<int>(column);
+					mask.set(info->id);
+					rowSize += (info->bTag ? 0 : info->size) + 2 * sizeof(uint32_t);
+					padding += (info->fieldCount > 0 ? info->fieldCount * ECS_SOA_ALIGNMENT : info->alignment) + alignof(uint32_t);
+					bHasFields = bHasFields || info->fieldCount > 0;
+				}
+
+				chunkCapacity = ECS_ARCHETYPE_CHUNK_SIZE > padding + rowSize ? (ECS_ARCHETYPE_CHUNK_SIZE - padding) / rowSize : 1;
+
+				size_t offset = chunkCapacity * sizeof(Entity*);
+				for (auto* info : components)
+				{
+					firstFields.push_back(fieldOffsets.size());
+					if (info->fieldCount > 0)
+					{
+						for (size_t field = 0; field < info->fieldCount; ++field)
+						{
+							offset = (offset + ECS_SOA_ALIGNMENT - 1) / ECS_SOA_ALIGNMENT * ECS_SOA_ALIGNMENT;
+							fieldOffsets.push_back(offset);
+							offset += chunkCapacity * info->fieldSizes[field];
+						}
+
+						// getComponent() points at the first field.
+						offsets.push_back(fieldOffsets[firstFields.back()]);
+						strides.push_back(info->fieldSizes[0]);
+						continue;
+					}
+
+					// A tag takes up the space of a single component per chunk, which every row points to.
+					offset = (offset + info->alignment - 1) / info->alignment * info->alignment;
+					offsets.push_back(offset);
+					strides.push_back(info->bTag ? 0 : info->size);
+					offset += info->bTag ? info->size : chunkCapacity * info->size;
+				}
+
+				// The added ticks of every column, then the changed ticks of every column.
+				offset = (offset + alignof(uint32_t) - 1) / alignof(uint32_t) * alignof(uint32_t);
+				tickOffset = offset;
+				offset += 2 * components.size() * chunkCapacity * sizeof(uint32_t);
+
+				chunkBlocks = (offset + sizeof(ArchetypeChunkBlock) - 1) / sizeof(ArchetypeChunkBlock);
+				chunkTicks.resize(components.size());
+
+				// Field arrays are aligned relative to the start of a chunk, so chunks need to start aligned as well.
+				if (bHasFields)
+				{
+					chunkAlignment = ECS_SOA_ALIGNMENT;
+					chunkBlocks += (ECS_SOA_ALIGNMENT - alignof(ArchetypeChunkBlock) + sizeof(ArchetypeChunkBlock) - 1) / sizeof(ArchetypeChunkBlock);
+				}
+			}
+
+			size_t getCount() const
+			{
+				return count;
+			}
+
+			size_t getChunkCapacity() const
+			{
+				return chunkCapacity;
+			}
+
+			size_t getColumnCount() const
+			{
+				return components.size();
+			}
+
+			const ComponentInfo* getInfo(size_t column) const
+			{
+				return components[column];
+			}
+
+			// Returns -1 if this archetype doesn't have a component type.
+			int findColumn(uint32_t componentId) const
+			{
+				return componentId < columns.size() ? columns[componentId] : -1;
+			}
+
+			template<typename... Types>
+			bool has() const
+			{
+				return mask.containsAll(getComponentMask<Types...>());
+			}
+
+			const ComponentMask& getMask() const
+			{
+				return mask;
+			}
+
+			Entity* getEntity(size_t row) const
+			{
+				return reinterpret_cast<Entity**>(chunks[row / chunkCapacity])[row % chunkCapacity];
+			}
+
+			// For components stored as structures of arrays, this is the first field of the component.
+			void* getComponent(size_t column, size_t row) const
+			{
+				unsigned char* chunk = reinterpret_cast<unsigned char*>(chunks[row / chunkCapacity]);
+				return chunk + offsets[column] + (row % chunkCapacity) * strides[column];
+			}
+
+			// Get a field of a component stored as a structure of arrays.
+			void* getField(size_t column, size_t field, size_t row) const
+			{
+				unsigned char* chunk = reinterpret_cast<unsigned char*>(chunks[row / chunkCapacity]);
+				return chunk + fieldOffsets[firstFields[column] + field] + (row % chunkCapacity) * components[column]->fieldSizes[field];
+			}
+
+			// Get a pointer to every field of a component stored as a structure of arrays.
+			void getFields(size_t column, size_t row, void** fields) const
+			{
+				for (size_t field = 0; field < components[column]->fieldCount; ++field)
+				{
+					fields[field] = getField(column, field, row);
+				}
+			}
+
+			// Construct the component of a row whose component is uninitialized.
+			template<typename T, typename... Args>
+			void construct(size_t column, size_t row, Args&&... args)
+			{
+				construct<T>(IsSoA<T>(), column, row, std::forward<Args>(args)...);
+			}
+
+			// Move a component from a row of this archetype or another one into a row whose component is uninitialized,
+			// destroying the source component.
+			void moveComponent(size_t column, size_t row, const Archetype& source, size_t sourceColumn, size_t sourceRow)
+			{
+				const ComponentInfo* info = components[column];
+				if (info->bTag)
+					return;
+
+				if (info->fieldCount == 0)
+				{
+					void* component = source.getComponent(sourceColumn, sourceRow);
+					info->moveConstruct(getComponent(column, row), component);
+					info->destruct(component);
+					return;
+				}
+
+				for (size_t field = 0; field < info->fieldCount; ++field)
+				{
+					std::memcpy(getField(column, field, row), source.getField(sourceColumn, field, sourceRow), info->fieldSizes[field]);
+				}
+			}
+
+			void destroyComponent(size_t column, size_t row)
+			{
+				if (components[column]->fieldCount == 0 && !components[column]->bTag)
+					components[column]->destruct(getComponent(column, row));
+			}
+
+			// The entities of the rows in a chunk, starting at row chunk * getChunkCapacity().
+			Entity** getChunkEntities(size_t chunk) const
+			{
+				return reinterpret_cast<Entity**>(chunks[chunk]);
+			}
+
+			// The components of a column in a chunk, starting at row chunk * getChunkCapacity().
+			void* getChunkComponents(size_t column, size_t chunk) const
+			{
+				return reinterpret_cast<unsigned char*>(chunks[chunk]) + offsets[column];
+			}
+
+			// Incremented whenever components are moved within this archetype or moved out of it.
+			const uint32_t* getVersion() const
+			{
+				return &version;
+			}
+
+			// The ticks components of a column in a chunk were added at, see World::getChangeTick().
+			uint32_t* getChunkAddedTicks(size_t column, size_t chunk) const
+			{
+				return reinterpret_cast<uint32_t*>(reinterpret_cast<unsigned char*>(chunks[chunk]) + tickOffset) + column * chunkCapacity;
+			}
+
+			// The ticks components of a column in a chunk were last assigned or written to at.
+			uint32_t* getChunkChangedTicks(size_t column, size_t chunk) const
+			{
+				return getChunkAddedTicks(column + components.size(), chunk);
+			}
+
+			uint32_t getAddedTick(size_t column, size_t row) const
+			{
+				return getChunkAddedTicks(column, row / chunkCapacity)[row % chunkCapacity];
+			}
+
+			uint32_t getChangedTick(size_t column, size_t row) const
+			{
+				return getChunkChangedTicks(column, row / chunkCapacity)[row % chunkCapacity];
+			}
+
+			void setTicks(size_t column, size_t row, uint32_t added, uint32_t changed)
+			{
+				const size_t chunk = row / chunkCapacity;
+				getChunkAddedTicks(column, chunk)[row % chunkCapacity] = added;
+				getChunkChangedTicks(column, chunk)[row % chunkCapacity] = changed;
+
+				ChunkTicks& newest = chunkTicks[column];
+				if (isTickNewer(added, newest.added[chunk]))
+					newest.added[chunk] = added;
+				if (isTickNewer(changed, newest.changed[chunk]))
+					newest.changed[chunk] = changed;
+			}
+
+			void markChanged(size_t column, size_t row, uint32_t tick)
+			{
+				getChunkChangedTicks(column, row / chunkCapacity)[row % chunkCapacity] = tick;
+				markChunkChanged(column, row / chunkCapacity, tick);
+			}
+
+			// Mark a chunk as having changes on a column, without marking any of its rows. Do this before writing to the
+			// chunk's changed ticks directly.
+			void markChunkChanged(size_t column, size_t chunk, uint32_t tick)
+			{
+				chunkTicks[column].changed[chunk] = tick;
+			}
+
+			void markAllChunksChanged(size_t column, uint32_t tick)
+			{
+				std::fill(chunkTicks[column].changed.begin(), chunkTicks[column].changed.end(), tick);
+			}
+
+			// May any component of a column in a chunk pass a Changed or Added filter? Each chunk remembers the newest tick
+			// of its rows, so that chunks without any changes can be skipped without looking at their rows.
+			bool chunkPasses(TermFilter filter, size_t column, size_t chunk, uint32_t since) const
+			{
+				switch (filter)
+				{
+				case TermFilter::Changed:
+					return isTickNewer(chunkTicks[column].changed[chunk], since);
+				case TermFilter::Added:
+					return isTickNewer(chunkTicks[column].added[chunk], since);
+				default:
+					return true;
+				}
+			}
+
+			/**
+			* Add a row for an entity. The row's components are left uninitialized.
+			*/
+			template<typename Alloc>
+			size_t pushRow(Entity* ent, Alloc& alloc)
+			{
+				using ChunkAllocator = typename std::allocator_traits<Alloc>::template rebind_alloc<ArchetypeChunkBlock>;
+
+				if (count == chunks.size() * chunkCapacity)
+				{
+					ChunkAllocator chunkAlloc(alloc);
+					ArchetypeChunkBlock* chunk = std::allocator_traits<ChunkAllocator>::allocate(chunkAlloc, chunkBlocks);
+					rawChunks.push_back(chunk);
+					if (chunkAlignment > 0)
+					{
+						uintptr_t address = reinterpret_cast<uintptr_t>(chunk);
+						chunk = reinterpret_cast<ArchetypeChunkBlock*>((address + chunkAlignment - 1) & ~static_cast<uintptr_t>(chunkAlignment - 1));
+					}
+
+					chunks.push_back(chunk);
+					for (auto& newest : chunkTicks)
+					{
+						newest.added.push_back(0);
+						newest.changed.push_back(0);
+					}
+				}
+
+				size_t row = count++;
+				reinterpret_cast<Entity**>(chunks[row / chunkCapacity])[row % chunkCapacity] = ent;
+				for (size_t column = 0; column < components.size(); ++column)
+				{
+					getChunkAddedTicks(column, row / chunkCapacity)[row % chunkCapacity] = 0;
+					getChunkChangedTicks(column, row / chunkCapacity)[row % chunkCapacity] = 0;
+				}
+
+				return row;
+			}
+
+			/**
+			* Remove a row whose components have already been destroyed, filling the hole with the last row.
+			*/
+			template<typename Alloc>
+			void removeRow(size_t row, Alloc& alloc);
+
+			template<typename Alloc>
+			void releaseChunks(Alloc& alloc)
+			{
+				using ChunkAllocator = typename std::allocator_traits<Alloc>::template rebind_alloc<ArchetypeChunkBlock>;
+
+				ChunkAllocator chunkAlloc(alloc);
+				for (auto* chunk : rawChunks)
+				{
+					std::allocator_traits<ChunkAllocator>::deallocate(chunkAlloc, chunk, chunkBlocks);
+				}
+
+				chunks.clear();
+				rawChunks.clear();
+				for (auto& newest : chunkTicks)
+				{
+					newest.added.clear();
+					newest.changed.clear();
+				}
+			}
+
+			/**
+			* Count the memory of the archetype. Rows that chunks have room for but don't use are slack.
+			*/
+			void countMemory(MemoryStats& stats) const
+			{
+				const size_t rows = chunks.size() * chunkCapacity;
+				size_t counted = rows * sizeof(Entity*);
+
+				for (size_t column = 0; column < components.size(); ++column)
+				{
+					const ComponentInfo* info = components[column];
+					ComponentMemoryStats& component = getComponentMemory(stats, info->id);
+					component.count += count;
+
+					if (info->bTag)
+					{
+						// A single shared component per chunk.
+						component.components.add(chunks.size() * info->size, chunks.size() * info->size);
+						counted += chunks.size() * info->size;
+					}
+					else
+					{
+						size_t size = info->size;
+						if (info->fieldCount > 0)
+						{
+							size = 0;
+							for (size_t field = 0; field < info->fieldCount; ++field)
+							{
+								size += info->fieldSizes[field];
+							}
+						}
+
+						component.size = size;
+						component.components.add(count * size, rows * size);
+						counted += rows * size;
+					}
+
+					component.bookkeeping.add(count * 2 * sizeof(uint32_t), rows * 2 * sizeof(uint32_t));
+					component.bookkeeping.addVector(chunkTicks[column].added);
+					component.bookkeeping.addVector(chunkTicks[column].changed);
+					counted += rows * 2 * sizeof(uint32_t);
+				}
+
+				// Whatever the columns don't take up of the chunks is alignment padding.
+				const size_t chunkBytes = rawChunks.size() * chunkBlocks * sizeof(ArchetypeChunkBlock);
+				stats.storage.add(count * sizeof(Entity*), rows * sizeof(Entity*));
+				stats.storage.add(0, chunkBytes - counted);
+
+				stats.storage.add(sizeof(Archetype), sizeof(Archetype));
+				stats.storage.addVector(components);
+				stats.storage.addVector(offsets);
+				stats.storage.addVector(strides);
+				stats.storage.addVector(fieldOffsets);
+				stats.storage.addVector(firstFields);
+				stats.storage.addVector(chunks);
+				stats.storage.addVector(rawChunks);
+				stats.storage.addVector(chunkTicks);
+				stats.storage.addVector(columns);
+				stats.storage.addVector(addEdges);
+				stats.storage.addVector(removeEdges);
+			}
+
+			// Cached transitions to other archetypes, indexed by the id of the component that is added or removed.
+			std::vector<Archetype*> addEdges;
+			std::vector<Archetype*> removeEdges;
+
+		private:
+			// The newest change ticks of a column, by chunk. These only ever move forward, so they may be newer than any of the
+			// chunk's rows once rows were removed.
+			struct ChunkTicks
+			{
+				std::vector<uint32_t> added;
+				std::vector<uint32_t> changed;
+			};
+
+			template<typename T, typename... Args>
+			void construct(std::false_type, size_t column, size_t row, Args&&... args)
+			{
+				new (getComponent(column, row)) T(std::forward<Args>(args)...);
+			}
+
+			template<typename T, typename... Args>
+			void construct(std::true_type, size_t column, size_t row, Args&&... args)
+			{
+				void* fields[T::SoAFields::FieldCount];
+				getFields(column, row, fields);
+				T::SoAFields::store(T(std::forward<Args>(args)...), fields);
+			}
+
+			std::vector<const ComponentInfo*> components;
+			std::vector<size_t> offsets;
+
+			// The distance between the components of a column, which is the size of the first field for components stored as
+			// structures of arrays.
+			std::vector<size_t> strides;
+
+			// The offsets of the fields of components stored as structures of arrays, and where the fields of each column start.
+			std::vector<size_t> fieldOffsets;
+			std::vector<size_t> firstFields;
+
+			std::vector<ArchetypeChunkBlock*> chunks;
+
+			// The chunks as they were allocated, before aligning them.
+			std::vector<ArchetypeChunkBlock*> rawChunks;
+
+			std::vector<ChunkTicks> chunkTicks;
+			ComponentMask mask;
+
+			// The column of each component, indexed by component id.
+			std::vector<int> columns;
+
+			size_t chunkCapacity;
+			size_t chunkBlocks;
+			size_t chunkAlignment = 0;
+			size_t tickOffset;
+			size_t count = 0;
+			uint32_t version = 0;
+		};
+#endif
+
+		template<typename... Types>
+		class EntityComponentIterator
+		{
+		public:
+			EntityComponentIterator(World* world, size_t index, bool bIsEnd, bool bIncludePendingDestroy);
+
+			size_t getIndex() const
+			{
+				return index;
+			}
+
+			bool isEnd() const;
+
+			bool includePendingDestroy() const
+			{
+				return bIncludePendingDestroy;
+			}
+
+			World* getWorld() const
+			{
+				return world;
+			}
+
+			Entity* get() const;
+
+			Entity* operator*() const
+			{
+				return get();
+			}
+
+			bool operator==(const EntityComponentIterator<Types...>& other) const
+			{
+				if (world != other.world)
+					return false;
+
+				if (isEnd())
+					return other.isEnd();
+
+#ifdef ECS_ARCHETYPE_STORAGE
+				if (archetypeIndex != other.archetypeIndex)
+					return false;
+#endif
+
+				return index == other.index;
+			}
+
+			bool operator!=(const EntityComponentIterator<Types...>& other) const
+			{
+				return !(*this == other);
+			}
+
+			EntityComponentIterator<Types...>& operator++();
+
+		private:
+			bool bIsEnd = false;
+			size_t index;
+			class ECS::World* world;
+			bool bIncludePendingDestroy;
+
+#ifdef ECS_ARCHETYPE_STORAGE
+			// When using archetype storage, index is the row within the current archetype.
+			size_t archetypeIndex = 0;
+#else
+			// Otherwise, index is the position within the smallest pool of the components being iterated.
+			BaseComponentPool* pool = nullptr;
+#endif
+
+			// Move forward to the next entity that should be visited, starting at the current one.
+			void seek();
+		};
+
+		template<typename... Types>
+		class EntityComponentView
+		{
+		public:
+			EntityComponentView(const EntityComponentIterator<Types...>& first, const EntityComponentIterator<Types...>& last);
+
+			const EntityComponentIterator<Types...>& begin() const
+			{
+				return firstItr;
+			}
+
+			const EntityComponentIterator<Types...>& end() const
+			{
+				return lastItr;
+			}
+
+		private:
+			EntityComponentIterator<Types...> firstItr;
+			EntityComponentIterator<Types...> lastItr;
+		};
+	}
+
+	/**
+	* A handle to an entity. Unlike a pointer to an entity, a handle is safe to hold on to after the entity is destroyed: it will
+	* simply stop resolving to an entity (see World::resolve()), even if its index is reused by a new entity later on.
+	*
+	* Entity pointers convert to handles implicitly, so a handle may be passed wherever you have an Entity*.
+	*/
+	struct EntityHandle
+	{
+		// Index 0 is never used by an entity, so a default constructed handle never resolves.
+		const static uint32_t InvalidIndex = 0;
+
+		EntityHandle()
+			: index(InvalidIndex), generation(0)
+		{
+		}
+
+		EntityHandle(uint32_t index, uint32_t generation)
+			: index(index), generation(generation)
+		{
+		}
+
+		EntityHandle(const Entity* ent);
+
+		/**
+		* Pack this handle into a single 64-bit value, for example to send it over the network.
+		*/
+		uint64_t pack() const
+		{
+			return (static_cast<uint64_t>(generation) << 32) | index;
+		}
+
+		static EntityHandle unpack(uint64_t value)
+		{
+			return EntityHandle(static_cast<uint32_t>(value & 0xFFFFFFFF), static_cast<uint32_t>(value >> 32));
+		}
+
+		bool isNull() const
+		{
+			return index == InvalidIndex;
+		}
+
+		bool operator==(const EntityHandle& other) const
+		{
+			return index == other.index && generation == other.generation;
+		}
+
+		bool operator!=(const EntityHandle& other) const
+		{
+			return !(*this == other);
+		}
+
+		uint32_t index;
+		uint32_t generation;
+	};
+
+	/**
+	* Think of this as a pointer to a component. Whenever you get a component from the world or an entity,
+	* it'll be wrapped in a ComponentHandle.
+	*/
+	template<typename T>
+	class ComponentHandle
+	{
+	public:
+		ComponentHandle()
+			: component(nullptr)
+		{
+		}
+
+		ComponentHandle(T* component)
+			: component(component)
+		{
+		}
+
+		// Component storage moves components around, so handles to components owned by an entity keep track of the entity
+		// and look the component up again if it may have moved.
+		ComponentHandle(T* component, Entity* owner, const uint32_t* version);
+
+		T* operator->() const
+		{
+			return resolve();
+		}
+
+		operator bool() const
+		{
+			return isValid();
+		}
+
+		T& get()
+		{
+			return *resolve();
+		}
+
+		bool isValid() const
+		{
+			return resolve() != nullptr;
+		}
+
+	private:
+		T* resolve() const;
+
+		// Handles to components stored as structures of arrays point to copies, which never move.
+		static ComponentHandle<T> lookup(Entity* ent, std::false_type);
+		static ComponentHandle<T> lookup(Entity* ent, std::true_type)
+		{
+			return ComponentHandle<T>();
+		}
+
+		mutable T* component;
+		mutable const uint32_t* version = nullptr;
+		mutable uint32_t seenVersion = 0;
+		World* world = nullptr;
+		EntityHandle owner;
+	};
+
+	/**
+	* One field of a component stored as a structure of arrays, see SoA. Use ECS_SOA_FIELD(Type, member) to name a field.
+	*/
+	template<typename M, M Member>
+	struct SoAField
+	{
+		typedef typename Internal::MemberTraits<M>::Type Type;
+
+		static_assert(std::is_trivially_copyable<Type>::value, "The fields of components stored as structures of arrays must be trivially copyable.");
+
+		static M member()
+		{
+			return Member;
+		}
+	};
+
+#define ECS_SOA_FIELD(type, member) ::ECS::SoAField<decltype(&type::member), &type::member>
+
+	/**
+	* Stores a component type as a structure of arrays: rather than storing whole components next to each other, the world
+	* keeps one array per field, aligned to ECS_SOA_ALIGNMENT bytes, so that systems can run SIMD kernels over them with
+	* World::eachSoA(). To opt a component type in, list all of its fields in a typedef named SoAFields:
+	*
+	*     struct Position
+	*     {
+	*         float x;
+	*         float y;
+	*
+	*         typedef SoA<ECS_SOA_FIELD(Position, x), ECS_SOA_FIELD(Position, y)> SoAFields;
+	*     };
+	*
+	* Such components must be trivially copyable. As there is no single object to point to, Entity::get() and Entity::assign()
+	* return an SoAHandle instead of a ComponentHandle, and component events get a copy of the component. They can only be
+	* iterated over with World::eachSoA(), not with each(), parallelEach() or queries.
+	*/
+	template<typename... Fields>
+	struct SoA
+	{
+		static_assert(sizeof...(Fields) > 0, "A structure of arrays needs at least one field.");
+
+		static const size_t FieldCount = sizeof...(Fields);
+
+		template<size_t Index>
+		using FieldType = typename std::tuple_element<Index, std::tuple<typename Fields::Type...>>::type;
+
+		// The size of every field, in bytes.
+		static const size_t* getFieldSizes()
+		{
+			static const size_t sizes[] = { sizeof(typename Fields::Type)... };
+			return sizes;
+		}
+
+		// Get the index of the field a member pointer refers to, or FieldCount if it isn't one of the fields.
+		template<typename T, typename F>
+		static size_t indexOf(F T::* member)
+		{
+			const bool matches[] = { Internal::isSameMember(Fields::member(), member)... };
+			for (size_t i = 0; i < FieldCount; ++i)
+			{
+				if (matches[i])
+					return i;
+			}
+
+			return FieldCount;
+		}
+
+		// Copy a component out of pointers to each of its fields.
+		template<typename T>
+		static void load(T& component, void* const* fields)
+		{
+			loadFields(component, fields, typename Internal::MakeIndexSequence<FieldCount>::Type());
+		}
+
+		// Copy a component into pointers to each of its fields.
+		template<typename T>
+		static void store(const T& component, void* const* fields)
+		{
+			storeFields(component, fields, typename Internal::MakeIndexSequence<FieldCount>::Type());
+		}
+
+	private:
+		template<typename T, size_t... Indices>
+		static void loadFields(T& component, void* const* fields, Internal::IndexSequence<Indices...>)
+		{
+			int expand[] = { 0, (component.*Fields::member() = *static_cast<const typename Fields::Type*>(fields[Indices]), 0)... };
+			(void)expand;
+		}
+
+		template<typename T, size_t... Indices>
+		static void storeFields(const T& component, void* const* fields, Internal::IndexSequence<Indices...>)
+		{
+			int expand[] = { 0, (*static_cast<typename Fields::Type*>(fields[Indices]) = component.*Fields::member(), 0)... };
+			(void)expand;
+		}
+	};
+
+	/**
+	* The field arrays of a run of components stored as structures of arrays, as handed out by World::eachSoA(). Get an array
+	* with a member pointer, or with the index of the field in SoAFields:
+	*
+	*     float* x = positions[&Position::x];
+	*     float* y = positions.field<1>();
+	*
+	* The arrays are const if the component type is.
+	*/
+	template<typename T>
+	class SoAArrays
+	{
+	public:
+		typedef typename std::remove_const<T>::type Component;
+		typedef typename Component::SoAFields Layout;
+
+		template<typename F>
+		using Qualified = typename std::conditional<std::is_const<T>::value, const F, F>::type;
+
+		// Takes a pointer to the first element of every field array.
+		explicit SoAArrays(void* const* fields)
+		{
+			std::copy(fields, fields + Layout::FieldCount, arrays);
+		}
+
+		template<typename F>
+		Qualified<F>* operator[](F Component::* member) const
+		{
+			const size_t index = Layout::indexOf(member);
+			assert(index < Layout::FieldCount && "The member isn't one of the fields listed in SoAFields");
+			return static_cast<Qualified<F>*>(arrays[index]);
+		}
+
+		template<size_t Index>
+		Qualified<typename Layout::template FieldType<Index>>* field() const
+		{
+			return static_cast<Qualified<typename Layout::template FieldType<Index>>*>(arrays[Index]);
+		}
+
+	private:
+		void* arrays[Layout::FieldCount];
+	};
+
+	/**
+	* A handle to a component stored as a structure of arrays (see SoA). Its fields are stored apart from each other, so they
+	* are accessed one at a time, or copied out and back in as a whole:
+	*
+	*     SoAHandle<Position> position = ent->get<Position>();
+	*     position[&Position::x] += 1.f;
+	*     Position copy = position.get();
+	*
+	* A handle looks the component up every time it is used, so it stays valid for as long as the entity has the component.
+	* Like writing through a ComponentHandle, writing through an SoAHandle doesn't mark the component as changed.
+	*/
+	template<typename T>
+	class SoAHandle
+	{
+	public:
+		typedef typename T::SoAFields Layout;
+
+		SoAHandle()
+		{
+		}
+
+		SoAHandle(Entity* owner);
+
+		template<typename F>
+		F& operator[](F T::* member) const
+		{
+			const size_t index = Layout::indexOf(member);
+			assert(index < Layout::FieldCount && "The member isn't one of the fields listed in SoAFields");
+			return *static_cast<F*>(getField(index));
+		}
+
+		template<size_t Index>
+		typename Layout::template FieldType<Index>& field() const
+		{
+			return *static_cast<typename Layout::template FieldType<Index>*>(getField(Index));
+		}
+
+		// Copy the component out.
+		T get() const;
+
+		// Overwrite the component.
+		void set(const T& component) const;
+
+		operator bool() const
+		{
+			return isValid();
+		}
+
+		bool isValid() const;
+
+	private:
+		// Fills in a pointer to every field, returns false if the component is gone.
+		bool getFields(void** fields) const;
+
+		void* getField(size_t index) const
+		{
+			void* fields[Layout::FieldCount];
+			bool bValid = getFields(fields);
+			assert(bValid && "The component of an SoAHandle is gone");
+			(void)bValid;
+			return fields[index];
+		}
+
+		World* world = nullptr;
+		EntityHandle owner;
+	};
+
+	/**
+	* Filters for World::each() and World::parallelEach(). Changed<T> only visits entities whose T was assigned or written to
+	* since the running system last ran, and Added<T> only those that got their T since then. The callback still gets the
+	* component itself:
+	*
+	*     world->each<Changed<Position>>([](Entity* ent, Position& position) { ... });
+	*
+	* See World::getChangeTick() for when components count as written to.
+	*/
+	template<typename T>
+	struct Changed
+	{
+	};
+
+	template<typename T>
+	struct Added
+	{
+	};
+
+	/**
+	* Terms for World::each(), World::parallelEach() and World::eachChunk(), which can be mixed with plain component types:
+	*
+	*     All<A, B>     The entity must have A and B, which are passed to the callback. This is the same as listing A, B.
+	*     None<C, D>    The entity must have neither C nor D. Nothing is passed.
+	*     Any<E, F>     The entity must have E, F or both. Nothing is passed.
+	*     Optional<G>   G is passed if the entity has one: as a pointer that is nullptr if it doesn't, or as a handle that is
+	*                   invalid if it doesn't. Not supported by eachChunk().
+	*
+	*     world->each<All<Position, const Velocity>, None<Frozen>, Optional<Drag>>(
+	*         [](Position& position, const Velocity& velocity, Drag* drag) { ... });
+	*
+	* The terms are turned into component masks once per list of terms. Archetypes that don't match are skipped as a whole,
+	* and entities that don't match are skipped before the callback is called. At least one component has to be required
+	* (listed plainly or in All) for anything to be visited.
+	*/
+	template<typename... Types>
+	struct All
+	{
+	};
+
+	template<typename... Types>
+	struct None
+	{
+	};
+
+	template<typename... Types>
+	struct Any
+	{
+	};
+
+	template<typename T>
+	struct Optional
+	{
+	};
+
+	namespace Internal
+	{
+		// What Entity::get() and Entity::assign() return for a component type.
+		template<typename T>
+		struct HandleOf
+		{
+			typedef typename std::conditional<IsSoA<T>::value, SoAHandle<T>, ComponentHandle<T>>::type Type;
+		};
+
+		// What World::eachChunk() passes for a component type, which may be const.
+		template<typename T>
+		struct ChunkArray
+		{
+			typedef typename std::conditional<IsSoA<typename std::remove_const<T>::type>::value, SoAArrays<T>, T*>::type Type;
+		};
+
+		// Calls a function given to World::eachSoA() from eachChunk(), leaving out the entities.
+		template<typename Func>
+		struct WithoutEntities
+		{
+			Func& func;
+
+			template<typename... Arrays>
+			void operator()(size_t count, Entity* const*, Arrays... arrays)
+			{
+				func(count, arrays...);
+			}
+		};
+
+		// A pointer to an optional component, which is nullptr if the entity doesn't have one. See Optional.
+		template<typename T>
+		struct OptionalPtr
+		{
+			T* ptr;
+
+			OptionalPtr operator+(size_t offset) const
+			{
+				OptionalPtr result = { ptr != nullptr ? ptr + offset : nullptr };
+				return result;
+			}
+		};
+
+		/**
+		* What a type given to World::each() stands for: a component type, optionally const (the component is only read, so
+		* it isn't marked as changed), and optionally wrapped in Changed, Added or Optional.
+		*/
+		template<typename T>
+		struct Term
+		{
+			typedef T Component;
+
+			// What the callback gets a reference to.
+			typedef T Argument;
+
+			// What the callback gets when it doesn't take handles.
+			typedef T& Reference;
+
+			// What the loops in World point to the component with.
+			typedef T* Pointer;
+
+			static const TermFilter filter = TermFilter::None;
+
+			static const bool bOptional = false;
+		};
+
+		template<typename T>
+		struct Term<const T> : Term<T>
+		{
+			typedef const T Argument;
+			typedef const T& Reference;
+			typedef const T* Pointer;
+		};
+
+		template<typename T>
+		struct Term<Optional<T>> : Term<T>
+		{
+			static_assert(Term<T>::filter == TermFilter::None, "Optional components can't be wrapped in Changed or Added");
+
+			typedef typename Term<T>::Argument* Reference;
+			typedef OptionalPtr<typename Term<T>::Argument> Pointer;
+
+			static const bool bOptional = true;
+		};
+
+		template<typename T>
+		struct Term<Changed<T>> : Term<T>
+		{
+			static const TermFilter filter = TermFilter::Changed;
+		};
+
+		template<typename T>
+		struct Term<Added<T>> : Term<T>
+		{
+			static const TermFilter filter = TermFilter::Added;
+		};
+
+		template<typename... Types>
+		struct TypeList
+		{
+		};
+
+		// Expand All and drop None and Any from a list of terms given to World::each(), leaving what is passed to the callback.
+		template<typename Done, typename... Types>
+		struct FlattenTerms;
+
+		template<typename... Done>
+		struct FlattenTerms<TypeList<Done...>>
+		{
+			typedef TypeList<Done...> Type;
+		};
+
+		template<typename... Done, typename First, typename... Rest>
+		struct FlattenTerms<TypeList<Done...>, First, Rest...> : FlattenTerms<TypeList<Done..., First>, Rest...>
+		{
+		};
+
+		template<typename... Done, typename... Types, typename... Rest>
+		struct FlattenTerms<TypeList<Done...>, All<Types...>, Rest...> : FlattenTerms<TypeList<Done...>, Types..., Rest...>
+		{
+		};
+
+		template<typename... Done, typename... Types, typename... Rest>
+		struct FlattenTerms<TypeList<Done...>, None<Types...>, Rest...> : FlattenTerms<TypeList<Done...>, Rest...>
+		{
+		};
+
+		template<typename... Done, typename... Types, typename... Rest>
+		struct FlattenTerms<TypeList<Done...>, Any<Types...>, Rest...> : FlattenTerms<TypeList<Done...>, Rest...>
+		{
+		};
+
+		template<typename Arguments>
+		struct HandleFunctionOf;
+
+		template<typename... Terms>
+		struct HandleFunctionOf<TypeList<Terms...>>
+		{
+			typedef std::function<void(Entity*, ComponentHandle<typename Term<Terms>::Component>...)> Type;
+		};
+
+		template<typename Arguments>
+		struct AllSoATerms;
+
+		template<typename... Terms>
+		struct AllSoATerms<TypeList<Terms...>> : AllSoA<typename Term<Terms>::Component...>
+		{
+		};
+
+		// A list of types given to World::each().
+		template<typename... Types>
+		struct QueryTerms
+		{
+			// The terms of the components passed to the callback.
+			typedef typename FlattenTerms<TypeList<>, Types...>::Type Arguments;
+
+			typedef typename HandleFunctionOf<Arguments>::Type HandleFunction;
+		};
+
+		// Which component signatures a list of types given to World::each() matches.
+		struct QueryMatcher
+		{
+			ComponentMask required;
+			ComponentMask excluded;
+
+			// The entity must have a component of every one of these.
+			std::vector<ComponentMask> any;
+
+			bool matches(const ComponentMask& signature) const
+			{
+				if (!signature.containsAll(required) || signature.intersects(excluded))
+					return false;
+
+				for (auto& mask : any)
+				{
+					if (!signature.intersects(mask))
+						return false;
+				}
+
+				return true;
+			}
+		};
+
+		template<typename T>
+		void addQueryTerm(QueryMatcher& matcher, TypeList<T>)
+		{
+			matcher.required.set(getComponentId<typename Term<T>::Component>());
+		}
+
+		template<typename T>
+		void addQueryTerm(QueryMatcher&, TypeList<Optional<T>>)
+		{
+		}
+
+		template<typename... Types>
+		void addQueryTerm(QueryMatcher& matcher, TypeList<All<Types...>>)
+		{
+			int expand[] = { 0, (addQueryTerm(matcher, TypeList<Types>()), 0)... };
+			(void)expand;
+		}
+
+		template<typename... Types>
+		void addQueryTerm(QueryMatcher& matcher, TypeList<None<Types...>>)
+		{
+			int expand[] = { 0, (matcher.excluded.set(getComponentId<typename std::remove_const<Types>::type>()), 0)... };
+			(void)expand;
+		}
+
+		template<typename... Types>
+		void addQueryTerm(QueryMatcher& matcher, TypeList<Any<Types...>>)
+		{
+			matcher.any.push_back(makeComponentMask<typename std::remove_const<Types>::type...>());
+		}
+
+		template<typename... Types>
+		QueryMatcher makeQueryMatcher()
+		{
+			QueryMatcher matcher;
+			int expand[] = { 0, (addQueryTerm(matcher, TypeList<Types>()), 0)... };
+			(void)expand;
+			return matcher;
+		}
+
+		/**
+		* Get the matcher of a list of types given to World::each(). The matcher is only built once per list.
+		*/
+		template<typename... Types>
+		const QueryMatcher& getQueryMatcher()
+		{
+			static const QueryMatcher matcher = makeQueryMatcher<Types...>();
+			return matcher;
+		}
+
+		// Collects the entities World::parallelEachRange() visits.
+		struct CollectEntities
+		{
+			std::vector<Entity*>& matched;
+
+			template<typename... Handles>
+			void operator()(Entity* ent, Handles...)
+			{
+				matched.push_back(ent);
+			}
+		};
+
+#ifdef ECS_PROFILING
+		// Counts the entities a World::each() callback is called for.
+		template<typename Func>
+		struct CountCalls
+		{
+			Func& func;
+			size_t count;
+
+			template<typename... Args>
+			void operator()(Args&&... args)
+			{
+				++count;
+				func(std::forward<Args>(args)...);
+			}
+		};
+
+		// Counts the entities in the chunks a World::eachChunk() callback is called for.
+		template<typename Func>
+		struct CountChunkEntities
+		{
+			Func& func;
+			size_t count;
+
+			template<typename... Args>
+			void operator()(size_t chunkCount, Args&&... args)
+			{
+				count += chunkCount;
+				func(chunkCount, std::forward<Args>(args)...);
+			}
+		};
+#endif
+
+		template<typename T>
+		struct IsStdFunction : std::false_type
+		{
+		};
+
+		template<typename Signature>
+		struct IsStdFunction<std::function<Signature>> : std::true_type
+		{
+		};
+
+		// Can a Func be called with a list of arguments?
+		template<typename Func, typename... Args>
+		struct IsCallable
+		{
+			template<typename F>
+			static auto test(int) -> decltype(std::declval<F&>()(std::declval<Args>()...), std::true_type());
+
+			template<typename F>
+			static std::false_type test(...);
+
+			static const bool value = decltype(test<Func>(0))::value;
+		};
+
+		// The ways each() and Entity::with() may call a function: with the entity and component handles, with the entity and
+		// references to the components, or with just references to the components.
+		enum class CallStyle
+		{
+			Handles,
+			EntityAndReferences,
+			References,
+			None
+		};
+
+		template<typename Func, typename Arguments>
+		struct EachCallStyleOf;
+
+		template<typename Func, typename... Terms>
+		struct EachCallStyleOf<Func, TypeList<Terms...>>
+		{
+			static const CallStyle value = IsCallable<Func, Entity*, ComponentHandle<typename Term<Terms>::Component>...>::value ? CallStyle::Handles
+				: IsCallable<Func, Entity*, typename Term<Terms>::Reference...>::value ? CallStyle::EntityAndReferences
+				: IsCallable<Func, typename Term<Terms>::Reference...>::value ? CallStyle::References
+				: CallStyle::None;
+		};
+
+		template<typename Func, typename... Types>
+		struct EachCallStyle : EachCallStyleOf<Func, typename QueryTerms<Types...>::Arguments>
+		{
+		};
+
+		template<typename Func, typename... Types>
+		struct WithCallStyle
+		{
+			static const CallStyle value = IsCallable<Func, ComponentHandle<Types>...>::value ? CallStyle::Handles
+				: IsCallable<Func, Types&...>::value ? CallStyle::References
+				: CallStyle::None;
+		};
+
+		// Only pick the templated overloads for callables that aren't std::function, which have overloads of their own.
+		template<typename Func, CallStyle Style>
+		struct EnableForCallable : std::enable_if<Style != CallStyle::None && !IsStdFunction<typename std::decay<Func>::type>::value>
+		{
+		};
+
+		// Components that are only read still get a regular handle.
+		template<typename T>
+		ComponentHandle<typename std::remove_const<T>::type> makeHandle(T* component, Entity* ent, const uint32_t* version)
+		{
+			return ComponentHandle<typename std::remove_const<T>::type>(const_cast<typename std::remove_const<T>::type*>(component), ent, version);
+		}
+
+		template<typename T>
+		ComponentHandle<typename std::remove_const<T>::type> makeHandle(OptionalPtr<T> component, Entity* ent, const uint32_t* version)
+		{
+			return component.ptr != nullptr ? makeHandle(component.ptr, ent, version) : ComponentHandle<typename std::remove_const<T>::type>();
+		}
+
+		template<typename T>
+		T& dereference(T* component)
+		{
+			return *component;
+		}
+
+		template<typename T>
+		T* dereference(OptionalPtr<T> component)
+		{
+			return component.ptr;
+		}
+
+		template<CallStyle Style>
+		struct Caller;
+
+		template<>
+		struct Caller<CallStyle::Handles>
+		{
+			template<typename Func, size_t... Indices, typename... Pointers>
+			static void call(Func& func, IndexSequence<Indices...>, const uint32_t* const* versions, Entity* ent, Pointers... components)
+			{
+				func(ent, makeHandle(components, ent, versions[Indices])...);
+			}
+
+			template<typename Func, typename... Types>
+			static void callWith(Func& func, ComponentHandle<Types>... components)
+			{
+				func(components...);
+			}
+		};
+
+		template<>
+		struct Caller<CallStyle::EntityAndReferences>
+		{
+			template<typename Func, size_t... Indices, typename... Pointers>
+			static void call(Func& func, IndexSequence<Indices...>, const uint32_t* const* versions, Entity* ent, Pointers... components)
+			{
+				func(ent, dereference(components)...);
+			}
+		};
+
+		template<>
+		struct Caller<CallStyle::References>
+		{
+			template<typename Func, size_t... Indices, typename... Pointers>
+			static void call(Func& func, IndexSequence<Indices...>, const uint32_t* const* versions, Entity* ent, Pointers... components)
+			{
+				func(dereference(components)...);
+			}
+
+			template<typename Func, typename... Types>
+			static void callWith(Func& func, ComponentHandle<Types>... components)
+			{
+				func(components.get()...);
+			}
+		};
+	}
+
+	/**
+	* What a system reads and writes, filled in by EntitySystem::declareAccess(). The world uses this to run systems that
+	* don't conflict with each other at the same time.
+	*
+	* Two systems conflict if either of them writes a type that the other one reads or writes, regardless of const (so
+	* reads<const Position>() conflicts with writes<Position>()). Events count as types too: subscribers run on the thread
+	* that emitted the event, so declare what your subscribers touch on the systems that emit it.
+	*/
+	class SystemAccess
+	{
+	public:
+		template<typename T>
+		SystemAccess& reads()
+		{
+			bDeclared = true;
+			readTypes.push_back(getTypeIndex<typename std::remove_cv<T>::type>());
+			return *this;
+		}
+
+		template<typename T>
+		SystemAccess& writes()
+		{
+			bDeclared = true;
+			writeTypes.push_back(getTypeIndex<typename std::remove_cv<T>::type>());
+			return *this;
+		}
+
+		template<typename T>
+		SystemAccess& emits()
+		{
+			return writes<T>();
+		}
+
+		/**
+		* The system creates or destroys entities, or assigns or removes components. It will run on its own.
+		*/
+		SystemAccess& changesStructure()
+		{
+			bDeclared = true;
+			bExclusive = true;
+			return *this;
+		}
+
+		/**
+		* Always run this system after another system, even if they don't conflict.
+		*/
+		SystemAccess& after(EntitySystem* system)
+		{
+			bDeclared = true;
+			runAfter.push_back(system);
+			return *this;
+		}
+
+		/**
+		* Always run this system before another system, even if they don't conflict.
+		*/
+		SystemAccess& before(EntitySystem* system)
+		{
+			bDeclared = true;
+			runBefore.push_back(system);
+			return *this;
+		}
+
+		/**
+		* Does this system need to run on its own? This is true for systems that don't declare anything.
+		*/
+		bool isExclusive() const
+		{
+			return !bDeclared || bExclusive;
+		}
+
+		bool conflictsWith(const SystemAccess& other) const
+		{
+			if (isExclusive() || other.isExclusive())
+				return true;
+
+			return overlaps(writeTypes, other.readTypes) || overlaps(writeTypes, other.writeTypes) || overlaps(readTypes, other.writeTypes);
+		}
+
+	private:
+		friend class World;
+
+		static bool overlaps(const std::vector<TypeIndex>& a, const std::vector<TypeIndex>& b)
+		{
+			for (auto& type : a)
+			{
+				if (std::find(b.begin(), b.end(), type) != b.end())
+					return true;
+			}
+
+			return false;
+		}
+
+		std::vector<TypeIndex> readTypes;
+		std::vector<TypeIndex> writeTypes;
+		std::vector<EntitySystem*> runAfter;
+		std::vector<EntitySystem*> runBefore;
+		bool bDeclared = false;
+		bool bExclusive = false;
+	};
+
+	/**
+	* A system that acts on entities. Generally, this will act on a subset of entities using World::each().
+	*
+	* Systems often will respond to events by subclassing EventSubscriber. You may use configure() to subscribe to events,
+	* but remember to unsubscribe in unconfigure().
+	*/
+	class EntitySystem
+	{
+	public:
+		virtual ~EntitySystem() {}
+
+		/**
+		* Called when this system is added to a world.
+		*/
+		virtual void configure(World* world)
+		{
+		}
+
+		/**
+		* Called when this system is being removed from a world.
+		*/
+		virtual void unconfigure(World* world)
+		{
+		}
+
+		/**
+		* Declare the components, events and other types that this system reads and writes, so that World::tick() can run it at
+		* the same time as systems it doesn't conflict with. Once a system declares anything, it may only touch what it declared.
+		*
+		* Systems that don't override this run on their own, in the order they were registered in.
+		*/
+		virtual void declareAccess(SystemAccess& access)
+		{
+		}
+
+		/**
+		* The name of this system in profiles, see ECS_PROFILING. Systems without a name are numbered in registration order.
+		*/
+		virtual const char* getName() const
+		{
+			return nullptr;
+		}
+
+		/**
+		* Called when World::tick() is called. See ECS_TICK_TYPE at the top of this file for more
+		* information about passing data to tick.
+		*/
+#ifdef ECS_TICK_TYPE_VOID
+		virtual void tick(World* world)
+#else
+		virtual void tick(World* world, ECS_TICK_TYPE data)
+#endif
+		{
+		}
+
+	private:
+		friend class World;
+
+		// The change tick this system last ran at, which Changed and Added filters compare against while it runs.
+		uint32_t lastRunTick = 0;
+	};
+
+	/**
+	* A view over a contiguous array of objects that is owned by something else.
+	*/
+	template<typename T>
+	class Span
+	{
+	public:
+		Span()
+			: first(nullptr), count(0)
+		{
+		}
+
+		Span(T* first, size_t count)
+			: first(first), count(count)
+		{
+		}
+
+		T* begin() const
+		{
+			return first;
+		}
+
+		T* end() const
+		{
+			return first + count;
+		}
+
+		T* data() const
+		{
+			return first;
+		}
+
+		size_t size() const
+		{
+			return count;
+		}
+
+		bool empty() const
+		{
+			return count == 0;
+		}
+
+		T& operator[](size_t idx) const
+		{
+			return first[idx];
+		}
+
+	private:
+		T* first;
+		size_t count;
+	};
+
+	/**
+	* Subclass this as EventSubscriber<EventType> and then call World::subscribe() in order to subscribe to events. Make sure
+	* to call World::unsubscribe() or World::unsubscribeAll() when your subscriber is deleted!
+	*/
+	template<typename T>
+	class EventSubscriber : public Internal::BaseEventSubscriber
+	{
+	public:
+		virtual ~EventSubscriber() {}
+
+		/**
+		* Called when an event is emitted by the world.
+		*/
+		virtual void receive(World* world, const T& event) = 0;
+
+		/**
+		* Called with every queued event of this type when the world flushes its event queues (see World::enqueue()). By default
+		* this calls receive() for each event, override it to process the whole batch at once.
+		*/
+		virtual void receiveBatch(World* world, Span<const T> events)
+		{
+			for (const T& event : events)
+			{
+				receive(world, event);
+			}
+		}
+	};
+
+	/**
+	* Returned by World::subscribe() for callables. Pass it to World::unsubscribe() to remove the callable again.
+	*/
+	struct EventSubscription
+	{
+		TypeIndex type = 0;
+		void* object = nullptr;
+
+		bool isValid() const
+		{
+			return object != nullptr;
+		}
+	};
+
+	namespace Internal
+	{
+		template<typename T, typename C, void (C::*Method)(World*, const T&)>
+		struct MemberThunks
+		{
+			static void receive(void* object, World* world, const void* event)
+			{
+				(static_cast<C*>(object)->*Method)(world, *static_cast<const T*>(event));
+			}
+
+			static void receiveBatch(void* object, World* world, const void* events, size_t count)
+			{
+				C* target = static_cast<C*>(object);
+				for (const T* event = static_cast<const T*>(events), *end = event + count; event != end; ++event)
+				{
+					(target->*Method)(world, *event);
+				}
+			}
+		};
+
+		template<typename T, typename Func>
+		struct CallableThunks
+		{
+			static void receive(void* object, World* world, const void* event)
+			{
+				(*static_cast<Func*>(object))(world, *static_cast<const T*>(event));
+			}
+
+			static void receiveBatch(void* object, World* world, const void* events, size_t count)
+			{
+				Func& func = *static_cast<Func*>(object);
+				for (const T* event = static_cast<const T*>(events), *end = event + count; event != end; ++event)
+				{
+					func(world, *event);
+				}
+			}
+
+			static void destroy(void* object, World* world);
+		};
+	}
+
+	namespace Events
+	{
+		// Called when a new entity is created.
+		struct OnEntityCreated
+		{
+			Entity* entity;
+		};
+
+		// Called when an entity is about to be destroyed.
+		struct OnEntityDestroyed
+		{
+			Entity* entity;
+		};
+
+		// Called when a component is assigned (not necessarily created).
+		template<typename T>
+		struct OnComponentAssigned
+		{
+			Entity* entity;
+			ComponentHandle<T> component;
+		};
+
+		// Called when a component is removed
+		template<typename T>
+		struct OnComponentRemoved
+		{
+			Entity* entity;
+			ComponentHandle<T> component;
+		};
+
+		// Called once by World::createMany() after all of its entities and their components were created.
+		struct OnEntitiesCreated
+		{
+			Span<Entity* const> entities;
+		};
+	}
+
+	/**
+	* A container for components. Entities do not have any logic of their own, except of that which to manage
+	* components. Components themselves are generally structs that contain data with which EntitySystems can
+	* act upon, but technically any data type may be used as a component, though only one of each data type
+	* may be on a single Entity at a time.
+	*/
+	class Entity
+	{
+	public:
+		friend class World;
+#ifdef ECS_ARCHETYPE_STORAGE
+		friend class Internal::Archetype;
+#else
+		friend class Internal::BaseComponentPool;
+		friend class Internal::BaseQuery;
+
+		template<typename... Types>
+		friend class Query;
+#endif
+
+		const static size_t InvalidEntityId = 0;
+
+		// Do not create entities yourself, use World::create().
+		Entity(World* world, EntityHandle handle)
+			: world(world), index(handle.index), generation(handle.generation)
+		{
+		}
+
+		// Do not delete entities yourself, use World::destroy().
+		~Entity();
+
+		/**
+		* Get the world associated with this entity.
+		*/
+		World* getWorld() const
+		{
+			return world;
+		}
+
+		/**
+		* Does this entity have a component?
+		*/
+		template<typename T>
+		bool has() const;
+
+		/**
+		* Does this entity have this list of components? The order of components does not matter.
+		*/
+		template<typename T, typename V, typename... Types>
+		bool has() const
+		{
+			return getSignature().containsAll(Internal::getComponentMask<T, V, Types...>());
+		}
+
+		/**
+		* Get the set of components this entity has, as a mask of component ids.
+		*/
+		const Internal::ComponentMask& getSignature() const
+		{
+#ifdef ECS_ARCHETYPE_STORAGE
+			return archetype->getMask();
+#else
+			return signature;
+#endif
+		}
+
+		/**
+		* Assign a new component (or replace an old one). All components must have a default constructor, though they
+		* may have additional constructors. You may pass arguments to this function the same way you would to a constructor.
+		*
+		* It is recommended that components be simple types (not const, not references, not pointers). If you need to store
+		* any of the above, wrap it in a struct.
+		*
+		* This returns a ComponentHandle, or an SoAHandle for components stored as structures of arrays (see SoA).
+		*
+		* While the world's structure is locked (see World::isStructureLocked()), the component is recorded in the calling thread's
+		* command buffer instead, and this returns an empty handle.
+		*/
+		template<typename T, typename... Args>
+		typename Internal::HandleOf<T>::Type assign(Args&&... args);
+
+		/**
+		* Remove a component of a specific type. Returns whether a component was removed. While the world's structure is locked,
+		* the removal is recorded in the calling thread's command buffer instead, and this returns whether there is a component
+		* to remove.
+		*/
+		template<typename T>
+		bool remove();
+
+		/**
+		* Remove all components from this entity. This does nothing while the world's structure is locked.
+		*/
+		void removeAll();
+
+		/**
+		* Get a component from this entity. This returns a ComponentHandle, or an SoAHandle for components stored as structures
+		* of arrays (see SoA).
+		*/
+		template<typename T>
+		typename Internal::HandleOf<T>::Type get()
+		{
+			return getComponent<T>(Internal::IsSoA<T>());
+		}
+
+		/**
+		* Mark a component as changed, for Changed filters. World::each() marks the components it passes to its callback,
+		* but changes made through handles or pointers elsewhere have to be marked by hand. Returns false if this entity
+		* doesn't have the component.
+		*/
+		template<typename T>
+		bool markChanged();
+
+		/**
+		* Call a function with components from this entity as arguments. This will return true if this entity has
+		* all specified components attached, and false if otherwise.
+		*/
+		template<typename... Types>
+		bool with(typename std::common_type<std::function<void(ComponentHandle<Types>...)>>::type view)
+		{
+			if (!has<Types...>())
+				return false;
+
+			view(get<Types>()...); // variadic template expansion is fun
+			return true;
+		}
+
+		/**
+		* Like with(), but takes any callable, which may either take component handles or references to the components
+		* (for example a lambda taking Position& or const Position&). The callable isn't wrapped in a std::function, so it
+		* can be inlined.
+		*/
+		template<typename... Types, typename Func>
+		typename std::enable_if<Internal::WithCallStyle<Func, Types...>::value != Internal::CallStyle::None
+			&& !Internal::IsStdFunction<typename std::decay<Func>::type>::value, bool>::type with(Func&& func)
+		{
+			if (!has<Types...>())
+				return false;
+
+			Internal::Caller<Internal::WithCallStyle<Func, Types...>::value>::callWith(func, get<Types>()...);
+			return true;
+		}
+
+		/**
+		* Get this entity's id. This is its handle packed into a single value (see EntityHandle::pack()), and as such is
+		* unique for the lifetime of the world as long as size_t is 64 bits. Use World::getById() to find an entity by its id.
+		*/
+		size_t getEntityId() const
+		{
+			return static_cast<size_t>(getHandle().pack());
+		}
+
+		/**
+		* Get a handle to this entity, which unlike the entity pointer may safely outlive the entity.
+		*/
+		EntityHandle getHandle() const
+		{
+			return EntityHandle(index, generation);
+		}
+
+		bool isPendingDestroy() const
+		{
+			return bPendingDestroy;
+		}
+
+	private:
+		template<typename T>
+		friend class SoAHandle;
+
+		template<typename T, typename... Args>
+		ComponentHandle<T> assignComponent(std::false_type, Args&&... args);
+
+		template<typename T, typename... Args>
+		SoAHandle<T> assignComponent(std::true_type, Args&&... args);
+
+		template<typename T>
+		ComponentHandle<T> getComponent(std::false_type);
+
+		template<typename T>
+		SoAHandle<T> getComponent(std::true_type)
+		{
+			return has<T>() ? SoAHandle<T>(this) : SoAHandle<T>();
+		}
+
+		// Get a pointer to every field of a component stored as a structure of arrays. Returns false if this entity doesn't
+		// have the component.
+		template<typename T>
+		bool getFields(void** fields);
+
+#ifdef ECS_ARCHETYPE_STORAGE
+		Internal::Archetype* archetype = nullptr;
+		size_t archetypeRow = 0;
+#else
+		// One bit per component this entity has, kept up to date by the component pools.
+		Internal::ComponentMask signature;
+#endif
+		World* world;
+
+		// A dense index for the entity, which is reused after the entity is destroyed.
+		uint32_t index;
+
+		// How many times this entity's index was reused.
+		uint32_t generation;
+
+		// Where this entity is in the world's list of entities, which changes as other entities are removed from it.
+		uint32_t listIndex = 0;
+
+		bool bPendingDestroy = false;
+	};
+
+	/**
+	* A work-stealing thread pool. Every worker has its own queue of tasks, and steals from the other queues once its own
+	* runs dry. A thread that waits for a batch of tasks to finish runs tasks itself in the meantime, so batches may be
+	* started from inside of other tasks.
+	*/
+	class ThreadPool
+	{
+	public:
+		/**
+		* Start a pool with a number of worker threads. A count of 0 starts one worker per hardware thread, minus one for
+		* the thread that is going to hand out work.
+		*/
+		explicit ThreadPool(size_t workerCount = 0)
+			: queued(0), bStopping(false)
+		{
+			if (workerCount == 0)
+			{
+				size_t hardwareThreads = std::thread::hardware_concurrency();
+				workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+			}
+
+			// Queue 0 is shared by all threads that aren't workers of this pool.
+			for (size_t i = 0; i <= workerCount; ++i)
+			{
+				queues.emplace_back(new Queue());
+			}
+
+			for (size_t i = 1; i <= workerCount; ++i)
+			{
+				workers.emplace_back(&ThreadPool::workerMain, this, i);
+			}
+		}
+
+		~ThreadPool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(sleepMutex);
+				bStopping = true;
+			}
+			wake.notify_all();
+
+			for (auto& worker : workers)
+			{
+				worker.join();
+			}
+		}
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		size_t getWorkerCount() const
+		{
+			return workers.size();
+		}
+
+		/**
+		* Call a function for every index in [0, count), spread across the workers and the calling thread. Returns once
+		* every call has finished.
+		*/
+		void parallelFor(size_t count, const std::function<void(size_t)>& func)
+		{
+			if (count == 0)
+				return;
+
+			Batch batch;
+			batch.func = &func;
+			batch.remaining.store(count);
+
+			// Count the tasks before they become visible, so that popping one never takes the counter below zero.
+			queued += count;
+
+			const size_t home = getQueueIndex();
+			for (size_t i = 0; i < count; ++i)
+			{
+				Queue& queue = *queues[(home + i) % queues.size()];
+				std::lock_guard<std::mutex> lock(queue.mutex);
+				queue.tasks.push_back({ &batch, i });
+			}
+
+			{
+				// Workers check for work while holding this lock, so taking it here makes sure none of them miss the wakeup.
+				std::lock_guard<std::mutex> lock(sleepMutex);
+			}
+			wake.notify_all();
+
+			while (batch.remaining.load(std::memory_order_acquire) > 0)
+			{
+				Task task;
+				if (pop(home, task))
+				{
+					run(task);
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+		}
+
+		/**
+		* The index of the worker running on the current thread, starting at 1. Threads that aren't workers of any pool
+		* return 0.
+		*/
+		static size_t getCurrentWorkerIndex()
+		{
+			return currentWorker().index;
+		}
+
+	private:
+		struct Batch
+		{
+			const std::function<void(size_t)>* func;
+			std::atomic<size_t> remaining;
+		};
+
+		struct Task
+		{
+			Batch* batch;
+			size_t index;
+		};
+
+		struct Queue
+		{
+			std::mutex mutex;
+			std::deque<Task> tasks;
+		};
+
+		struct WorkerInfo
+		{
+			const ThreadPool* pool;
+			size_t index;
+		};
+
+		static WorkerInfo& currentWorker()
+		{
+			static thread_local WorkerInfo info = { nullptr, 0 };
+			return info;
+		}
+
+		size_t getQueueIndex() const
+		{
+			const WorkerInfo& info = currentWorker();
+			return info.pool == this ? info.index : 0;
+		}
+
+		// Take a task from the back of our own queue, or steal one from the front of another queue.
+		bool pop(size_t home, Task& task)
+		{
+			for (size_t i = 0; i < queues.size(); ++i)
+			{
+				Queue& queue = *queues[(home + i) % queues.size()];
+				std::lock_guard<std::mutex> lock(queue.mutex);
+				if (queue.tasks.empty())
+					continue;
+
+				if (i == 0)
+				{
+					task = queue.tasks.back();
+					queue.tasks.pop_back();
+				}
+				else
+				{
+					task = queue.tasks.front();
+					queue.tasks.pop_front();
+				}
+
+				--queued;
+				return true;
+			}
+
+			return false;
+		}
+
+		void run(const Task& task)
+		{
+			Batch* batch = task.batch;
+			(*batch->func)(task.index);
+
+			// The batch lives on the stack of the thread waiting for it, so this has to be the last time we touch it.
+			batch->remaining.fetch_sub(1, std::memory_order_release);
+		}
+
+		void workerMain(size_t index)
+		{
+			currentWorker() = { this, index };
+
+			while (true)
+			{
+				Task task;
+				if (pop(index, task))
+				{
+					run(task);
+					continue;
+				}
+
+				std::unique_lock<std::mutex> lock(sleepMutex);
+				wake.wait(lock, [this] { return bStopping || queued.load() > 0; });
+				if (bStopping && queued.load() == 0)
+					return;
+			}
+		}
+
+		std::vector<std::unique_ptr<Queue>> queues;
+		std::vector<std::thread> workers;
+
+		std::mutex sleepMutex;
+		std::condition_variable wake;
+		std::atomic<size_t> queued;
+		bool bStopping;
+	};
+
+	namespace Internal
+	{
+		// A range of rows of an archetype, or of dense indices of a component pool, that parallelEach() hands to a thread.
+		struct ParallelRange
+		{
+#ifdef ECS_ARCHETYPE_STORAGE
+			Archetype* archetype;
+#else
+			BaseComponentPool* pool;
+#endif
+			size_t begin;
+			size_t end;
+		};
+
+		// Systems that World::tick() runs at the same time. Exclusive stages hold a single system that runs without locking the world.
+		struct SystemStage
+		{
+			std::vector<EntitySystem*> systems;
+			bool bExclusive;
+		};
+
+		// The command buffer a thread got from World::getCommandBuffer().
+		struct ThreadCommandBuffer
+		{
+			std::thread::id thread;
+			CommandBuffer* buffer;
+		};
+
+		/**
+		* The part of an event queue that doesn't depend on the event type.
+		*/
+		class BaseEventQueue
+		{
+		public:
+			virtual ~BaseEventQueue() {}
+
+			// Deliver the queued events to the world's subscribers.
+			virtual void flush(World* world) = 0;
+
+			// This should only ever be called by the world itself.
+			virtual void destroy(World* world) = 0;
+
+			virtual void countMemory(MemoryUsage& usage) const = 0;
+
+			// Is this queue in the world's list of queues that have events waiting?
+			bool bPending = false;
+		};
+
+		/**
+		* Events of a single type that were queued with World::enqueue().
+		*/
+		template<typename T>
+		class EventQueue : public BaseEventQueue
+		{
+		public:
+			using EventAllocator = std::allocator_traits<Allocator>::template rebind_alloc<T>;
+
+			EventQueue(const Allocator& alloc)
+				: events({}, EventAllocator(alloc)), flushing({}, EventAllocator(alloc))
+			{
+			}
+
+			void push(const T& event)
+			{
+				events.push_back(event);
+			}
+
+			virtual void flush(World* world) override;
+
+			virtual void destroy(World* world) override;
+
+			virtual void countMemory(MemoryUsage& usage) const override
+			{
+				usage.add(sizeof(*this), sizeof(*this));
+				usage.addVector(events);
+				usage.addVector(flushing);
+			}
+
+		private:
+			std::vector<T, EventAllocator> events;
+
+			// The events being delivered. Swapping the two buffers lets subscribers queue more events while receiving these.
+			std::vector<T, EventAllocator> flushing;
+		};
+
+		class BaseResource
+		{
+		public:
+			virtual ~BaseResource() {}
+
+			// This should only ever be called by the world itself.
+			virtual void destroy(World* world) = 0;
+
+			// The size of the resource, not counting anything it allocates itself.
+			virtual size_t getSize() const = 0;
+		};
+
+		/**
+		* A resource of the world, see World::setResource().
+		*/
+		template<typename T>
+		class Resource : public BaseResource
+		{
+		public:
+			template<typename... Args>
+			Resource(Args&&... args)
+				: value(std::forward<Args>(args)...)
+			{
+			}
+
+			virtual void destroy(World* world) override;
+
+			virtual size_t getSize() const override
+			{
+				return sizeof(*this);
+			}
+
+			T value;
+		};
+
+		template<typename T>
+		uint32_t getResourceId()
+		{
+			return TypeIdRegistry<ResourceFamily>::template get<T>();
+		}
+	}
+
+#ifdef ECS_PROFILING
+	/**
+	* Records how long World::tick() and each of its systems take, how many entities each() visits, how many entities are
+	* created and destroyed, and how many events of each type are emitted. Only compiled in with ECS_PROFILING, see
+	* World::getProfiler().
+	*
+	* Everything is recorded per tick, and kept for the last ECS_PROFILING_HISTORY ticks. writeStats() exports these as JSON,
+	* and writeTrace() exports what happened between startTrace() and stopTrace() as a Chrome trace, which chrome://tracing
+	* and Perfetto can open.
+	*/
+	class Profiler
+	{
+	public:
+		typedef std::chrono::steady_clock Clock;
+
+		/**
+		* The parts of World::tick().
+		*/
+		enum class Phase
+		{
+			Cleanup,
+			Systems,
+			Commands,
+			Events
+		};
+
+		static const size_t PhaseCount = 4;
+
+		/**
+		* A value recorded once per tick, over the last ECS_PROFILING_HISTORY ticks.
+		*/
+		class History
+		{
+		public:
+			void add(double value)
+			{
+				values[next] = value;
+				next = (next + 1) % ECS_PROFILING_HISTORY;
+				count = std::min(count + 1, static_cast<size_t>(ECS_PROFILING_HISTORY));
+			}
+
+			size_t getCount() const
+			{
+				return count;
+			}
+
+			// The most recent value, or 0 if there are none.
+			double getLast() const
+			{
+				return count > 0 ? values[(next + ECS_PROFILING_HISTORY - 1) % ECS_PROFILING_HISTORY] : 0.0;
+			}
+
+			double getMin() const;
+			double getMax() const;
+			double getMean() const;
+
+			// Get a percentile (0 to 100) of the values, or 0 if there are none.
+			double getPercentile(double percentile) const;
+
+			// Count the values that fall into buckets, which are given by their upper bounds in ascending order. The result has
+			// one more entry than there are bounds, for the values above the last bound.
+			std::vector<size_t> getHistogram(const std::vector<double>& bounds) const;
+
+		private:
+			double values[ECS_PROFILING_HISTORY];
+			size_t next = 0;
+			size_t count = 0;
+		};
+
+		struct SystemStats
+		{
+			const EntitySystem* system;
+			std::string name;
+
+			// The time the system's tick took, in milliseconds.
+			History milliseconds;
+
+			// The entities visited by each(), eachChunk() and their parallel versions while the system ran.
+			History entities;
+
+		private:
+			friend class Profiler;
+			friend class World;
+
+			std::atomic<uint64_t> entitiesThisTick{ 0 };
+			double millisecondsThisTick = 0.0;
+			bool bRan = false;
+		};
+
+		struct EventStats
+		{
+			std::string name;
+
+			// The events emitted per tick, including queued events as they are delivered.
+			History emitted;
+
+		private:
+			friend class Profiler;
+
+			uint64_t emittedThisTick = 0;
+			bool bEmitted = false;
+		};
+
+		Profiler()
+			: origin(Clock::now())
+		{
+		}
+
+		// The time the whole tick took, in milliseconds.
+		const History& getTickTime() const
+		{
+			return tickTime;
+		}
+
+		// The time a part of the tick took, in milliseconds.
+		const History& getPhaseTime(Phase phase) const
+		{
+			return phaseTimes[static_cast<size_t>(phase)];
+		}
+
+		// The entities created and destroyed per tick, counting the ones created and destroyed between ticks as well.
+		const History& getCreated() const
+		{
+			return created;
+		}
+
+		const History& getDestroyed() const
+		{
+			return destroyed;
+		}
+
+		// The entities visited by each(), eachChunk() and their parallel versions per tick, inside and outside of systems.
+		const History& getEntitiesVisited() const
+		{
+			return entitiesVisited;
+		}
+
+		/**
+		* Get the stats of a registered system. Returns nullptr if the system hasn't been part of a tick yet. Systems are named
+		* by EntitySystem::getName(), or numbered in registration order if they don't have a name.
+		*/
+		const SystemStats* getSystemStats(const EntitySystem* system) const;
+
+		/**
+		* Get the stats of an event type. Returns nullptr if no events of the type were emitted yet.
+		*/
+		template<typename T>
+		const EventStats* getEventStats() const
+		{
+			const TypeIndex index = getTypeIndex<T>();
+			return index < events.size() && events[index] != nullptr && events[index]->bEmitted ? events[index].get() : nullptr;
+		}
+
+		/**
+		* Name an event type in the exported stats and traces. There's no RTTI to get the name from, so event types that aren't
+		* named are listed by their type index (see getTypeIndex()).
+		*/
+		template<typename T>
+		void setEventName(const std::string& name)
+		{
+			getEvent(getTypeIndex<T>()).name = name;
+		}
+
+		/**
+		* Start recording a trace. Every tick adds a few events to the trace, plus one per system, so don't leave this running
+		* forever.
+		*/
+		void startTrace()
+		{
+			std::lock_guard<std::mutex> lock(traceMutex);
+			bTracing = true;
+		}
+
+		void stopTrace()
+		{
+			std::lock_guard<std::mutex> lock(traceMutex);
+			bTracing = false;
+		}
+
+		bool isTracing() const
+		{
+			return bTracing;
+		}
+
+		void clearTrace()
+		{
+			std::lock_guard<std::mutex> lock(traceMutex);
+			trace.clear();
+		}
+
+		/**
+		* Write the recorded trace in the Chrome trace event format (JSON).
+		*/
+		void writeTrace(std::ostream& out);
+
+		/**
+		* Write every History as JSON: its count, last value, min, mean, max, 50th, 90th and 99th percentiles, and for times, a
+		* histogram of the ticks that took up to 0.1, 0.25, 0.5, 1, 2, 4, 8, 16, 33 and 66 milliseconds, and longer.
+		*/
+		void writeStats(std::ostream& out) const;
+
+	private:
+		friend class World;
+
+		struct TraceEvent
+		{
+			std::string name;
+			const char* category;
+
+			// In microseconds since the profiler was created. Counters have a duration of -1.
+			double start;
+			double duration;
+			uint32_t thread;
+
+			// The values of a counter.
+			std::vector<std::pair<std::string, double>> values;
+		};
+
+		double toMicroseconds(Clock::time_point time) const
+		{
+			return std::chrono::duration<double, std::micro>(time - origin).count();
+		}
+
+		static double toMilliseconds(Clock::duration duration)
+		{
+			return std::chrono::duration<double, std::milli>(duration).count();
+		}
+
+		EventStats& getEvent(TypeIndex index)
+		{
+			if (index >= events.size())
+				events.resize(index + 1);
+
+			if (events[index] == nullptr)
+			{
+				events[index].reset(new EventStats());
+				events[index]->name = "Event " + std::to_string(index);
+			}
+
+			return *events[index];
+		}
+
+		// Match the stats to the world's systems, after the schedule was rebuilt.
+		void setSystems(Span<EntitySystem* const> registered);
+
+		SystemStats* findSystem(const EntitySystem* system) const;
+
+		void beginTick()
+		{
+			tickStart = phaseStart = Clock::now();
+		}
+
+		void endPhase(Phase phase);
+
+		void beginSystem(SystemStats* stats, Clock::time_point& start)
+		{
+			start = Clock::now();
+			if (stats != nullptr)
+				stats->bRan = true;
+		}
+
+		void endSystem(SystemStats* stats, Clock::time_point start);
+
+		void endTick(size_t entityCount);
+
+		// Locks if events may be emitted from several threads at once.
+		void countEmitted(TypeIndex index, size_t count, bool bLock)
+		{
+			std::unique_lock<std::mutex> lock(eventMutex, std::defer_lock);
+			if (bLock)
+				lock.lock();
+
+			EventStats& stats = getEvent(index);
+			stats.emittedThisTick += count;
+			stats.bEmitted = true;
+		}
+
+		void record(TraceEvent&& event);
+
+		uint32_t getThreadNumber();
+
+		static void writeString(std::ostream& out, const std::string& str);
+		static void writeHistory(std::ostream& out, const History& history, bool bTime);
+
+		Clock::time_point origin;
+		Clock::time_point tickStart;
+		Clock::time_point phaseStart;
+
+		History tickTime;
+		History phaseTimes[PhaseCount];
+		History created;
+		History destroyed;
+		History entitiesVisited;
+
+		std::vector<std::unique_ptr<SystemStats>> systems;
+		// Indexed by the type index of the event.
+		std::vector<std::unique_ptr<EventStats>> events;
+		std::mutex eventMutex;
+
+		// Only touched by the world's thread, as entities can't be created or destroyed while the structure is locked.
+		uint64_t createdThisTick = 0;
+		uint64_t destroyedThisTick = 0;
+
+		std::atomic<uint64_t> entitiesOutsideSystems{ 0 };
+
+		std::atomic<bool> bTracing{ false };
+		std::vector<TraceEvent> trace;
+		std::vector<std::thread::id> threads;
+		std::mutex traceMutex;
+	};
+#endif
+
+	/**
+	* The world creates, destroys, and manages entities. The lifetime of entities and _registered_ systems are handled by the world
+	* (don't delete a system without unregistering it from the world first!), while event subscribers have their own lifetimes
+	* (the world doesn't delete them automatically when the world is deleted).
+	*/
+	class World
+	{
+	public:
+		friend class Entity;
+
+		template<typename... Types>
+		friend class Internal::EntityComponentIterator;
+
+		template<typename... Types>
+		friend class Query;
+
+		friend class WorldSerializer;
+
+		using WorldAllocator = std::allocator_traits<Allocator>::template rebind_alloc<World>;
+		using EntityAllocator = std::allocator_traits<Allocator>::template rebind_alloc<Entity>;
+		using SystemAllocator = std::allocator_traits<Allocator>::template rebind_alloc<EntitySystem>;
+		using EntityPtrAllocator = std::allocator_traits<Allocator>::template rebind_alloc<Entity*>;
+		using SystemPtrAllocator = std::allocator_traits<Allocator>::template rebind_alloc<EntitySystem*>;
+		using SubscriberPtrAllocator = std::allocator_traits<Allocator>::template rebind_alloc<Internal::BaseEventSubscriber*>;
+		using CallbackAllocator = std::allocator_traits<Allocator>::template rebind_alloc<Internal::EventCallback>;
+
+		// Everything subscribed to a single event type.
+		struct EventSlot
+		{
+			EventSlot(const Allocator& alloc)
+				: subscribers({}, SubscriberPtrAllocator(alloc)), callbacks({}, CallbackAllocator(alloc))
+			{
+			}
+
+			bool empty() const
+			{
+				return subscribers.empty() && callbacks.empty();
+			}
+
+			// EventSubscribers, which are called through their vtable.
+			std::vector<Internal::BaseEventSubscriber*, SubscriberPtrAllocator> subscribers;
+
+			// Member functions and callables.
+			std::vector<Internal::EventCallback, CallbackAllocator> callbacks;
+		};
+
+		using EventSlotAllocator = std::allocator_traits<Allocator>::template rebind_alloc<EventSlot>;
+#ifdef ECS_ARCHETYPE_STORAGE
+		using ArchetypeAllocator = std::allocator_traits<Allocator>::template rebind_alloc<Internal::Archetype>;
+		using ArchetypePtrAllocator = std::allocator_traits<Allocator>::template rebind_alloc<Internal::Archetype*>;
+#else
+		using PoolPtrAllocator = std::allocator_traits<Allocator>::template rebind_alloc<Internal::BaseComponentPool*>;
+#endif
+		using IndexAllocator = std::allocator_traits<Allocator>::template rebind_alloc<uint32_t>;
+		using QueryPtrAllocator = std::allocator_traits<Allocator>::template rebind_alloc<Internal::BaseQuery*>;
+		using SlotAllocator = std::allocator_traits<Allocator>::template rebind_alloc<Internal::EntitySlot>;
+		using HandleAllocator = std::allocator_traits<Allocator>::template rebind_alloc<EntityHandle>;
+		using EventQueuePtrAllocator = std::allocator_traits<Allocator>::template rebind_alloc<Internal::BaseEventQueue*>;
+		using ResourcePtrAllocator = std::allocator_traits<Allocator>::template rebind_alloc<Internal::BaseResource*>;
+		using CommandBufferAllocator = std::allocator_traits<Allocator>::template rebind_alloc<CommandBuffer>;
+		using ThreadCommandBufferAllocator = std::allocator_traits<Allocator>::template rebind_alloc<Internal::ThreadCommandBuffer>;
+
+		/**
+		* Use this function to construct the world with a custom allocator.
+		*/
+		static World* createWorld(Allocator alloc)
+		{
+			WorldAllocator worldAlloc(alloc);
+			World* world = std::allocator_traits<WorldAllocator>::allocate(worldAlloc, 1);
+			std::allocator_traits<WorldAllocator>::construct(worldAlloc, world, alloc);
+
+			return world;
+		}
+
+		/**
+		* Use this function to construct the world with the default allocator.
+		*/
+		static World* createWorld()
+		{
+			return createWorld(Allocator());
+		}
+
+		// Use this to destroy the world instead of calling delete.
+		// This will emit OnEntityDestroyed events and call EntitySystem::unconfigure as appropriate.
+		void destroyWorld()
+		{
+			WorldAllocator alloc(entAlloc);
+			std::allocator_traits<WorldAllocator>::destroy(alloc, this);
+			std::allocator_traits<WorldAllocator>::deallocate(alloc, this, 1);
+		}
+
+		World(Allocator alloc)
+			: entAlloc(alloc),
+			entities({}, EntityPtrAllocator(alloc)),
+			systems({}, SystemPtrAllocator(alloc)),
+			eventSlots({}, EventSlotAllocator(alloc)),
+			slots(1, Internal::EntitySlot(), SlotAllocator(alloc)),
+			freeIndices({}, IndexAllocator(alloc)),
+			pendingDestroy({}, HandleAllocator(alloc)),
+			eventQueues({}, EventQueuePtrAllocator(alloc)),
+			pendingEventQueues({}, EventQueuePtrAllocator(alloc)),
+			flushingEventQueues({}, EventQueuePtrAllocator(alloc)),
+			resources({}, ResourcePtrAllocator(alloc)),
+			commandBuffers({}, ThreadCommandBufferAllocator(alloc)),
+			queries({}, QueryPtrAllocator(alloc))
+#ifdef ECS_ARCHETYPE_STORAGE
+			, archetypes({}, ArchetypePtrAllocator(alloc))
+#else
+			, pools({}, PoolPtrAllocator(alloc)),
+			poolList({}, PoolPtrAllocator(alloc))
+#endif
+		{
+#ifdef ECS_ARCHETYPE_STORAGE
+			rootArchetype = getArchetype({});
+#endif
+
+#ifdef ECS_PROFILING
+			profiler.setEventName<Events::OnEntityCreated>("OnEntityCreated");
+			profiler.setEventName<Events::OnEntityDestroyed>("OnEntityDestroyed");
+#endif
+		}
+
+		/**
+		* Destroying the world will emit OnEntityDestroyed events and call EntitySystem::unconfigure() as appropriate.
+		*
+		* Use World::destroyWorld to destroy and deallocate the world, do not manually delete the world!
+		*/
+		~World();
+
+		/**
+		* Create a new entity. This will emit the OnEntityCreated event.
+		*/
+		Entity* create()
+		{
+			assert(!isStructureLocked() && "Entities can't be created while the world is locked by a parallel loop, use a command buffer");
+			if (isStructureLocked())
+				return nullptr;
+
+			Entity* ent = allocateEntity();
+#ifdef ECS_ARCHETYPE_STORAGE
+			ent->archetype = rootArchetype;
+			ent->archetypeRow = rootArchetype->pushRow(ent, entAlloc);
+#endif
+
+			emit<Events::OnEntityCreated>({ ent });
+
+			return ent;
+		}
+
+		/**
+		* Create many entities at once, each with a copy of the given prototype components. This is much faster than calling
+		* create() and assign() for every entity, as storage is reserved once and components are constructed in bulk.
+		*
+		* OnEntityCreated and OnComponentAssigned are still emitted for every entity, but only after all of the entities and
+		* their components were created. OnEntitiesCreated is emitted once at the end with all of the new entities.
+		*
+		* Returns the new entities. The span is only valid until entities are next created or destroyed.
+		*/
+		template<typename... Types>
+		Span<Entity* const> createMany(size_t count, const Types&... prototypes);
+
+		/**
+		* Destroy an entity. This will emit the OnEntityDestroy event.
+		*
+		* If immediate is false (recommended), then the entity won't be immediately
+		* deleted but instead will be removed at the beginning of the next tick() or
+		* when cleanup() is called. OnEntityDestroyed will still be called immediately.
+		*
+		* This function is safe to call multiple times on a single entity. Note that calling
+		* this once with immediate = false and then calling it with immediate = true will
+		* remove the entity from the pending destroy queue and will immediately destroy it
+		* _without_ emitting a second OnEntityDestroyed event.
+		*
+		* A warning: Do not set immediate to true if you are currently iterating through entities!
+		*
+		* Destroying an entity is O(1). The last entity in the world takes its place, so removing entities changes the order
+		* in which all() visits the remaining ones.
+		*
+		* While the world's structure is locked (see isStructureLocked()), the entity is destroyed through the calling thread's
+		* command buffer instead, as if immediate was false.
+		*/
+		void destroy(Entity* ent, bool immediate = false);
+
+		/**
+		* Destroy the entity a handle refers to, if any. See destroy(Entity*, bool).
+		*/
+		void destroy(EntityHandle handle, bool immediate = false)
+		{
+			destroy(resolve(handle), immediate);
+		}
+
+		/**
+		* Delete all entities in the pending destroy queue. Returns true if any entities were cleaned up,
+		* false if there were no entities to clean up. This only touches the pending entities, so it's cheap to call
+		* when there is nothing to clean up.
+		*/
+		bool cleanup();
+
+		/**
+		* Reset the world, destroying all entities. Entity indices are handed out from the lowest up again, but every slot keeps
+		* its generation, so ids and handles from before the reset never refer to new entities afterwards.
+		*/
+		void reset();
+
+		/**
+		* Register a system. The world will manage the memory of the system unless you unregister the system.
+		*/
+		EntitySystem* registerSystem(EntitySystem* system)
+		{
+			systems.push_back(system);
+			system->configure(this);
+			invalidateSchedule();
+
+            		return system;
+		}
+
+		/**
+		* Unregister a system.
+		*/
+		void unregisterSystem(EntitySystem* system)
+		{
+			systems.erase(std::remove(systems.begin(), systems.end(), system), systems.end());
+			system->unconfigure(this);
+			invalidateSchedule();
+		}
+
+		void enableSystem(EntitySystem* system)
+		{
+			auto it = std::find(disabledSystems.begin(), disabledSystems.end(), system);
+			if (it != disabledSystems.end())
+			{
+				disabledSystems.erase(it);
+				systems.push_back(system);
+				invalidateSchedule();
+			}
+		}
+
+		void disableSystem(EntitySystem* system)
+		{
+			auto it = std::find(systems.begin(), systems.end(), system);
+			if (it != systems.end())
+			{
+				systems.erase(it);
+				disabledSystems.push_back(system);
+				invalidateSchedule();
+			}
+		}
+
+		/**
+		* Ask the world to call EntitySystem::declareAccess() on every system again before the next tick. Registering, unregistering,
+		* enabling and disabling systems does this automatically.
+		*/
+		void invalidateSchedule()
+		{
+			bScheduleDirty = true;
+		}
+
+		/**
+		* Subscribe to an event.
+		*/
+		template<typename T>
+		void subscribe(EventSubscriber<T>* subscriber)
+		{
+			getEventSlot<T>().subscribers.push_back(subscriber);
+		}
+
+		/**
+		* Subscribe a member function to an event, without needing to inherit from EventSubscriber. The function is called
+		* directly instead of through a vtable:
+		*
+		*     world->subscribe<MyEvent, MySystem, &MySystem::onMyEvent>(this);
+		*
+		* unsubscribeAll(object) removes these subscriptions as well.
+		*/
+		template<typename T, typename C, void (C::*Method)(World*, const T&)>
+		void subscribe(C* object)
+		{
+			using Thunks = Internal::MemberThunks<T, C, Method>;
+			getEventSlot<T>().callbacks.push_back({ object, object, &Thunks::receive, &Thunks::receiveBatch, nullptr });
+		}
+
+		/**
+		* Subscribe a callable taking (World*, const T&) to an event. The world keeps a copy of the callable until it is
+		* unsubscribed, either with the returned subscription or with unsubscribeAll(owner). Don't unsubscribe a callable from
+		* inside of itself.
+		*/
+		template<typename T, typename Func>
+		typename std::enable_if<Internal::IsCallable<Func, World*, const T&>::value && !std::is_convertible<Func, EventSubscriber<T>*>::value, EventSubscription>::type
+			subscribe(Func&& func, const void* owner = nullptr);
+
+		/**
+		* Unsubscribe from an event.
+		*/
+		template<typename T>
+		void unsubscribe(EventSubscriber<T>* subscriber)
+		{
+			auto index = getTypeIndex<T>();
+			if (index < eventSlots.size())
+			{
+				auto& subList = eventSlots[index].subscribers;
+				subList.erase(std::remove(subList.begin(), subList.end(), subscriber), subList.end());
+			}
+		}
+
+		/**
+		* Unsubscribe a member function that was subscribed with subscribe<T, C, Method>().
+		*/
+		template<typename T, typename C, void (C::*Method)(World*, const T&)>
+		void unsubscribe(C* object)
+		{
+			removeCallbacks(getTypeIndex<T>(), object, &Internal::MemberThunks<T, C, Method>::receive);
+		}
+
+		/**
+		* Unsubscribe a callable. The subscription is reset.
+		*/
+		void unsubscribe(EventSubscription& subscription)
+		{
+			if (subscription.isValid())
+				removeCallbacks(subscription.type, subscription.object, nullptr);
+
+			subscription = EventSubscription();
+		}
+
+		/**
+		* Unsubscribe from all events. Don't be afraid of the void pointer, just pass in your subscriber as normal. This also
+		* removes member functions subscribed on the object, and callables subscribed with it as their owner.
+		*/
+		void unsubscribeAll(const void* subscriber)
+		{
+			for (auto& slot : eventSlots)
+			{
+				slot.subscribers.erase(std::remove(slot.subscribers.begin(), slot.subscribers.end(), subscriber), slot.subscribers.end());
+
+				for (size_t i = 0; i < slot.callbacks.size();)
+				{
+					if (slot.callbacks[i].owner == subscriber)
+						eraseCallback(slot, i);
+					else
+						++i;
+				}
+			}
+		}
+
+		/**
+		* Is anything subscribed to events of type T?
+		*/
+		template<typename T>
+		bool hasSubscribers() const
+		{
+			auto index = getTypeIndex<T>();
+			return index < eventSlots.size() && !eventSlots[index].empty();
+		}
+
+		/**
+		* Emit a batch of events at once. Subscribers get the whole batch through EventSubscriber::receiveBatch().
+		*/
+		template<typename T>
+		void emitBatch(Span<const T> events)
+		{
+			auto index = getTypeIndex<T>();
+#ifdef ECS_PROFILING
+			profiler.countEmitted(index, events.size(), isStructureLocked());
+#endif
+			if (events.empty() || index >= eventSlots.size())
+				return;
+
+			// Subscribers may subscribe to more events while receiving this one, so don't hold on to an iterator.
+			for (size_t i = 0; i < eventSlots[index].subscribers.size(); ++i)
+			{
+				auto* sub = static_cast<EventSubscriber<T>*>(eventSlots[index].subscribers[i]);
+				sub->receiveBatch(this, events);
+			}
+
+			for (size_t i = 0; i < eventSlots[index].callbacks.size(); ++i)
+			{
+				const Internal::EventCallback& callback = eventSlots[index].callbacks[i];
+				callback.receiveBatch(callback.object, this, events.data(), events.size());
+			}
+		}
+
+		/**
+		* Queue an event instead of emitting it right away. Queued events are stored contiguously per event type, and delivered
+		* in batches when the world flushes its event queues: at the end of every tick() (unless ECS_TICK_NO_EVENT_FLUSH is
+		* defined), or when flushEvents() is called.
+		*
+		* Unlike emit(), this may be called from systems that run in parallel and from inside of parallelEach().
+		*/
+		template<typename T>
+		void enqueue(const T& event);
+
+		/**
+		* Deliver all queued events, one batch per event type. Events that are queued while this runs are delivered by the
+		* next flush at the latest, and calling this while events are being flushed does nothing.
+		*/
+		void flushEvents();
+
+		/**
+		* Emit an event. This will do nothing if there are no subscribers for the event type.
+		*/
+		template<typename T>
+		void emit(const T& event)
+		{
+			auto index = getTypeIndex<T>();
+#ifdef ECS_PROFILING
+			profiler.countEmitted(index, 1, isStructureLocked());
+#endif
+			if (index >= eventSlots.size())
+				return;
+
+			// Subscribers may subscribe to more events while receiving this one, so don't hold on to an iterator.
+			for (size_t i = 0; i < eventSlots[index].subscribers.size(); ++i)
+			{
+				auto* sub = static_cast<EventSubscriber<T>*>(eventSlots[index].subscribers[i]);
+				sub->receive(this, event);
+			}
+
+			for (size_t i = 0; i < eventSlots[index].callbacks.size(); ++i)
+			{
+				const Internal::EventCallback& callback = eventSlots[index].callbacks[i];
+				callback.receive(callback.object, this, &event);
+			}
+		}
+
+		/**
+		* Run a function on each entity with a specific set of components. This is useful for implementing an EntitySystem.
+		*
+		* Components may be wrapped in Changed or Added to only visit entities whose components changed, and may be const to
+		* keep them from being marked as changed (see getChangeTick()). All, None, Any and Optional filter the entities further.
+		*
+		* If you want to include entities that are pending destruction, set includePendingDestroy to true.
+		*/
+		template<typename... Types>
+		void each(typename Internal::QueryTerms<Types...>::HandleFunction viewFunc, bool bIncludePendingDestroy = false);
+
+		/**
+		* Like each(), but takes any callable instead of a std::function, so that it can be inlined into the loop. The callable
+		* may take the entity and component handles, the entity and references to the components, or just references to the
+		* components:
+		*
+		*     world->each<Position, Velocity>([](Position& position, const Velocity& velocity) { ... });
+		*/
+		template<typename... Types, typename Func>
+		typename Internal::EnableForCallable<Func, Internal::EachCallStyle<Func, Types...>::value>::type each(Func&& func, bool bIncludePendingDestroy = false);
+
+		/**
+		* Run a function on runs of entities with a set of components. Rather than once per entity, the function is called once
+		* per run of entities whose components sit next to each other in memory, with the number of entities in the run, the
+		* entities themselves, and a pointer to the first component of each type:
+		*
+		*     world->eachChunk<Position, const Velocity>([](size_t count, Entity* const* ents, Position* p, const Velocity* v) {
+		*         for (size_t i = 0; i < count; ++i)
+		*             p[i].x += v[i].x;
+		*     });
+		*
+		* Components stored as structures of arrays (see SoA) are passed as SoAArrays instead. This lets the loop over a run be
+		* vectorized. With archetype storage a run is (at most) a chunk. With the default storage, runs end wherever the
+		* components of consecutive entities aren't next to each other in every pool, so iterating over several components
+		* that were assigned in a different order gets short runs.
+		*
+		* Components are marked as changed unless they are const. Changed and Added aren't supported, as they would split
+		* runs. The world's structure is locked while iterating.
+		*/
+		template<typename... Types, typename Func>
+		void eachChunk(Func&& func, bool bIncludePendingDestroy = false);
+
+		/**
+		* Like eachChunk(), for components stored as structures of arrays only, and without the entities:
+		*
+		*     world->eachSoA<Position, const Velocity>([](size_t count, SoAArrays<Position> p, SoAArrays<const Velocity> v) {
+		*         float* x = p[&Position::x];
+		*         const float* vx = v[&Velocity::x];
+		*         for (size_t i = 0; i < count; ++i)
+		*             x[i] += vx[i];
+		*     });
+		*/
+		template<typename... Types, typename Func>
+		void eachSoA(Func&& func, bool bIncludePendingDestroy = false);
+
+		/**
+		* Run a function on all entities.
+		*/
+		void all(std::function<void(Entity*)> viewFunc, bool bIncludePendingDestroy = false);
+
+		/**
+		* Like all(), but takes any callable instead of a std::function.
+		*/
+		template<typename Func>
+		typename Internal::EnableForCallable<Func, Internal::IsCallable<Func, Entity*>::value ? Internal::CallStyle::Handles : Internal::CallStyle::None>::type
+			all(Func&& func, bool bIncludePendingDestroy = false);
+
+		/**
+		* Get a view for entities with a specific set of components. The list of entities is calculated on the fly, so this method itself
+		* has little overhead. This is mostly useful with a range based for loop.
+		*/
+		template<typename... Types>
+		Internal::EntityComponentView<Types...> each(bool bIncludePendingDestroy = false)
+		{
+			Internal::EntityComponentIterator<Types...> first(this, 0, false, bIncludePendingDestroy);
+			Internal::EntityComponentIterator<Types...> last(this, getCount(), true, bIncludePendingDestroy);
+			return Internal::EntityComponentView<Types...>(first, last);
+		}
+
+		Internal::EntityView all(bool bIncludePendingDestroy = false);
+
+		/**
+		* Get the cached query for a set of components, creating it if it doesn't exist yet. Unlike each(), queries remember which
+		* entities match, so they are much faster to iterate over every tick. See Query for more information.
+		*/
+		template<typename... Types>
+		Query<Types...>* query();
+
+		/**
+		* Like each(), but the matching entities are split into batches of grainSize entities which run in parallel on the
+		* world's thread pool. The calling thread helps out, and this returns once every entity has been visited. A grainSize of 0
+		* uses the world's grain size (see setGrainSize()).
+		*
+		* The function is called from several threads at once, so it must not touch shared state (including emitting events
+		* that subscribers don't expect from other threads) without synchronization. The world's structure is locked until
+		* parallelEach returns: entities can't be created, and destroying entities and assigning or removing components is
+		* recorded in the calling thread's command buffer (see getCommandBuffer()) to be made when the commands are played back.
+		*/
+		template<typename... Types>
+		void parallelEach(typename Internal::QueryTerms<Types...>::HandleFunction viewFunc, size_t grainSize = 0, bool bIncludePendingDestroy = false);
+
+		/**
+		* Like parallelEach(), but takes any callable instead of a std::function, in the same forms as each() does.
+		*/
+		template<typename... Types, typename Func>
+		typename Internal::EnableForCallable<Func, Internal::EachCallStyle<Func, Types...>::value>::type parallelEach(Func&& func,
+			size_t grainSize = 0, bool bIncludePendingDestroy = false);
+
+		/**
+		* Like parallelEach(), but the function is called once per batch, with all of the matching entities in that batch.
+		*/
+		template<typename... Types>
+		void parallelEachRange(std::function<void(Span<Entity* const>)> rangeFunc, size_t grainSize = 0, bool bIncludePendingDestroy = false);
+
+		template<typename... Types, typename Func>
+		typename Internal::EnableForCallable<Func, Internal::IsCallable<Func, Span<Entity* const>>::value ? Internal::CallStyle::Handles : Internal::CallStyle::None>::type
+			parallelEachRange(Func&& rangeFunc, size_t grainSize = 0, bool bIncludePendingDestroy = false);
+
+		/**
+		* Like eachChunk(), but batches of grainSize entities run in parallel, as with parallelEach(). Runs never cross batches.
+		*/
+		template<typename... Types, typename Func>
+		void parallelEachChunk(Func&& func, size_t grainSize = 0, bool bIncludePendingDestroy = false);
+
+		/**
+		* Get the thread pool used by parallelEach(). The pool is started the first time this is called.
+		*/
+		ThreadPool* getThreadPool();
+
+		/**
+		* Set the number of worker threads used by parallelEach(), not counting the calling thread. A count of 0 (the default)
+		* uses one worker per hardware thread. This restarts the thread pool, so don't call it from inside of a parallel loop.
+		*/
+		void setWorkerCount(size_t count);
+
+		size_t getWorkerCount()
+		{
+			return getThreadPool()->getWorkerCount();
+		}
+
+		/**
+		* Set the default number of entities handed to a thread at once by parallelEach(). Smaller batches balance better
+		* across threads, while bigger batches have less overhead.
+		*/
+		void setGrainSize(size_t size)
+		{
+			grainSize = size > 0 ? size : 1;
+		}
+
+		size_t getGrainSize() const
+		{
+			return grainSize;
+		}
+
+		/**
+		* Is the world's structure locked by a parallel loop? While it is, entities may not be created (create() returns nullptr),
+		* and Entity::assign(), Entity::remove() and destroy() go through the calling thread's command buffer.
+		*/
+		bool isStructureLocked() const
+		{
+			return structureLocks > 0;
+		}
+
+		/**
+		* Get the command buffer of the calling thread. Every thread gets a buffer of its own, so this may be called from systems
+		* that run in parallel and from inside of parallelEach() to create and destroy entities, and assign and remove
+		* components, once the world's structure isn't locked anymore. The world plays back the buffers at the end of every
+		* tick() (unless ECS_TICK_NO_COMMAND_PLAYBACK is defined), or when playbackCommands() is called.
+		*
+		* Finding the buffer is cheap once a thread has asked for it, but still best done once per loop rather than per entity.
+		*/
+		CommandBuffer* getCommandBuffer();
+
+		/**
+		* Play back the commands recorded in the buffers handed out by getCommandBuffer(), one buffer at a time in the order
+		* that threads first asked for them. Don't record commands on other threads while this runs.
+		*/
+		void playbackCommands();
+
+		size_t getCount() const
+		{
+			return entities.size();
+		}
+
+		Entity* getByIndex(size_t idx)
+		{
+			if (idx >= getCount())
+				return nullptr;
+
+			return entities[idx];
+		}
+
+		/**
+		* Get an entity by an id. Returns nullptr if the entity was already deallocated.
+		*/
+		Entity* getById(size_t id) const
+		{
+			return resolve(EntityHandle::unpack(id));
+		}
+
+		/**
+		* Get the entity a handle refers to. Returns nullptr if the entity was already deallocated (entities pending
+		* destruction are still returned), or if the handle is null.
+		*/
+		Entity* resolve(EntityHandle handle) const
+		{
+			if (handle.index >= slots.size())
+				return nullptr;
+
+			const Internal::EntitySlot& slot = slots[handle.index];
+			return slot.generation == handle.generation ? slot.entity : nullptr;
+		}
+
+		/**
+		* Does this handle refer to an entity that hasn't been deallocated yet?
+		*/
+		bool isValid(EntityHandle handle) const
+		{
+			return resolve(handle) != nullptr;
+		}
+
+		/**
+		* Set a resource: a single object of a type that belongs to the world rather than to an entity, such as settings or a
+		* clock. Looking a resource up is an array access, so there's no need to find an entity that holds it. If the world
+		* already has a resource of this type, it's assigned a new value. Returns the resource.
+		*
+		* Systems declare access to resources like to components, with SystemAccess::reads<T>() and writes<T>(). Adding or
+		* removing a resource changes the world's structure, so it can't be done while the structure is locked.
+		*/
+		template<typename T, typename... Args>
+		T& setResource(Args&&... args);
+
+		/**
+		* Get a resource. Returns nullptr if the world doesn't have a resource of this type.
+		*/
+		template<typename T>
+		T* resource() const
+		{
+			const uint32_t id = Internal::getResourceId<T>();
+			if (id >= resources.size() || resources[id] == nullptr)
+				return nullptr;
+
+			return &static_cast<Internal::Resource<T>*>(resources[id])->value;
+		}
+
+		template<typename T>
+		bool hasResource() const
+		{
+			return resource<T>() != nullptr;
+		}
+
+		/**
+		* Remove and destroy a resource. Returns false if the world doesn't have a resource of this type.
+		*/
+		template<typename T>
+		bool removeResource();
+
+#ifdef ECS_PROFILING
+		/**
+		* Get what the world recorded about its ticks. Only available with ECS_PROFILING.
+		*/
+		Profiler& getProfiler()
+		{
+			return profiler;
+		}
+
+		const Profiler& getProfiler() const
+		{
+			return profiler;
+		}
+#endif
+
+		/**
+		* Tick the world. See the definition for ECS_TICK_TYPE at the top of this file for more information on
+		* passing data through tick().
+		*/
+#ifdef ECS_TICK_TYPE_VOID
+		void tick()
+#else
+		void tick(ECS_TICK_TYPE data)
+#endif
+		{
+#ifdef ECS_PROFILING
+			profiler.beginTick();
+#endif
+#ifndef ECS_TICK_NO_CLEANUP
+			cleanup();
+#endif
+			tickArena.reset();
+
+			if (bScheduleDirty)
+			{
+				buildSchedule();
+			}
+#ifdef ECS_PROFILING
+			profiler.endPhase(Profiler::Phase::Cleanup);
+#endif
+
+			for (auto& stage : schedule)
+			{
+				// Every stage gets a change tick of its own, so that systems see what the stages before them changed.
+				++changeTick;
+
+				if (stage.bExclusive)
+				{
+#ifdef ECS_TICK_TYPE_VOID
+					tickSystem(stage.systems[0]);
+#else
+					tickSystem(stage.systems[0], data);
+#endif
+					continue;
+				}
+
+				++structureLocks;
+				if (stage.systems.size() == 1)
+				{
+#ifdef ECS_TICK_TYPE_VOID
+					tickSystem(stage.systems[0]);
+#else
+					tickSystem(stage.systems[0], data);
+#endif
+				}
+				else
+				{
+					getThreadPool()->parallelFor(stage.systems.size(), [&](size_t idx) {
+#ifdef ECS_TICK_TYPE_VOID
+						tickSystem(stage.systems[idx]);
+#else
+						tickSystem(stage.systems[idx], data);
+#endif
+					});
+				}
+				--structureLocks;
+			}
+
+			// Changes made between ticks are newer than anything the systems saw.
+			++changeTick;
+
+#ifdef ECS_PROFILING
+			profiler.endPhase(Profiler::Phase::Systems);
+#endif
+
+#ifndef ECS_TICK_NO_COMMAND_PLAYBACK
+			playbackCommands();
+#endif
+#ifdef ECS_PROFILING
+			profiler.endPhase(Profiler::Phase::Commands);
+#endif
+
+#ifndef ECS_TICK_NO_EVENT_FLUSH
+			flushEvents();
+#endif
+#ifdef ECS_PROFILING
+			profiler.endPhase(Profiler::Phase::Events);
+			profiler.endTick(entities.size());
+#endif
+		}
+
+		/**
+		* Get the current change tick. Assigning a component stamps it with the change tick as the time it was added and
+		* changed, and so does each() for every component it passes to its callback (except for const ones, as in
+		* each<Position, const Velocity>()). Entity::markChanged() stamps a component by hand.
+		*
+		* tick() starts a new change tick for every group of systems it runs, and once more when it's done. While a system
+		* runs, Changed and Added filters pass the components stamped after the system last ran, so that systems see every
+		* change made since then (except for their own).
+		*/
+		uint32_t getChangeTick() const
+		{
+			return changeTick;
+		}
+
+		/**
+		* Start a new change tick, returning the one that ended. Components changed from now on are newer than the returned tick.
+		*/
+		uint32_t advanceChangeTick()
+		{
+			return changeTick++;
+		}
+
+		/**
+		* Get the tick that Changed and Added filters compare against on the calling thread. Inside of a system this is the
+		* tick the system last ran at, otherwise it's whatever was passed to setChangeSince() (0 by default, so every
+		* component counts as changed).
+		*/
+		uint32_t getChangeSince() const
+		{
+			const ChangeContext& context = currentChangeContext();
+			return context.world == this ? context.since : changeSince;
+		}
+
+		/**
+		* Set the tick that Changed and Added filters compare against outside of systems, for example to only visit the
+		* components changed since a tick returned by advanceChangeTick().
+		*/
+		void setChangeSince(uint32_t tick)
+		{
+			changeSince = tick;
+		}
+
+		EntityAllocator& getPrimaryAllocator()
+		{
+			return entAlloc;
+		}
+
+		/**
+		* Get the arena for memory that is only needed until the end of the tick, such as scratch arrays in systems (see
+		* ArenaAllocator). The arena is reset at the start of every tick(), so nothing allocated from it may be used afterwards.
+		*/
+		LinearArena& getTickArena()
+		{
+			return tickArena;
+		}
+
+		/**
+		* Count the memory the world uses, per component type and for everything it keeps besides components. This walks all
+		* of the world's storage, so it isn't meant to be called every tick.
+		*/
+		MemoryStats memoryStats() const;
+
+	private:
+		// What Changed and Added filters compare against on a thread while a system of a world runs on it.
+		struct ChangeContext
+		{
+			const World* world;
+			uint32_t since;
+
+#ifdef ECS_PROFILING
+			// Counts the entities each() visits for the running system.
+			std::atomic<uint64_t>* entities;
+#endif
+		};
+
+		static ChangeContext& currentChangeContext()
+		{
+			static thread_local ChangeContext context = {};
+			return context;
+		}
+
+#ifdef ECS_PROFILING
+		// Where each() counts the entities it visits, which is the running system's counter if there is one. Worker threads
+		// don't know which system they are running for, so parallel loops have to get the counter up front.
+		std::atomic<uint64_t>& getEntityCounter()
+		{
+			const ChangeContext& context = currentChangeContext();
+			return context.world == this && context.entities != nullptr ? *context.entities : profiler.entitiesOutsideSystems;
+		}
+
+		Profiler profiler;
+#endif
+
+		uint32_t changeTick = 1;
+		uint32_t changeSince = 0;
+
+#ifdef ECS_TICK_TYPE_VOID
+		void tickSystem(EntitySystem* system)
+#else
+		void tickSystem(EntitySystem* system, ECS_TICK_TYPE data)
+#endif
+		{
+			// Systems may run inside of other systems that wait for a parallel loop on the same thread, so restore the context after.
+			ChangeContext& context = currentChangeContext();
+			const ChangeContext previous = context;
+			context.world = this;
+			context.since = system->lastRunTick;
+			system->lastRunTick = changeTick;
+
+#ifdef ECS_PROFILING
+			Profiler::SystemStats* stats = profiler.findSystem(system);
+			Profiler::Clock::time_point start;
+			profiler.beginSystem(stats, start);
+			context.entities = stats != nullptr ? &stats->entitiesThisTick : nullptr;
+#endif
+
+#ifdef ECS_TICK_TYPE_VOID
+			system->tick(this);
+#else
+			system->tick(this, data);
+#endif
+
+#ifdef ECS_PROFILING
+			profiler.endSystem(stats, start);
+#endif
+
+			context = previous;
+		}
+
+		EntityAllocator entAlloc;
+
+		LinearArena tickArena;
+
+		std::vector<Entity*, EntityPtrAllocator> entities;
+		std::vector<EntitySystem*, SystemPtrAllocator> systems;
+        	std::vector<EntitySystem*> disabledSystems;
+		// Indexed by the type index of the event.
+		std::vector<EventSlot, EventSlotAllocator> eventSlots;
+
+		// Indexed by entity index. Slot 0 is never used, so that null handles and ids never resolve.
+		std::vector<Internal::EntitySlot, SlotAllocator> slots;
+		std::vector<uint32_t, IndexAllocator> freeIndices;
+
+		// Entities destroyed since the last cleanup(). Entities destroyed immediately afterwards are left in here, but their
+		// handles don't resolve anymore.
+		std::vector<EntityHandle, HandleAllocator> pendingDestroy;
+
+		// Indexed by the type index of the event.
+		std::vector<Internal::BaseEventQueue*, EventQueuePtrAllocator> eventQueues;
+
+		// The queues that have events waiting to be flushed, and the ones being flushed right now.
+		std::vector<Internal::BaseEventQueue*, EventQueuePtrAllocator> pendingEventQueues;
+		std::vector<Internal::BaseEventQueue*, EventQueuePtrAllocator> flushingEventQueues;
+
+		// Only locked while the structure is locked, as that's the only time events may be queued from several threads at once.
+		std::mutex eventQueueMutex;
+
+		// Indexed by resource id, nullptr for resource types the world doesn't have.
+		std::vector<Internal::BaseResource*, ResourcePtrAllocator> resources;
+
+		// Handed out by getCommandBuffer(), in the order that threads first asked for them.
+		std::vector<Internal::ThreadCommandBuffer, ThreadCommandBufferAllocator> commandBuffers;
+		std::mutex commandBufferMutex;
+
+		// Tells this world apart from worlds that were destroyed before it, which may have had the same address.
+		const uint64_t serial = nextSerial();
+
+		// The command buffer that a thread last got from getCommandBuffer(), so that it doesn't have to be looked up again.
+		struct CommandBufferCache
+		{
+			const World* world;
+			uint64_t serial;
+			CommandBuffer* buffer;
+		};
+
+		static CommandBufferCache& currentCommandBufferCache()
+		{
+			static thread_local CommandBufferCache cache = { nullptr, 0, nullptr };
+			return cache;
+		}
+
+		static uint64_t nextSerial()
+		{
+			static std::atomic<uint64_t> next(1);
+			return next++;
+		}
+
+		std::vector<Internal::BaseQuery*, QueryPtrAllocator> queries;
+		std::map<std::vector<TypeIndex>, Internal::BaseQuery*> queryLookup;
+
+		ThreadPool* threadPool = nullptr;
+		size_t workerCount = 0;
+		size_t grainSize = ECS_PARALLEL_GRAIN_SIZE;
+		std::atomic<int> structureLocks{ 0 };
+
+		// Systems grouped into stages by World::buildSchedule(), in the order they run in.
+		std::vector<Internal::SystemStage> schedule;
+		bool bScheduleDirty = true;
+
+		void buildSchedule();
+
+		// Allocate an entity and add it to the list of entities, without placing it in storage or emitting any events.
+		Entity* allocateEntity();
+
+		// Same as allocateEntity(), but at a free index chosen by the caller.
+		Entity* allocateEntityAt(uint32_t index);
+
+		// Same as create(), but at a free index chosen by the caller.
+		Entity* createAt(uint32_t index);
+
+		template<typename T>
+		EventSlot& getEventSlot()
+		{
+			auto index = getTypeIndex<T>();
+			if (index >= eventSlots.size())
+			{
+				eventSlots.resize(index + 1, EventSlot(Allocator(entAlloc)));
+			}
+
+			return eventSlots[index];
+		}
+
+		// Remove the callbacks of an event type with a given object, and a given thunk unless it's nullptr.
+		void removeCallbacks(TypeIndex index, const void* object, void (*receive)(void*, World*, const void*))
+		{
+			if (index >= eventSlots.size())
+				return;
+
+			EventSlot& slot = eventSlots[index];
+			for (size_t i = 0; i < slot.callbacks.size();)
+			{
+				if (slot.callbacks[i].object == object && (receive == nullptr || slot.callbacks[i].receive == receive))
+					eraseCallback(slot, i);
+				else
+					++i;
+			}
+		}
+
+		void eraseCallback(EventSlot& slot, size_t i)
+		{
+			Internal::EventCallback callback = slot.callbacks[i];
+			slot.callbacks.erase(slot.callbacks.begin() + i);
+
+			if (callback.destroy != nullptr)
+				callback.destroy(callback.object, this);
+		}
+
+		// Remove an entity from the list of entities by moving the last entity into its place.
+		void unlistEntity(Entity* ent);
+
+		// Destroy and deallocate an entity, without removing it from the list of entities.
+		void freeEntity(Entity* ent);
+
+		// Emit the events for entities created by createMany().
+		template<typename... Types>
+		void emitCreatedMany(size_t first, size_t count);
+
+		template<typename T>
+		void emitAssigned(Entity* ent);
+
+		template<typename T>
+		void emitAssigned(Entity* ent, std::false_type)
+		{
+			emit<Events::OnComponentAssigned<T>>({ ent, ent->get<T>() });
+		}
+
+		template<typename T>
+		void emitAssigned(Entity* ent, std::true_type)
+		{
+			// There's no single object to point to, so subscribers get a copy.
+			T component = ent->get<T>().get();
+			emit<Events::OnComponentAssigned<T>>({ ent, ComponentHandle<T>(&component) });
+		}
+
+		// Split the entities matching a query into ranges and run a function on each range in parallel. The types are the
+		// arguments of the query, see Internal::QueryTerms.
+		template<typename... Types>
+		void runParallel(Internal::TypeList<Types...>, const Internal::QueryMatcher& matcher, size_t grainSize,
+			const std::function<void(const Internal::ParallelRange&)>& rangeFunc);
+
+		template<typename Caller, typename Func, typename... Types>
+		void eachInRange(const Internal::ParallelRange& range, Func& func, Internal::TypeList<Types...>, const Internal::QueryMatcher& matcher,
+			uint32_t since, bool bIncludePendingDestroy);
+
+		// The parallelEach() and parallelEachRange() overloads for std::function and for other callables share these.
+		template<typename Caller, typename Func, typename... Types>
+		void parallelEachWith(Func& func, size_t grainSize, bool bIncludePendingDestroy);
+
+		template<typename Func, typename... Types>
+		void parallelEachRangeWith(Func& rangeFunc, size_t grainSize, bool bIncludePendingDestroy);
+
+		// Threads of a parallel loop only stamp the rows they visit, as chunks and blocks of pools are shared between threads. This
+		// marks every chunk or block of the components the loop writes as changed up front instead.
+		template<typename... Types>
+		void markBlocksChanged(Internal::TypeList<Types...>, const Internal::QueryMatcher& matcher);
+
+		// Run a function on every entity that matches a query, calling it through one of the Internal::Caller types. The
+		// types are the arguments of the query, which may be wrapped in Changed, Added or Optional (see Internal::Term).
+		// Changed and Added are checked against the change tick since.
+		template<typename Caller, typename Func, typename... Types>
+		void eachWith(Func& func, Internal::TypeList<Types...>, const Internal::QueryMatcher& matcher, uint32_t since, bool bIncludePendingDestroy);
+
+		// Run a function given to eachChunk() on the runs of a parallel range, or of the whole world if range is nullptr.
+		template<typename Func, typename... Types>
+		void eachChunkWith(Func& func, Internal::TypeList<Types...>, const Internal::QueryMatcher& matcher, const Internal::ParallelRange* range,
+			bool bIncludePendingDestroy);
+
+#ifdef ECS_ARCHETYPE_STORAGE
+		// Get or create the archetype with a (sorted) list of components.
+		Internal::Archetype* getArchetype(const std::vector<const Internal::ComponentInfo*>& components);
+
+		Internal::Archetype* getArchetypeWith(Internal::Archetype* source, const Internal::ComponentInfo* info);
+
+		Internal::Archetype* getArchetypeWithout(Internal::Archetype* source, uint32_t componentId);
+
+		static void setArchetypeEdge(std::vector<Internal::Archetype*>& edges, uint32_t componentId, Internal::Archetype* target)
+		{
+			if (componentId >= edges.size())
+				edges.resize(componentId + 1, nullptr);
+
+			edges[componentId] = target;
+		}
+
+		// Move an entity to another archetype. Components that the target archetype doesn't have are destroyed, and components
+		// that only the target archetype has are left uninitialized.
+		void moveEntity(Entity* ent, Internal::Archetype* target);
+
+		template<typename Caller, typename... Types, typename Func, size_t... Indices>
+		void eachInArchetype(Internal::Archetype* archetype, size_t begin, size_t end, Internal::IndexSequence<Indices...>,
+			Func& func, uint32_t since, bool bParallel, bool bIncludePendingDestroy);
+
+		// Get the components of a chunk for a term of each(), or nullptr for an optional component the archetype doesn't have.
+		template<typename T>
+		static typename Internal::Term<T>::Pointer getTermComponents(const Internal::Archetype* archetype, int column, size_t chunk)
+		{
+			typename Internal::Term<T>::Pointer components = { column >= 0 ? static_cast<typename Internal::Term<T>::Argument*>(archetype->getChunkComponents(column, chunk)) : nullptr };
+			return components;
+		}
+
+		// Visit the runs of rows [begin, end) of an archetype.
+		template<typename... Types, typename Func, size_t... Indices>
+		void eachChunkInArchetype(Internal::Archetype* archetype, size_t begin, size_t end, Internal::IndexSequence<Indices...>,
+			Func& func, bool bParallel, bool bIncludePendingDestroy);
+
+		template<typename T>
+		static T* getChunkArray(const Internal::Archetype* archetype, size_t column, size_t row, std::false_type)
+		{
+			return static_cast<T*>(archetype->getComponent(column, row));
+		}
+
+		template<typename T>
+		static SoAArrays<T> getChunkArray(const Internal::Archetype* archetype, size_t column, size_t row, std::true_type)
+		{
+			void* fields[std::remove_const<T>::type::SoAFields::FieldCount];
+			archetype->getFields(column, row, fields);
+			return SoAArrays<T>(fields);
+		}
+
+		std::vector<Internal::Archetype*, ArchetypePtrAllocator> archetypes;
+		std::map<std::vector<uint32_t>, Internal::Archetype*> archetypeLookup;
+		Internal::Archetype* rootArchetype;
+#else
+		// Returns nullptr if no component of this type was ever assigned.
+		template<typename T>
+		Internal::ComponentPool<T>* getPool() const;
+
+		template<typename T>
+		Internal::ComponentPool<T>* getOrCreatePool();
+
+		// Get the smallest pool of the components a query requires (its types may be wrapped, see Internal::Term). Returns
+		// nullptr if any of them doesn't have a pool, or if there are none.
+		template<typename... Types>
+		Internal::BaseComponentPool* getSmallestPool() const;
+
+		// Iterate the dense indices [begin, end) of a pool, visiting the entities that match a query.
+		template<typename Caller, typename... Types, typename Func, size_t... Indices>
+		void eachInPools(Internal::BaseComponentPool* pool, size_t begin, size_t end, Internal::IndexSequence<Indices...>,
+			const Internal::QueryMatcher& matcher, Func& func, uint32_t since, bool bParallel, bool bIncludePendingDestroy);
+
+		// Get the component of a term of each(), or nullptr for an optional component the entity doesn't have.
+		template<typename T>
+		static typename Internal::Term<T>::Pointer getTermComponent(Internal::ComponentPool<typename Internal::Term<T>::Component>* pool, uint32_t denseIndex);
+
+		// Visit the runs of the dense indices [begin, end) of a pool.
+		template<typename... Types, typename Func, size_t... Indices>
+		void eachChunkInPools(Internal::BaseComponentPool* pool, size_t begin, size_t end, Internal::IndexSequence<Indices...>,
+			const Internal::QueryMatcher& matcher, Func& func, bool bParallel, bool bIncludePendingDestroy);
+
+		template<typename T>
+		static T* getChunkArray(Internal::ComponentPool<typename std::remove_const<T>::type>* pool, size_t denseIndex, std::false_type)
+		{
+			return pool->getDense(denseIndex);
+		}
+
+		template<typename T>
+		static SoAArrays<T> getChunkArray(const Internal::ComponentPool<typename std::remove_const<T>::type>* pool, size_t denseIndex, std::true_type)
+		{
+			void* fields[std::remove_const<T>::type::SoAFields::FieldCount];
+			pool->getFields(denseIndex, fields);
+			return SoAArrays<T>(fields);
+		}
+
+		// Indexed by component id, nullptr for component types that were never assigned.
+		std::vector<Internal::BaseComponentPool*, PoolPtrAllocator> pools;
+		std::vector<Internal::BaseComponentPool*, PoolPtrAllocator> poolList;
+#endif
+	};
+
+	namespace Internal
+	{
+		class EntityIterator
+		{
+		public:
+			EntityIterator(World* world, size_t index, bool bIsEnd, bool bIncludePendingDestroy);
+
+			size_t getIndex() const
+			{
+				return index;
+			}
+
+			bool isEnd() const;
+
+			bool includePendingDestroy() const
+			{
+				return bIncludePendingDestroy;
+			}
+
+			World* getWorld() const
+			{
+				return world;
+			}
+
+			Entity* get() const;
+
+			Entity* operator*() const
+			{
+				return get();
+			}
+
+			bool operator==(const EntityIterator& other) const
+			{
+				if (world != other.world)
+					return false;
+
+				if (isEnd())
+					return other.isEnd();
+
+				return index == other.index;
+			}
+
+			bool operator!=(const EntityIterator& other) const
+			{
+				if (world != other.world)
+					return true;
+
+				if (isEnd())
+					return !other.isEnd();
+
+				return index != other.index;
+			}
+
+			EntityIterator& operator++();
+
+		private:
+			bool bIsEnd = false;
+			size_t index;
+			class ECS::World* world;
+			bool bIncludePendingDestroy;
+		};
+
+		class EntityView
+		{
+		public:
+			EntityView(const EntityIterator& first, const EntityIterator& last)
+				: firstItr(first), lastItr(last)
+			{
+				if (firstItr.get() == nullptr || (firstItr.get()->isPendingDestroy() && !firstItr.includePendingDestroy()))
+				{
+					++firstItr;
+				}
+			}
+
+			const EntityIterator& begin() const
+			{
+				return firstItr;
+			}
+
+			const EntityIterator& end() const
+			{
+				return lastItr;
+			}
+
+		private:
+			EntityIterator firstItr;
+			EntityIterator lastItr;
+		};
+
+#ifndef ECS_ARCHETYPE_STORAGE
+		/**
+		* Stores every component of a single type as a sparse set. Components and their entities are packed in dense arrays,
+		* and an entity's index maps to the position of its component through a paged sparse array.
+		*/
+		class BaseComponentPool
+		{
+		public:
+			static const uint32_t InvalidIndex = 0xFFFFFFFF;
+			static const size_t SparsePageSize = 4096;
+
+			// Dense indices are grouped into blocks of this size, which remember the newest change ticks of their components.
+			static const size_t TickBlockSize = 1024;
+
+			using IndexAllocator = World::IndexAllocator;
+
+			BaseComponentPool(const World::EntityAllocator& alloc, uint32_t componentId)
+				: entities({}, World::EntityPtrAllocator(alloc)), addedTicks({}, IndexAllocator(alloc)), changedTicks({}, IndexAllocator(alloc)),
+				blockAddedTicks({}, IndexAllocator(alloc)), blockChangedTicks({}, IndexAllocator(alloc)), indexAlloc(alloc), componentId(componentId)
+			{
+			}
+
+			virtual ~BaseComponentPool()
+			{
+				for (auto* page : sparse)
+				{
+					if (page != nullptr)
+						std::allocator_traits<IndexAllocator>::deallocate(indexAlloc, page, SparsePageSize);
+				}
+			}
+
+			// This should only ever be called by the world itself.
+			virtual void destroy(World* world) = 0;
+
+			// Emits OnComponentRemoved for the component of an entity.
+			virtual void removed(Entity* ent) = 0;
+
+			// Remove the component of an entity. The entity must have a component in this pool.
+			virtual void remove(Entity* ent) = 0;
+
+			size_t getCount() const
+			{
+				return entities.size();
+			}
+
+			uint32_t getComponentId() const
+			{
+				return componentId;
+			}
+
+			Entity* getEntity(size_t denseIndex) const
+			{
+				return entities[denseIndex];
+			}
+
+			// Get the entities from a dense index on.
+			Entity* const* getEntities(size_t denseIndex) const
+			{
+				return entities.data() + denseIndex;
+			}
+
+			// Returns InvalidIndex if the entity doesn't have a component in this pool.
+			uint32_t find(uint32_t entityIndex) const
+			{
+				size_t page = entityIndex / SparsePageSize;
+				if (page >= sparse.size() || sparse[page] == nullptr)
+					return InvalidIndex;
+
+				return sparse[page][entityIndex % SparsePageSize];
+			}
+
+			// Same as find(), but skips the lookup if the entity was found at a dense index of this pool.
+			uint32_t find(uint32_t entityIndex, const BaseComponentPool* source, size_t sourceIndex) const
+			{
+				return source == this ? static_cast<uint32_t>(sourceIndex) : find(entityIndex);
+			}
+
+			bool contains(uint32_t entityIndex) const
+			{
+				return find(entityIndex) != InvalidIndex;
+			}
+
+			// The tick a component was added at, see World::getChangeTick().
+			uint32_t getAddedTick(size_t denseIndex) const
+			{
+				return addedTicks[denseIndex];
+			}
+
+			// The tick a component was last assigned or written to at.
+			uint32_t getChangedTick(size_t denseIndex) const
+			{
+				return changedTicks[denseIndex];
+			}
+
+			void markChanged(size_t denseIndex, uint32_t tick)
+			{
+				changedTicks[denseIndex] = tick;
+				blockChangedTicks[denseIndex / TickBlockSize] = tick;
+			}
+
+			// Like markChanged(), but leaves the block alone. Use markAllBlocksChanged() beforehand instead.
+			void markRowChanged(size_t denseIndex, uint32_t tick)
+			{
+				changedTicks[denseIndex] = tick;
+			}
+
+			void markAllBlocksChanged(uint32_t tick)
+			{
+				std::fill(blockChangedTicks.begin(), blockChangedTicks.end(), tick);
+			}
+
+			// Does a component pass a Changed or Added filter?
+			bool passes(TermFilter filter, size_t denseIndex, uint32_t since) const
+			{
+				switch (filter)
+				{
+				case TermFilter::Changed:
+					return isTickNewer(changedTicks[denseIndex], since);
+				case TermFilter::Added:
+					return isTickNewer(addedTicks[denseIndex], since);
+				default:
+					return true;
+				}
+			}
+
+			// May any component in a block of dense indices pass a Changed or Added filter?
+			bool blockPasses(TermFilter filter, size_t block, uint32_t since) const
+			{
+				switch (filter)
+				{
+				case TermFilter::Changed:
+					return isTickNewer(blockChangedTicks[block], since);
+				case TermFilter::Added:
+					return isTickNewer(blockAddedTicks[block], since);
+				default:
+					return true;
+				}
+			}
+
+			// Keep a query up to date with the entities in this pool.
+			void addQuery(BaseQuery* query)
+			{
+				queries.push_back(query);
+			}
+
+			// Incremented whenever components in this pool are moved in memory.
+			const uint32_t* getVersion() const
+			{
+				return &version;
+			}
+
+			// Count the memory of the pool into the stats of its component type.
+			virtual void countMemory(MemoryStats& stats) const = 0;
+
+		protected:
+			// Count what every pool keeps per component, and get the stats of the pool's component type.
+			ComponentMemoryStats& countBookkeeping(MemoryStats& stats, size_t poolSize) const
+			{
+				ComponentMemoryStats& component = getComponentMemory(stats, componentId);
+				component.count += entities.size();
+				component.bookkeeping.addVector(entities);
+				component.bookkeeping.addVector(addedTicks);
+				component.bookkeeping.addVector(changedTicks);
+				component.bookkeeping.addVector(blockAddedTicks);
+				component.bookkeeping.addVector(blockChangedTicks);
+
+				// Every entity with the component uses one entry of a sparse page, the rest of the page is slack.
+				size_t pages = 0;
+				for (auto* page : sparse)
+				{
+					pages += page != nullptr ? 1 : 0;
+				}
+
+				component.bookkeeping.add(entities.size() * sizeof(uint32_t), pages * SparsePageSize * sizeof(uint32_t));
+				component.bookkeeping.addVector(sparse);
+
+				stats.storage.add(poolSize, poolSize);
+				stats.storage.addVector(queries);
+				return component;
+			}
+
+			static uint32_t getIndex(const Entity* ent);
+
+			void insertDense(Entity* ent, uint32_t tick);
+
+			// Swap the last entity into a dense index and pop it. Components must already have been moved the same way.
+			void eraseDense(uint32_t denseIndex);
+
+			void setSparse(uint32_t entityIndex, uint32_t denseIndex)
+			{
+				size_t page = entityIndex / SparsePageSize;
+				if (page >= sparse.size())
+					sparse.resize(page + 1, nullptr);
+
+				if (sparse[page] == nullptr)
+				{
+					sparse[page] = std::allocator_traits<IndexAllocator>::allocate(indexAlloc, SparsePageSize);
+					std::fill(sparse[page], sparse[page] + SparsePageSize, static_cast<uint32_t>(InvalidIndex));
+				}
+
+				sparse[page][entityIndex % SparsePageSize] = denseIndex;
+			}
+
+			std::vector<Entity*, World::EntityPtrAllocator> entities;
+
+			// Change ticks, by dense index.
+			std::vector<uint32_t, IndexAllocator> addedTicks;
+			std::vector<uint32_t, IndexAllocator> changedTicks;
+
+			// The newest change ticks, by block of dense indices. These only ever move forward, so they may be newer than any
+			// of the block's components once components were removed.
+			std::vector<uint32_t, IndexAllocator> blockAddedTicks;
+			std::vector<uint32_t, IndexAllocator> blockChangedTicks;
+
+			std::vector<uint32_t*> sparse;
+			IndexAllocator indexAlloc;
+			uint32_t componentId;
+			uint32_t version = 0;
+			std::vector<BaseQuery*> queries;
+		};
+
+		template<typename T>
+		class ComponentPool<T, false, false> : public BaseComponentPool
+		{
+		public:
+			using ComponentAllocator = std::allocator_traits<World::EntityAllocator>::template rebind_alloc<T>;
+
+			ComponentPool(const World::EntityAllocator& alloc)
+				: BaseComponentPool(alloc, Internal::getComponentId<T>()), components(ComponentAllocator(alloc))
+			{
+			}
+
+			// Returns nullptr if the entity doesn't have a component in this pool.
+			T* get(uint32_t entityIndex)
+			{
+				uint32_t denseIndex = find(entityIndex);
+				if (denseIndex == InvalidIndex)
+					return nullptr;
+
+				return &components[denseIndex];
+			}
+
+			T* getDense(size_t denseIndex)
+			{
+				return &components[denseIndex];
+			}
+
+			template<typename... Args>
+			T* assign(Entity* ent, Args&&... args);
+
+			// Add a component for an entity that doesn't have one in this pool yet, without looking it up first.
+			template<typename... Args>
+			T* insert(Entity* ent, uint32_t tick, Args&&... args);
+
+			// Make room for count more components, so that adding them doesn't move the existing ones more than once.
+			void reserveMore(size_t count)
+			{
+				size_t needed = components.size() + count;
+				if (needed <= components.capacity())
+					return;
+
+				// Grow geometrically, so that many small batches don't each reallocate.
+				components.reserve(std::max(needed, components.capacity() * 2));
+				entities.reserve(components.capacity());
+				addedTicks.reserve(components.capacity());
+				changedTicks.reserve(components.capacity());
+				++version;
+			}
+
+			virtual void destroy(World* world) override
+			{
+				using PoolAllocator = std::allocator_traits<World::EntityAllocator>::template rebind_alloc<ComponentPool<T>>;
+
+				PoolAllocator alloc(world->getPrimaryAllocator());
+				std::allocator_traits<PoolAllocator>::destroy(alloc, this);
+				std::allocator_traits<PoolAllocator>::deallocate(alloc, this, 1);
+			}
+
+			virtual void removed(Entity* ent) override;
+
+			virtual void remove(Entity* ent) override;
+
+			virtual void countMemory(MemoryStats& stats) const override
+			{
+				ComponentMemoryStats& component = countBookkeeping(stats, sizeof(*this));
+				component.size = sizeof(T);
+				component.components.addVector(components);
+			}
+
+		private:
+			std::vector<T, ComponentAllocator> components;
+		};
+
+		/**
+		* Stores the components of a type that is stored as a structure of arrays (see SoA) as a sparse set, with one dense
+		* array per field. The arrays share a single allocation, each starting on an ECS_SOA_ALIGNMENT boundary.
+		*/
+		template<typename T>
+		class ComponentPool<T, true, false> : public BaseComponentPool
+		{
+		public:
+			typedef typename T::SoAFields Layout;
+
+			using BlockAllocator = std::allocator_traits<World::EntityAllocator>::template rebind_alloc<std::max_align_t>;
+
+			static_assert(std::is_trivially_copyable<T>::value, "Components stored as structures of arrays must be trivially copyable.");
+
+			ComponentPool(const World::EntityAllocator& alloc)
+				: BaseComponentPool(alloc, Internal::getComponentId<T>()), blockAlloc(alloc)
+			{
+				std::fill(fields, fields + Layout::FieldCount, nullptr);
+			}
+
+			virtual ~ComponentPool()
+			{
+				if (block != nullptr)
+					std::allocator_traits<BlockAllocator>::deallocate(blockAlloc, block, blockCount);
+			}
+
+			// Get a pointer to every field of the component at a dense index.
+			void getFields(size_t denseIndex, void** out) const
+			{
+				const size_t* sizes = Layout::getFieldSizes();
+				for (size_t field = 0; field < Layout::FieldCount; ++field)
+				{
+					out[field] = static_cast<unsigned char*>(fields[field]) + denseIndex * sizes[field];
+				}
+			}
+
+			template<typename... Args>
+			void assign(Entity* ent, Args&&... args);
+
+			// Add a component for an entity that doesn't have one in this pool yet, without looking it up first.
+			template<typename... Args>
+			void insert(Entity* ent, uint32_t tick, Args&&... args);
+
+			// Make room for count more components, so that adding them doesn't move the existing ones more than once.
+			void reserveMore(size_t count)
+			{
+				size_t needed = getCount() + count;
+				if (needed <= capacity)
+					return;
+
+				grow(std::max(needed, capacity * 2));
+				entities.reserve(capacity);
+				addedTicks.reserve(capacity);
+				changedTicks.reserve(capacity);
+			}
+
+			virtual void destroy(World* world) override
+			{
+				using PoolAllocator = std::allocator_traits<World::EntityAllocator>::template rebind_alloc<ComponentPool<T>>;
+
+				PoolAllocator alloc(world->getPrimaryAllocator());
+				std::allocator_traits<PoolAllocator>::destroy(alloc, this);
+				std::allocator_traits<PoolAllocator>::deallocate(alloc, this, 1);
+			}
+
+			virtual void removed(Entity* ent) override;
+
+			virtual void remove(Entity* ent) override;
+
+			virtual void countMemory(MemoryStats& stats) const override
+			{
+				ComponentMemoryStats& component = countBookkeeping(stats, sizeof(*this));
+
+				const size_t* sizes = Layout::getFieldSizes();
+				component.size = 0;
+				for (size_t field = 0; field < Layout::FieldCount; ++field)
+				{
+					component.size += sizes[field];
+				}
+
+				// The spare capacity and the padding between the field arrays are slack.
+				component.components.add(getCount() * component.size, blockCount * sizeof(std::max_align_t));
+			}
+
+		private:
+			// Move the field arrays to a new allocation with room for a number of components.
+			void grow(size_t newCapacity);
+
+			BlockAllocator blockAlloc;
+			std::max_align_t* block = nullptr;
+			size_t blockCount = 0;
+			size_t capacity = 0;
+			void* fields[Layout::FieldCount];
+		};
+
+		/**
+		* Keeps track of which entities have a tag (see IsTag) as a sparse set, without storing any components. Every entity
+		* with the tag shares the same (empty) component, so assigning or removing a tag never constructs or moves one.
+		*/
+		template<typename T>
+		class ComponentPool<T, false, true> : public BaseComponentPool
+		{
+		public:
+			ComponentPool(const World::EntityAllocator& alloc)
+				: BaseComponentPool(alloc, Internal::getComponentId<T>())
+			{
+			}
+
+			// Returns nullptr if the entity doesn't have the tag.
+			T* get(uint32_t entityIndex)
+			{
+				return contains(entityIndex) ? &tag : nullptr;
+			}
+
+			T* getDense(size_t)
+			{
+				return &tag;
+			}
+
+			template<typename... Args>
+			T* assign(Entity* ent, Args&&... args);
+
+			// Add the tag to an entity that doesn't have it yet, without looking it up first.
+			template<typename... Args>
+			T* insert(Entity* ent, uint32_t tick, Args&&... args);
+
+			// Make room for count more tags.
+			void reserveMore(size_t count)
+			{
+				size_t needed = getCount() + count;
+				if (needed <= entities.capacity())
+					return;
+
+				entities.reserve(std::max(needed, entities.capacity() * 2));
+				addedTicks.reserve(entities.capacity());
+				changedTicks.reserve(entities.capacity());
+			}
+
+			virtual void destroy(World* world) override
+			{
+				using PoolAllocator = std::allocator_traits<World::EntityAllocator>::template rebind_alloc<ComponentPool<T>>;
+
+				PoolAllocator alloc(world->getPrimaryAllocator());
+				std::allocator_traits<PoolAllocator>::destroy(alloc, this);
+				std::allocator_traits<PoolAllocator>::deallocate(alloc, this, 1);
+			}
+
+			virtual void removed(Entity* ent) override;
+
+			virtual void remove(Entity* ent) override;
+
+			virtual void countMemory(MemoryStats& stats) const override
+			{
+				countBookkeeping(stats, sizeof(*this));
+			}
+
+		private:
+			T tag;
+		};
+#else
+		template<typename T>
+		struct ComponentOperations
+		{
+			static void moveConstruct(void* dest, void* src)
+			{
+				new (dest) T(std::move(*static_cast<T*>(src)));
+			}
+
+			static void destruct(void* component)
+			{
+				static_cast<T*>(component)->~T();
+			}
+
+			static void removed(Entity* ent, void* component)
+			{
+				World* world = ent->getWorld();
+				if (world->hasSubscribers<Events::OnComponentRemoved<T>>())
+				{
+					auto handle = ComponentHandle<T>(static_cast<T*>(component));
+					world->emit<Events::OnComponentRemoved<T>>({ ent, handle });
+				}
+			}
+		};
+
+		template<typename T>
+		struct SoAOperations
+		{
+			static void removed(Entity* ent, void*)
+			{
+				World* world = ent->getWorld();
+				if (world->hasSubscribers<Events::OnComponentRemoved<T>>())
+				{
+					// There's no single object to point to, so subscribers get a copy.
+					T component = ent->get<T>().get();
+					world->emit<Events::OnComponentRemoved<T>>({ ent, ComponentHandle<T>(&component) });
+				}
+			}
+		};
+
+		template<typename T>
+		const ComponentInfo* getComponentInfo(std::false_type)
+		{
+			static_assert(alignof(T) <= alignof(ArchetypeChunkBlock), "Over-aligned components are not supported by archetype storage.");
+
+			static const ComponentInfo info = {
+				getComponentId<T>(), sizeof(T), alignof(T),
+				&ComponentOperations<T>::moveConstruct,
+				&ComponentOperations<T>::destruct,
+				&ComponentOperations<T>::removed,
+				0, nullptr,
+				IsTag<T>::value
+			};
+
+			return &info;
+		}
+
+		template<typename T>
+		const ComponentInfo* getComponentInfo(std::true_type)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "Components stored as structures of arrays must be trivially copyable.");
+
+			static const ComponentInfo info = {
+				getComponentId<T>(), sizeof(T), alignof(T),
+				nullptr,
+				nullptr,
+				&SoAOperations<T>::removed,
+				T::SoAFields::FieldCount, T::SoAFields::getFieldSizes(),
+				false
+			};
+
+			return &info;
+		}
+
+		template<typename T>
+		const ComponentInfo* getComponentInfo()
+		{
+			return getComponentInfo<T>(IsSoA<T>());
+		}
+
+		template<typename Alloc>
+		void Archetype::removeRow(size_t row, Alloc& alloc)
+		{
+			using ChunkAllocator = typename std::allocator_traits<Alloc>::template rebind_alloc<ArchetypeChunkBlock>;
+
+			size_t last = count - 1;
+			if (row != last)
+			{
+				for (size_t column = 0; column < components.size(); ++column)
+				{
+					moveComponent(column, row, *this, column, last);
+					setTicks(column, row, getAddedTick(column, last), getChangedTick(column, last));
+				}
+
+				Entity* moved = getEntity(last);
+				reinterpret_cast<Entity**>(chunks[row / chunkCapacity])[row % chunkCapacity] = moved;
+				moved->archetypeRow = row;
+			}
+
+			--count;
+			++version;
+
+			// Keep a single spare chunk around so that an entity moving back and forth doesn't thrash the allocator.
+			size_t neededChunks = (count + chunkCapacity - 1) / chunkCapacity + 1;
+			if (chunks.size() > neededChunks)
+			{
+				ChunkAllocator chunkAlloc(alloc);
+				while (chunks.size() > neededChunks)
+				{
+					std::allocator_traits<ChunkAllocator>::deallocate(chunkAlloc, rawChunks.back(), chunkBlocks);
+					chunks.pop_back();
+					rawChunks.pop_back();
+				}
+
+				for (auto& newest : chunkTicks)
+				{
+					newest.added.resize(chunks.size());
+					newest.changed.resize(chunks.size());
+				}
+			}
+		}
+#endif
+
+		/**
+		* The part of a cached query that doesn't depend on the component types. Queries are kept up to date by the world as
+		* components are assigned and removed.
+		*/
+		class BaseQuery
+		{
+		public:
+			BaseQuery(World* world)
+				: world(world)
+#ifdef ECS_ARCHETYPE_STORAGE
+				, archetypes({}, World::ArchetypePtrAllocator(world->getPrimaryAllocator()))
+#else
+				, pools({}, World::PoolPtrAllocator(world->getPrimaryAllocator())),
+				entities({}, World::EntityPtrAllocator(world->getPrimaryAllocator())),
+				positions({}, World::IndexAllocator(world->getPrimaryAllocator()))
+#endif
+			{
+			}
+
+			virtual ~BaseQuery()
+			{
+			}
+
+			// This should only ever be called by the world itself.
+			virtual void destroy(World* world) = 0;
+
+			World* getWorld() const
+			{
+				return world;
+			}
+
+#ifdef ECS_ARCHETYPE_STORAGE
+			// Called by the world whenever a new archetype is created.
+			void onArchetypeCreated(Archetype* archetype)
+			{
+				if (archetype->getMask().containsAll(mask))
+					archetypes.push_back(archetype);
+			}
+#else
+			// Called by a pool when an entity gets a component of the pool's type.
+			void onInserted(Entity* ent);
+
+			// Called by a pool when an entity loses a component of the pool's type.
+			void onErased(Entity* ent);
+#endif
+
+			void countMemory(MemoryUsage& usage) const
+			{
+				usage.add(sizeof(BaseQuery), sizeof(BaseQuery));
+#ifdef ECS_ARCHETYPE_STORAGE
+				usage.addVector(archetypes);
+#else
+				usage.addVector(pools);
+				usage.addVector(entities);
+				usage.addVector(positions);
+#endif
+			}
+
+		protected:
+			World* world;
+
+			// The components an entity needs to match the query.
+			ComponentMask mask;
+
+#ifdef ECS_ARCHETYPE_STORAGE
+			std::vector<Archetype*, World::ArchetypePtrAllocator> archetypes;
+#else
+			static const uint32_t InvalidPosition = 0xFFFFFFFF;
+
+			// One pool per component type, in the order of the query's types.
+			std::vector<BaseComponentPool*, World::PoolPtrAllocator> pools;
+
+			// Every entity that has all of the components, and the position of each entity in that list by entity index.
+			std::vector<Entity*, World::EntityPtrAllocator> entities;
+			std::vector<uint32_t, World::IndexAllocator> positions;
+#endif
+		};
+	}
+
+	/**
+	* A cached list of the entities that have a specific set of components, created with World::query(). Rather than searching
+	* for matching entities every time, a query is updated as components are assigned and removed, so iterating it only costs
+	* as much as the entities that match.
+	*
+	* Queries are owned by the world and live as long as the world does, so it is fine to create them in
+	* EntitySystem::configure() and hold on to them.
+	*/
+	template<typename... Types>
+	class Query : public Internal::BaseQuery
+	{
+		static_assert(!Internal::AnySoA<typename std::remove_const<Types>::type...>::value, "Components stored as structures of arrays can't be queried, use World::eachSoA()");
+
+	public:
+		Query(World* world);
+
+		virtual void destroy(World* world) override
+		{
+			using QueryAllocator = std::allocator_traits<World::EntityAllocator>::template rebind_alloc<Query<Types...>>;
+
+			QueryAllocator alloc(world->getPrimaryAllocator());
+			std::allocator_traits<QueryAllocator>::destroy(alloc, this);
+			std::allocator_traits<QueryAllocator>::deallocate(alloc, this, 1);
+		}
+
+		/**
+		* Run a function on each entity that matches the query. This works just like World::each().
+		*/
+		void each(typename std::common_type<std::function<void(Entity*, ComponentHandle<typename std::remove_const<Types>::type>...)>>::type viewFunc,
+			bool bIncludePendingDestroy = false)
+		{
+			eachImpl<Internal::Caller<Internal::CallStyle::Handles>>(typename Internal::MakeIndexSequence<sizeof...(Types)>::Type(), viewFunc, bIncludePendingDestroy);
+		}
+
+		/**
+		* Like each(), but takes any callable. See World::each() for the kinds of callables that are supported.
+		*/
+		template<typename Func>
+		typename Internal::EnableForCallable<Func, Internal::EachCallStyle<Func, Types...>::value>::type each(Func&& func, bool bIncludePendingDestroy = false)
+		{
+			eachImpl<Internal::Caller<Internal::EachCallStyle<Func, Types...>::value>>(typename Internal::MakeIndexSequence<sizeof...(Types)>::Type(), func, bIncludePendingDestroy);
+		}
+
+		/**
+		* Get the number of matching entities, including entities that are pending destruction.
+		*/
+		size_t getCount() const
+		{
+#ifdef ECS_ARCHETYPE_STORAGE
+			size_t count = 0;
+			for (auto* archetype : archetypes)
+			{
+				count += archetype->getCount();
+			}
+
+			return count;
+#else
+			return entities.size();
+#endif
+		}
+
+	private:
+		template<typename Caller, typename Func, size_t... Indices>
+		void eachImpl(Internal::IndexSequence<Indices...>, Func& func, bool bIncludePendingDestroy);
+	};
+
+	/**
+	* Records structural changes to a world (creating and destroying entities, and assigning and removing components) and makes
+	* them all at once when it is played back. Use a command buffer to change the world from where changing it right away isn't
+	* allowed or safe, such as from inside of parallelEach(), from systems that run in parallel, or while iterating over entities.
+	*
+	* Playback creates the recorded entities first, then assigns and removes components one component type at a time (keeping
+	* the order in which commands for the same type were recorded), and destroys entities last, as with World::destroy(ent, false).
+	* Commands for entities that were destroyed in the meantime are skipped.
+	*
+	* A buffer may only be used by one thread at a time. World::getCommandBuffer() hands out a buffer per thread. Commands and
+	* the components they assign are stored in memory that is reused after playback, so recording stops allocating once a
+	* buffer has grown to fit the commands of a tick.
+	*/
+	class CommandBuffer
+	{
+	public:
+		// Set in the index of the handles returned by create(), which don't refer to entities of the world (yet).
+		const static uint32_t PendingIndexBit = 0x80000000;
+
+		CommandBuffer(World* world)
+			: world(world),
+			batches{ Batch(world->getPrimaryAllocator()), Batch(world->getPrimaryAllocator()) },
+			recording(&batches[0]), playing(&batches[1]),
+			created({}, HandleAllocator(world->getPrimaryAllocator())),
+			order({}, IndexAllocator(world->getPrimaryAllocator()))
+		{
+		}
+
+		CommandBuffer(const CommandBuffer&) = delete;
+		CommandBuffer& operator=(const CommandBuffer&) = delete;
+
+		~CommandBuffer()
+		{
+			BlockAllocator alloc(world->getPrimaryAllocator());
+			for (auto& batch : batches)
+			{
+				discard(batch);
+				for (auto& block : batch.blocks)
+				{
+					std::allocator_traits<BlockAllocator>::deallocate(alloc, block.data, block.count);
+				}
+			}
+		}
+
+		World* getWorld() const
+		{
+			return world;
+		}
+
+		/**
+		* Count the memory the buffer holds on to, including what it keeps around from earlier playbacks. See
+		* World::memoryStats().
+		*/
+		void countMemory(MemoryUsage& usage) const
+		{
+			usage.add(sizeof(CommandBuffer), sizeof(CommandBuffer));
+			for (auto& batch : batches)
+			{
+				usage.addVector(batch.commands);
+				usage.addVector(batch.destroys);
+				usage.addVector(batch.blocks);
+
+				// Blocks are filled in order, so the ones after the current block are empty.
+				for (size_t i = 0; i < batch.blocks.size(); ++i)
+				{
+					const size_t bytes = batch.blocks[i].count * sizeof(CommandBlock);
+					usage.add(i < batch.blockIndex ? bytes : (i == batch.blockIndex ? batch.blockOffset : 0), bytes);
+				}
+			}
+
+			usage.addVector(created);
+			usage.addVector(order);
+		}
+
+		/**
+		* Record creating an entity. The returned handle refers to the new entity in the other commands of this buffer until the
+		* buffer is played back, but doesn't resolve in the world and means nothing to other buffers.
+		*/
+		EntityHandle create()
+		{
+			assert(recording->createCount < PendingIndexBit && "Too many entities created by a single command buffer");
+			return EntityHandle(PendingIndexBit | recording->createCount++, 0);
+		}
+
+		/**
+		* Record destroying an entity. See World::destroy().
+		*/
+		void destroy(EntityHandle handle)
+		{
+			recording->destroys.push_back(handle);
+		}
+
+		/**
+		* Record assigning a component. The component is constructed from the arguments right away, and moved into the entity
+		* when the buffer is played back. See Entity::assign().
+		*/
+		template<typename T, typename... Args>
+		void assign(EntityHandle handle, Args&&... args)
+		{
+			void* component = allocate(*recording, sizeof(T), alignof(T));
+			new (component) T(std::forward<Args>(args)...);
+
+			push({ handle, Internal::getComponentId<T>(), component, &Thunks<T>::assign,
+				std::is_trivially_destructible<T>::value ? nullptr : &Thunks<T>::destroy });
+		}
+
+		/**
+		* Record removing a component. See Entity::remove().
+		*/
+		template<typename T>
+		void remove(EntityHandle handle)
+		{
+			push({ handle, Internal::getComponentId<T>(), nullptr, &Thunks<T>::remove, nullptr });
+		}
+
+		/**
+		* Get the number of commands waiting to be played back.
+		*/
+		size_t getCount() const
+		{
+			return recording->createCount + recording->commands.size() + recording->destroys.size();
+		}
+
+		bool empty() const
+		{
+			return getCount() == 0;
+		}
+
+		/**
+		* Make the recorded changes to the world. Commands recorded while the buffer plays back (for example by event subscribers)
+		* are kept for the next playback, and calling this while the buffer plays back does nothing.
+		*/
+		void playback();
+
+		/**
+		* Throw away the recorded commands without playing them back.
+		*/
+		void clear()
+		{
+			discard(*recording);
+		}
+
+	private:
+		using CommandBlock = std::max_align_t;
+		using BlockAllocator = std::allocator_traits<Allocator>::template rebind_alloc<CommandBlock>;
+		using HandleAllocator = std::allocator_traits<Allocator>::template rebind_alloc<EntityHandle>;
+		using IndexAllocator = std::allocator_traits<Allocator>::template rebind_alloc<uint32_t>;
+
+		// The smallest block of memory that assigned components are stored in.
+		const static size_t MinBlockSize = 4096;
+
+		struct Command
+		{
+			EntityHandle target;
+			uint32_t componentId;
+
+			// The component to assign, if any.
+			void* component;
+
+			void(*execute)(Entity* ent, void* component);
+			void(*destroy)(void* component);
+		};
+
+		struct Block
+		{
+			CommandBlock* data;
+			size_t count;
+		};
+
+		using CommandAllocator = std::allocator_traits<Allocator>::template rebind_alloc<Command>;
+		using BlockListAllocator = std::allocator_traits<Allocator>::template rebind_alloc<Block>;
+
+		// Everything recorded between two playbacks.
+		struct Batch
+		{
+			Batch(const Allocator& alloc)
+				: commands({}, CommandAllocator(alloc)), destroys({}, HandleAllocator(alloc)), blocks({}, BlockListAllocator(alloc))
+			{
+			}
+
+			size_t createCount = 0;
+			std::vector<Command, CommandAllocator> commands;
+
+			// Are the commands already sorted by component type? They usually are when they were recorded by a loop.
+			bool bSorted = true;
+			std::vector<EntityHandle, HandleAllocator> destroys;
+
+			// Holds the components to assign. Blocks are kept when the batch is cleared, and filled again from the first one.
+			std::vector<Block, BlockListAllocator> blocks;
+			size_t blockIndex = 0;
+			size_t blockOffset = 0;
+		};
+
+		template<typename T>
+		struct Thunks
+		{
+			static void assign(Entity* ent, void* component)
+			{
+				ent->assign<T>(std::move(*static_cast<T*>(component)));
+			}
+
+			static void remove(Entity* ent, void*)
+			{
+				ent->remove<T>();
+			}
+
+			static void destroy(void* component)
+			{
+				static_cast<T*>(component)->~T();
+			}
+		};
+
+		World* world;
+
+		// Recording goes to one batch while the other one plays back, so that commands may be recorded during playback.
+		Batch batches[2];
+		Batch* recording;
+		Batch* playing;
+		bool bPlaying = false;
+
+		// Used during playback: the entities created by the batch, and the order to run its commands in.
+		std::vector<EntityHandle, HandleAllocator> created;
+		std::vector<uint32_t, IndexAllocator> order;
+
+		void push(const Command& command)
+		{
+			if (!recording->commands.empty() && command.componentId < recording->commands.back().componentId)
+				recording->bSorted = false;
+
+			recording->commands.push_back(command);
+		}
+
+		void* allocate(Batch& batch, size_t size, size_t alignment)
+		{
+			for (;; ++batch.blockIndex, batch.blockOffset = 0)
+			{
+				if (batch.blockIndex == batch.blocks.size())
+				{
+					BlockAllocator alloc(world->getPrimaryAllocator());
+					size_t bytes = size + alignment > MinBlockSize ? size + alignment : MinBlockSize;
+					size_t count = (bytes + sizeof(CommandBlock) - 1) / sizeof(CommandBlock);
+					batch.blocks.push_back({ std::allocator_traits<BlockAllocator>::allocate(alloc, count), count });
+				}
+
+				const Block& block = batch.blocks[batch.blockIndex];
+				uintptr_t begin = reinterpret_cast<uintptr_t>(block.data);
+				uintptr_t address = (begin + batch.blockOffset + alignment - 1) / alignment * alignment;
+				if (address + size <= begin + block.count * sizeof(CommandBlock))
+				{
+					batch.blockOffset = address + size - begin;
+					return reinterpret_cast<void*>(address);
+				}
+			}
+		}
+
+		// Destroy the components of a batch that weren't assigned, and clear the batch.
+		void discard(Batch& batch)
+		{
+			for (auto& command : batch.commands)
+			{
+				if (command.destroy != nullptr)
+					command.destroy(command.component);
+			}
+
+			reset(batch);
+		}
+
+		// Clear a batch, keeping its memory.
+		void reset(Batch& batch)
+		{
+			batch.createCount = 0;
+			batch.bSorted = true;
+			batch.commands.clear();
+			batch.destroys.clear();
+			batch.blockIndex = 0;
+			batch.blockOffset = 0;
+		}
+
+		void execute(const Command& command)
+		{
+			// Subscribers may destroy entities right away, so resolve the handle of every command as it runs.
+			Entity* ent = resolve(command.target);
+			if (ent != nullptr)
+				command.execute(ent, command.component);
+
+			if (command.destroy != nullptr)
+				command.destroy(command.component);
+		}
+
+		Entity* resolve(EntityHandle handle) const
+		{
+			if (handle.index & PendingIndexBit)
+			{
+				uint32_t index = handle.index & ~PendingIndexBit;
+				return index < created.size() ? world->resolve(created[index]) : nullptr;
+			}
+
+			return world->resolve(handle);
+		}
+	};
+
+	inline void CommandBuffer::playback()
+	{
+		assert(!world->isStructureLocked() && "Command buffers can't be played back while the world is locked by a parallel loop");
+
+		if (bPlaying || empty() || world->isStructureLocked())
+			return;
+
+		bPlaying = true;
+		std::swap(recording, playing);
+		Batch& batch = *playing;
+
+		created.clear();
+		for (size_t i = 0; i < batch.createCount; ++i)
+		{
+			created.push_back(world->create()->getHandle());
+		}
+
+		if (batch.bSorted)
+		{
+			for (auto& command : batch.commands)
+			{
+				execute(command);
+			}
+		}
+		else
+		{
+			// Sort the commands by component type, keeping the order of the commands for each type, with a counting sort.
+			uint32_t starts[ECS_MAX_COMPONENTS + 1] = {};
+			for (auto& command : batch.commands)
+			{
+				++starts[command.componentId + 1];
+			}
+
+			for (size_t i = 1; i <= ECS_MAX_COMPONENTS; ++i)
+			{
+				starts[i] += starts[i - 1];
+			}
+
+			order.resize(batch.commands.size());
+			for (uint32_t i = 0; i < batch.commands.size(); ++i)
+			{
+				order[starts[batch.commands[i].componentId]++] = i;
+			}
+
+			for (uint32_t i : order)
+			{
+				execute(batch.commands[i]);
+			}
+		}
+
+		for (auto& handle : batch.destroys)
+		{
+			world->destroy(resolve(handle));
+		}
+
+		// The components were destroyed as their commands ran.
+		reset(batch);
+		created.clear();
+		bPlaying = false;
+	}
+
+	/**
+	* Collects the bytes that WorldSerializer save functions write for components that aren't saved as raw memory.
+	*/
+	class BinaryWriter
+	{
+	public:
+		void write(const void* data, size_t size)
+		{
+			buffer.insert(buffer.end(), static_cast<const char*>(data), static_cast<const char*>(data) + size);
+		}
+
+		template<typename T>
+		void write(const T& value)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be written directly, write their members instead.");
+			write(&value, sizeof(T));
+		}
+
+		void writeString(const std::string& value)
+		{
+			write(static_cast<uint32_t>(value.size()));
+			write(value.data(), value.size());
+		}
+
+		size_t getSize() const
+		{
+			return buffer.size();
+		}
+
+		const char* getData() const
+		{
+			return buffer.data();
+		}
+
+		void clear()
+		{
+			buffer.clear();
+		}
+
+	private:
+		std::vector<char> buffer;
+	};
+
+	/**
+	* Reads back what a BinaryWriter wrote. Reading past the end fails, leaving the value alone and marking the reader as failed,
+	* which in turn fails WorldSerializer::load().
+	*/
+	class BinaryReader
+	{
+	public:
+		BinaryReader(const char* data, size_t size)
+			: data(data), size(size)
+		{
+		}
+
+		bool read(void* dest, size_t count)
+		{
+			if (bFailed || count > size - position)
+			{
+				bFailed = true;
+				return false;
+			}
+
+			std::memcpy(dest, data + position, count);
+			position += count;
+			return true;
+		}
+
+		template<typename T>
+		bool read(T& value)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "Only trivially copyable values can be read directly, read their members instead.");
+			return read(&value, sizeof(T));
+		}
+
+		bool readString(std::string& value)
+		{
+			uint32_t length = 0;
+			if (!read(length) || length > size - position)
+			{
+				bFailed = true;
+				return false;
+			}
+
+			value.assign(data + position, length);
+			position += length;
+			return true;
+		}
+
+		bool hasFailed() const
+		{
+			return bFailed;
+		}
+
+	private:
+		const char* data;
+		size_t size;
+		size_t position = 0;
+		bool bFailed = false;
+	};
+
+	/**
+	* Saves the entities of a world, their ids and their components to a binary stream, and loads them back into an empty world.
+	* Only the component types registered with the serializer are saved, each under a name and a version:
+	*
+	*     WorldSerializer serializer;
+	*     serializer.registerComponent<Position>("Position");
+	*     serializer.registerComponent<Name>("Name", 1,
+	*         [](const Name& name, BinaryWriter& writer) { writer.writeString(name.value); },
+	*         [](Name& name, BinaryReader& reader, uint32_t version) { reader.readString(name.value); });
+	*
+	*     std::ofstream file("world.bin", std::ios::binary);
+	*     serializer.save(world, file);
+	*
+	* Trivially copyable components are saved as raw memory, straight from the world's storage, while other components are
+	* saved with their save function. Components are written in groups of at most GroupSize entities as the world is walked,
+	* so memory use doesn't grow with the size of the world.
+	*
+	* The stream starts with a header listing the saved component types with their name, version and size. When loading, a
+	* component saved with a different version or size than the registered one is passed to the type's load function along
+	* with the version it was saved with, so that older snapshots can be upgraded. Trivially copyable types may register a
+	* load function for this as well. Component types that aren't registered anymore are skipped.
+	*
+	* Values are written in the byte order of the machine, and streams written on a machine with a different byte order fail
+	* to load. Change ticks aren't saved: loaded components count as added at the tick they were loaded at.
+	*/
+	class WorldSerializer
+	{
+	public:
+		// Increased whenever the layout of the stream changes.
+		const static uint32_t FormatVersion = 1;
+
+		// The most entities written in a single group.
+		const static size_t GroupSize = 4096;
+
+		template<typename T>
+		using SaveFunc = std::function<void(const T& component, BinaryWriter& writer)>;
+
+		template<typename T>
+		using LoadFunc = std::function<void(T& component, BinaryReader& reader, uint32_t version)>;
+
+		/**
+		* Register a trivially copyable component type, which is saved as raw memory. The load function, if any, is only used
+		* for components saved with a different version or size, and reads the raw bytes of a single component.
+		*/
+		template<typename T>
+		WorldSerializer& registerComponent(const std::string& name, uint32_t version = 1, LoadFunc<T> load = nullptr)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "Components that aren't trivially copyable need a save and a load function.");
+			return registerType<T>(name, version, true, nullptr, load);
+		}
+
+		/**
+		* Register a component type that is saved and loaded with functions of its own.
+		*/
+		template<typename T>
+		WorldSerializer& registerComponent(const std::string& name, uint32_t version, SaveFunc<T> save, LoadFunc<T> load)
+		{
+			return registerType<T>(name, version, false, save, load);
+		}
+
+		/**
+		* Save a world. Entities that are pending destruction are left out, as if the world was cleaned up first. Returns false
+		* if the stream failed.
+		*/
+		bool save(World* world, std::ostream& out) const;
+
+		/**
+		* Load a world saved with save() into an empty world, restoring its entities with the same ids, in the same order. This
+		* emits the usual OnEntityCreated and OnComponentAssigned events. Returns false if the stream is broken or was written by
+		* an incompatible version, or if a component can't be loaded because its version changed and its type has no load
+		* function. The world may be left partially loaded in that case, but new entities can still be created safely.
+		*/
+		bool load(World* world, std::istream& in) const;
+
+	private:
+		struct ComponentType
+		{
+			std::string name;
+			uint32_t version;
+			uint32_t size;
+			uint32_t componentId;
+			bool bRaw;
+
+			// Only for types that aren't saved raw.
+			std::function<void(const void* components, size_t count, BinaryWriter& writer)> save;
+
+			// Load a single component saved with a version, and assign it to an entity unless it's nullptr.
+			std::function<bool(Entity* ent, BinaryReader& reader, uint32_t version)> load;
+
+			// Assign components stored as raw memory to entities that may be nullptr.
+			void(*assignRaw)(Entity** ents, size_t count, const void* components);
+
+			// Get a run of components stored next to each other. Components stored as structures of arrays are gathered into
+			// scratch first.
+#ifdef ECS_ARCHETYPE_STORAGE
+			const void*(*getComponents)(const Internal::Archetype* archetype, size_t column, size_t row, size_t count, std::vector<std::max_align_t>& scratch);
+#else
+			const void*(*getComponents)(Internal::BaseComponentPool* pool, size_t denseIndex, size_t count, std::vector<std::max_align_t>& scratch);
+#endif
+		};
+
+		// A component type of a stream, and what it was registered as, if anything.
+		struct SavedType
+		{
+			uint32_t version;
+			uint32_t size;
+			bool bRaw;
+			const ComponentType* type;
+		};
+
+		const static uint32_t Magic = 0x57534345; // "ECSW"
+		const static uint32_t ByteOrderMark = 0x01020304;
+
+		std::vector<ComponentType> types;
+
+		template<typename T>
+		WorldSerializer& registerType(const std::string& name, uint32_t version, bool bRaw, SaveFunc<T> save, LoadFunc<T> load)
+		{
+			ComponentType type;
+			type.name = name;
+			type.version = version;
+			type.size = static_cast<uint32_t>(sizeof(T));
+			type.componentId = Internal::getComponentId<T>();
+			type.bRaw = bRaw;
+			type.assignRaw = &assignRaw<T>;
+			type.getComponents = &getComponents<T>;
+
+			if (save)
+			{
+				type.save = [save](const void* components, size_t count, BinaryWriter& writer) {
+					for (const T* component = static_cast<const T*>(components), *end = component + count; component != end; ++component)
+					{
+						save(*component, writer);
+					}
+				};
+			}
+
+			if (load)
+			{
+				type.load = [load](Entity* ent, BinaryReader& reader, uint32_t version) {
+					T component;
+					load(component, reader, version);
+					if (reader.hasFailed())
+						return false;
+
+					if (ent != nullptr)
+						ent->assign<T>(std::move(component));
+
+					return true;
+				};
+			}
+
+			for (auto& existing : types)
+			{
+				if (existing.componentId == type.componentId || existing.name == type.name)
+				{
+					existing = type;
+					return *this;
+				}
+			}
+
+			types.push_back(type);
+			return *this;
+		}
+
+		template<typename T>
+		static void assignRaw(Entity** ents, size_t count, const void* components)
+		{
+			for (size_t i = 0; i < count; ++i)
+			{
+				if (ents[i] != nullptr)
+					ents[i]->assign<T>(static_cast<const T*>(components)[i]);
+			}
+		}
+
+#ifdef ECS_ARCHETYPE_STORAGE
+		template<typename T>
+		static const void* getComponents(const Internal::Archetype* archetype, size_t column, size_t row, size_t count, std::vector<std::max_align_t>& scratch)
+		{
+			return getComponents<T>(archetype, column, row, count, scratch, Internal::IsSoA<T>());
+		}
+
+		template<typename T>
+		static const void* getComponents(const Internal::Archetype* archetype, size_t column, size_t row, size_t count, std::vector<std::max_align_t>& scratch, std::false_type)
+		{
+			// Tags aren't stored, so there's no array of them to point to.
+			if (Internal::IsTag<T>::value)
+				return getScratch<T>(scratch, count);
+
+			return archetype->getComponent(column, row);
+		}
+
+		template<typename T>
+		static const void* getComponents(const Internal::Archetype* archetype, size_t column, size_t row, size_t count, std::vector<std::max_align_t>& scratch, std::true_type)
+		{
+			T* components = getScratch<T>(scratch, count);
+			void* fields[T::SoAFields::FieldCount];
+			for (size_t i = 0; i < count; ++i)
+			{
+				archetype->getFields(column, row + i, fields);
+				T::SoAFields::load(components[i], fields);
+			}
+
+			return components;
+		}
+#else
+		template<typename T>
+		static const void* getComponents(Internal::BaseComponentPool* pool, size_t denseIndex, size_t count, std::vector<std::max_align_t>& scratch)
+		{
+			return getComponents<T>(static_cast<Internal::ComponentPool<T>*>(pool), denseIndex, count, scratch);
+		}
+
+		template<typename T>
+		static const void* getComponents(Internal::ComponentPool<T, false, false>* pool, size_t denseIndex, size_t, std::vector<std::max_align_t>&)
+		{
+			return pool->getDense(denseIndex);
+		}
+
+		// Tags aren't stored, so there's no array of them to point to.
+		template<typename T>
+		static const void* getComponents(Internal::ComponentPool<T, false, true>*, size_t, size_t count, std::vector<std::max_align_t>& scratch)
+		{
+			return getScratch<T>(scratch, count);
+		}
+
+		template<typename T>
+		static const void* getComponents(Internal::ComponentPool<T, true, false>* pool, size_t denseIndex, size_t count, std::vector<std::max_align_t>& scratch)
+		{
+			T* components = getScratch<T>(scratch, count);
+			void* fields[T::SoAFields::FieldCount];
+			for (size_t i = 0; i < count; ++i)
+			{
+				pool->getFields(denseIndex + i, fields);
+				T::SoAFields::load(components[i], fields);
+			}
+
+			return components;
+		}
+#endif
+
+		template<typename T>
+		static T* getScratch(std::vector<std::max_align_t>& scratch, size_t count)
+		{
+			scratch.resize((count * sizeof(T) + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t));
+			T* components = reinterpret_cast<T*>(scratch.data());
+			for (size_t i = 0; i < count; ++i)
+			{
+				new (components + i) T();
+			}
+
+			return components;
+		}
+
+		const ComponentType* findType(uint32_t componentId) const
+		{
+			for (auto& type : types)
+			{
+				if (type.componentId == componentId)
+					return &type;
+			}
+
+			return nullptr;
+		}
+
+		template<typename T>
+		static void write(std::ostream& out, const T& value)
+		{
+			out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+		}
+
+		template<typename T>
+		static bool read(std::istream& in, T& value)
+		{
+			return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+		}
+
+		// Read size bytes into a buffer that grows as the data arrives, so that a corrupt size runs into the end of the stream
+		// instead of allocating all of it up front.
+		template<typename Buffer>
+		static bool readBytes(std::istream& in, Buffer& buffer, uint64_t size)
+		{
+			const size_t ChunkSize = 1 << 16;
+
+			buffer.clear();
+			while (buffer.size() < size)
+			{
+				const size_t offset = buffer.size();
+				const size_t count = static_cast<size_t>(std::min<uint64_t>(size - offset, ChunkSize));
+				buffer.resize(offset + count);
+				if (!in.read(&buffer[offset], count))
+					return false;
+			}
+
+			return true;
+		}
+
+		// Write the components of a group of entities, starting at the given component of the world's storage.
+		void writeComponents(std::ostream& out, const ComponentType& type, const void* components, size_t count, BinaryWriter& writer) const;
+	};
+
+	inline void WorldSerializer::writeComponents(std::ostream& out, const ComponentType& type, const void* components, size_t count, BinaryWriter& writer) const
+	{
+		write(out, static_cast<uint32_t>(&type - types.data()));
+		if (type.bRaw)
+		{
+			write(out, static_cast<uint64_t>(count * type.size));
+			out.write(static_cast<const char*>(components), count * type.size);
+		}
+		else
+		{
+			writer.clear();
+			type.save(components, count, writer);
+			write(out, static_cast<uint64_t>(writer.getSize()));
+			out.write(writer.getData(), writer.getSize());
+		}
+	}
+
+	inline bool WorldSerializer::save(World* world, std::ostream& out) const
+	{
+		write(out, static_cast<uint32_t>(Magic));
+		write(out, static_cast<uint32_t>(ByteOrderMark));
+		write(out, static_cast<uint32_t>(FormatVersion));
+
+		write(out, static_cast<uint32_t>(types.size()));
+		for (auto& type : types)
+		{
+			write(out, static_cast<uint32_t>(type.name.size()));
+			out.write(type.name.data(), type.name.size());
+			write(out, type.version);
+			write(out, type.size);
+			write(out, static_cast<uint8_t>(type.bRaw ? 1 : 0));
+		}
+
+		// Entities pending destruction are saved as if cleanup() already freed them.
+		std::vector<uint32_t> freed;
+		for (auto& handle : world->pendingDestroy)
+		{
+			if (world->resolve(handle) != nullptr)
+				freed.push_back(handle.index);
+		}
+
+		std::vector<uint32_t> buffer;
+		buffer.reserve(GroupSize);
+
+		write(out, static_cast<uint32_t>(world->slots.size()));
+		for (size_t i = 0; i < world->slots.size(); i += GroupSize)
+		{
+			buffer.clear();
+			for (size_t j = i; j < world->slots.size() && j < i + GroupSize; ++j)
+			{
+				const Internal::EntitySlot& slot = world->slots[j];
+				buffer.push_back(slot.entity != nullptr && slot.entity->isPendingDestroy() ? slot.generation + 1 : slot.generation);
+			}
+
+			out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(uint32_t));
+		}
+
+		write(out, static_cast<uint32_t>(world->freeIndices.size() + freed.size()));
+		out.write(reinterpret_cast<const char*>(world->freeIndices.data()), world->freeIndices.size() * sizeof(uint32_t));
+		out.write(reinterpret_cast<const char*>(freed.data()), freed.size() * sizeof(uint32_t));
+
+		write(out, static_cast<uint32_t>(world->getCount() - freed.size()));
+		for (size_t i = 0; i < world->entities.size(); i += GroupSize)
+		{
+			buffer.clear();
+			for (size_t j = i; j < world->entities.size() && j < i + GroupSize; ++j)
+			{
+				if (!world->entities[j]->isPendingDestroy())
+					buffer.push_back(world->entities[j]->getHandle().index);
+			}
+
+			out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size() * sizeof(uint32_t));
+		}
+
+		// Groups of entities with some of their components each, ending with an empty group. Entities pending destruction are
+		// saved as well, as leaving them out would mean copying the components around them, and are skipped when loading.
+		BinaryWriter writer;
+		std::vector<std::max_align_t> scratch;
+#ifdef ECS_ARCHETYPE_STORAGE
+		std::vector<size_t> columns;
+		for (auto* archetype : world->archetypes)
+		{
+			columns.clear();
+			for (size_t column = 0; column < archetype->getColumnCount(); ++column)
+			{
+				if (findType(archetype->getInfo(column)->id) != nullptr)
+					columns.push_back(column);
+			}
+
+			if (columns.empty())
+				continue;
+
+			const size_t capacity = archetype->getChunkCapacity();
+			for (size_t begin = 0, chunk = 0; begin < archetype->getCount(); begin += capacity, ++chunk)
+			{
+				const size_t count = std::min(capacity, archetype->getCount() - begin);
+				Entity** ents = archetype->getChunkEntities(chunk);
+
+				buffer.clear();
+				for (size_t i = 0; i < count; ++i)
+				{
+					buffer.push_back(ents[i]->getHandle().index);
+				}
+
+				write(out, static_cast<uint32_t>(count));
+				out.write(reinterpret_cast<const char*>(buffer.data()), count * sizeof(uint32_t));
+
+				write(out, static_cast<uint32_t>(columns.size()));
+				for (size_t column : columns)
+				{
+					const ComponentType* type = findType(archetype->getInfo(column)->id);
+					writeComponents(out, *type, type->getComponents(archetype, column, begin, count, scratch), count, writer);
+				}
+			}
+		}
+#else
+		for (auto* pool : world->poolList)
+		{
+			const ComponentType* type = findType(pool->getComponentId());
+			if (type == nullptr)
+				continue;
+
+			for (size_t begin = 0; begin < pool->getCount(); begin += GroupSize)
+			{
+				const size_t count = pool->getCount() - begin < GroupSize ? pool->getCount() - begin : GroupSize;
+
+				buffer.clear();
+				for (size_t i = begin; i < begin + count; ++i)
+				{
+					buffer.push_back(pool->getEntity(i)->getHandle().index);
+				}
+
+				write(out, static_cast<uint32_t>(count));
+				out.write(reinterpret_cast<const char*>(buffer.data()), count * sizeof(uint32_t));
+
+				write(out, static_cast<uint32_t>(1));
+				writeComponents(out, *type, type->getComponents(pool, begin, count, scratch), count, writer);
+			}
+		}
+#endif
+
+		write(out, static_cast<uint32_t>(0));
+
+		return out.good();
+	}
+
+	inline bool WorldSerializer::load(World* world, std::istream& in) const
+	{
+		assert(world->getCount() == 0 && "Worlds can only be loaded into an empty world");
+
+		uint32_t magic = 0, byteOrder = 0, formatVersion = 0, typeCount = 0;
+		if (!read(in, magic) || magic != Magic || !read(in, byteOrder) || byteOrder != ByteOrderMark ||
+			!read(in, formatVersion) || formatVersion > FormatVersion || !read(in, typeCount) || world->getCount() != 0)
+			return false;
+
+		// Sizes read from the stream are only trusted as far as the data behind them actually arrives.
+		std::vector<SavedType> savedTypes;
+		std::string name;
+		for (uint32_t t = 0; t < typeCount; ++t)
+		{
+			savedTypes.emplace_back();
+			SavedType& saved = savedTypes.back();
+
+			uint32_t nameLength = 0;
+			uint8_t bRaw = 0;
+			if (!read(in, nameLength))
+				return false;
+
+			if (!readBytes(in, name, nameLength) || !read(in, saved.version) || !read(in, saved.size) || !read(in, bRaw))
+				return false;
+
+			saved.bRaw = bRaw != 0;
+			saved.type = nullptr;
+			for (auto& type : types)
+			{
+				if (type.name == name)
+					saved.type = &type;
+			}
+		}
+
+		// Indices with the top bit set are taken by command buffers (see CommandBuffer::PendingIndexBit).
+		uint32_t slotCount = 0;
+		if (!read(in, slotCount) || slotCount == 0 || slotCount > CommandBuffer::PendingIndexBit)
+			return false;
+
+		// Slot 0 is reserved, even if the stream ends before its generation. The free list is only filled in once it was
+		// checked against the loaded entities, so that a stream that fails part way doesn't leave bad indices behind.
+		world->slots.resize(1);
+		world->freeIndices.clear();
+		std::vector<uint32_t> buffer(GroupSize);
+		for (size_t i = 0; i < slotCount; i += GroupSize)
+		{
+			const size_t count = slotCount - i < GroupSize ? slotCount - i : GroupSize;
+			if (!in.read(reinterpret_cast<char*>(buffer.data()), count * sizeof(uint32_t)))
+				return false;
+
+			world->slots.resize(i + count);
+			for (size_t j = 0; j < count; ++j)
+			{
+				world->slots[i + j].generation = buffer[j];
+			}
+		}
+
+		uint32_t freeCount = 0;
+		if (!read(in, freeCount) || freeCount >= slotCount)
+			return false;
+
+		std::vector<uint32_t, World::IndexAllocator> freeIndices(freeCount, 0, World::IndexAllocator(world->getPrimaryAllocator()));
+		if (freeCount > 0 && !in.read(reinterpret_cast<char*>(freeIndices.data()), freeCount * sizeof(uint32_t)))
+			return false;
+
+		uint32_t entityCount = 0;
+		if (!read(in, entityCount) || entityCount >= slotCount)
+			return false;
+
+		world->entities.reserve(entityCount);
+		for (size_t i = 0; i < entityCount; i += GroupSize)
+		{
+			const size_t count = entityCount - i < GroupSize ? entityCount - i : GroupSize;
+			if (!in.read(reinterpret_cast<char*>(buffer.data()), count * sizeof(uint32_t)))
+				return false;
+
+			for (size_t j = 0; j < count; ++j)
+			{
+				const uint32_t index = buffer[j];
+				if (index == 0 || index >= slotCount || world->slots[index].entity != nullptr)
+					return false;
+
+				world->createAt(index);
+			}
+		}
+
+		// The next create() takes a free index without checking it, so each one has to point at a distinct empty slot.
+		std::vector<bool> freed(slotCount, false);
+		for (uint32_t index : freeIndices)
+		{
+			if (index == 0 || index >= slotCount || freed[index] || world->slots[index].entity != nullptr)
+				return false;
+
+			freed[index] = true;
+		}
+
+		world->freeIndices.swap(freeIndices);
+
+		std::vector<Entity*> ents;
+		std::vector<std::max_align_t> components;
+		std::vector<char> bytes;
+		for (;;)
+		{
+			uint32_t count = 0;
+			if (!read(in, count) || count > GroupSize)
+				return false;
+
+			if (count == 0)
+				return true;
+
+			if (!in.read(reinterpret_cast<char*>(buffer.data()), count * sizeof(uint32_t)))
+				return false;
+
+			// Entities that were pending destruction when the world was saved don't exist anymore.
+			ents.resize(count);
+			for (size_t i = 0; i < count; ++i)
+			{
+				ents[i] = buffer[i] < slotCount ? world->slots[buffer[i]].entity : nullptr;
+			}
+
+			uint32_t componentCount = 0;
+			if (!read(in, componentCount))
+				return false;
+
+			for (uint32_t c = 0; c < componentCount; ++c)
+			{
+				uint32_t typeIndex = 0;
+				uint64_t size = 0;
+				if (!read(in, typeIndex) || typeIndex >= savedTypes.size() || !read(in, size))
+					return false;
+
+				const SavedType& saved = savedTypes[typeIndex];
+				if (saved.type == nullptr)
+				{
+					if (!readBytes(in, bytes, size))
+						return false;
+
+					continue;
+				}
+
+				if (saved.bRaw && saved.type->bRaw && saved.version == saved.type->version && saved.size == saved.type->size)
+				{
+					if (size != static_cast<uint64_t>(count) * saved.size)
+						return false;
+
+					components.resize((size + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t));
+					if (!in.read(reinterpret_cast<char*>(components.data()), size))
+						return false;
+
+					saved.type->assignRaw(ents.data(), count, components.data());
+				}
+				else
+				{
+					if (!saved.type->load)
+						return false;
+
+					if (!readBytes(in, bytes, size))
+						return false;
+
+					BinaryReader reader(bytes.data(), bytes.size());
+					for (size_t i = 0; i < count; ++i)
+					{
+						if (!saved.type->load(ents[i], reader, saved.version))
+							return false;
+					}
+				}
+			}
+		}
+	}
+
+#ifdef ECS_PROFILING
+	inline double Profiler::History::getMin() const
+	{
+		return count > 0 ? *std::min_element(values, values + count) : 0.0;
+	}
+
+	inline double Profiler::History::getMax() const
+	{
+		return count > 0 ? *std::max_element(values, values + count) : 0.0;
+	}
+
+	inline double Profiler::History::getMean() const
+	{
+		if (count == 0)
+			return 0.0;
+
+		double sum = 0.0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			sum += values[i];
+		}
+
+		return sum / count;
+	}
+
+	inline double Profiler::History::getPercentile(double percentile) const
+	{
+		if (count == 0)
+			return 0.0;
+
+		std::vector<double> sorted(values, values + count);
+		std::sort(sorted.begin(), sorted.end());
+
+		// Interpolate between the two closest values.
+		const double position = std::min(std::max(percentile, 0.0), 100.0) / 100.0 * (count - 1);
+		const size_t below = static_cast<size_t>(position);
+		const size_t above = std::min(below + 1, count - 1);
+		return sorted[below] + (sorted[above] - sorted[below]) * (position - below);
+	}
+
+	inline std::vector<size_t> Profiler::History::getHistogram(const std::vector<double>& bounds) const
+	{
+		std::vector<size_t> buckets(bounds.size() + 1, 0);
+		for (size_t i = 0; i < count; ++i)
+		{
+			++buckets[std::lower_bound(bounds.begin(), bounds.end(), values[i]) - bounds.begin()];
+		}
+
+		return buckets;
+	}
+
+	inline const Profiler::SystemStats* Profiler::getSystemStats(const EntitySystem* system) const
+	{
+		return findSystem(system);
+	}
+
+	inline void Profiler::setSystems(Span<EntitySystem* const> registered)
+	{
+		// Keep the stats of systems that are still registered.
+		std::vector<std::unique_ptr<SystemStats>> previous;
+		previous.swap(systems);
+
+		for (size_t i = 0; i < registered.size(); ++i)
+		{
+			EntitySystem* system = registered[i];
+			auto found = std::find_if(previous.begin(), previous.end(), [system](const std::unique_ptr<SystemStats>& stats) {
+				return stats != nullptr && stats->system == system;
+			});
+
+			if (found != previous.end())
+			{
+				systems.push_back(std::move(*found));
+				continue;
+			}
+
+			std::unique_ptr<SystemStats> stats(new SystemStats());
+			stats->system = system;
+			stats->name = system->getName() != nullptr ? system->getName() : "System " + std::to_string(i);
+			systems.push_back(std::move(stats));
+		}
+	}
+
+	inline Profiler::SystemStats* Profiler::findSystem(const EntitySystem* system) const
+	{
+		for (auto& stats : systems)
+		{
+			if (stats->system == system)
+				return stats.get();
+		}
+
+		return nullptr;
+	}
+
+	inline void Profiler::endPhase(Phase phase)
+	{
+		static const char* const names[PhaseCount] = { "Cleanup", "Systems", "Commands", "Events" };
+
+		const Clock::time_point now = Clock::now();
+		phaseTimes[static_cast<size_t>(phase)].add(toMilliseconds(now - phaseStart));
+
+		if (bTracing)
+		{
+			record({ names[static_cast<size_t>(phase)], "phase", toMicroseconds(phaseStart),
+				std::chrono::duration<double, std::micro>(now - phaseStart).count(), 0, {} });
+		}
+
+		phaseStart = now;
+	}
+
+	inline void Profiler::endSystem(SystemStats* stats, Clock::time_point start)
+	{
+		if (stats == nullptr)
+			return;
+
+		const Clock::time_point now = Clock::now();
+		stats->millisecondsThisTick = toMilliseconds(now - start);
+
+		if (bTracing)
+		{
+			record({ stats->name, "system", toMicroseconds(start), std::chrono::duration<double, std::micro>(now - start).count(), 0, {} });
+		}
+	}
+
+	inline void Profiler::endTick(size_t entityCount)
+	{
+		const Clock::time_point now = Clock::now();
+		tickTime.add(toMilliseconds(now - tickStart));
+		created.add(static_cast<double>(createdThisTick));
+		destroyed.add(static_cast<double>(destroyedThisTick));
+
+		uint64_t visited = entitiesOutsideSystems.exchange(0);
+		for (auto& stats : systems)
+		{
+			const uint64_t count = stats->entitiesThisTick.exchange(0);
+			visited += count;
+
+			if (stats->bRan)
+			{
+				stats->milliseconds.add(stats->millisecondsThisTick);
+				stats->entities.add(static_cast<double>(count));
+			}
+
+			stats->millisecondsThisTick = 0.0;
+			stats->bRan = false;
+		}
+
+		entitiesVisited.add(static_cast<double>(visited));
+
+		TraceEvent eventCounter = { "Events emitted", "counter", toMicroseconds(now), -1.0, 0, {} };
+		for (auto& stats : events)
+		{
+			// Once an event type was emitted, it gets a value every tick.
+			if (stats == nullptr || !stats->bEmitted)
+				continue;
+
+			stats->emitted.add(static_cast<double>(stats->emittedThisTick));
+			if (bTracing)
+				eventCounter.values.push_back({ stats->name, static_cast<double>(stats->emittedThisTick) });
+			stats->emittedThisTick = 0;
+		}
+
+		if (bTracing)
+		{
+			record({ "Tick", "tick", toMicroseconds(tickStart), std::chrono::duration<double, std::micro>(now - tickStart).count(), 0, {} });
+			record({ "Entities", "counter", toMicroseconds(now), -1.0, 0, { { "Alive", static_cast<double>(entityCount) } } });
+			record({ "Entity churn", "counter", toMicroseconds(now), -1.0, 0,
+				{ { "Created", static_cast<double>(createdThisTick) }, { "Destroyed", static_cast<double>(destroyedThisTick) } } });
+			record({ "Entities visited", "counter", toMicroseconds(now), -1.0, 0, { { "Visited", static_cast<double>(visited) } } });
+
+			if (!eventCounter.values.empty())
+				record(std::move(eventCounter));
+		}
+
+		createdThisTick = 0;
+		destroyedThisTick = 0;
+	}
+
+	inline void Profiler::record(TraceEvent&& event)
+	{
+		std::lock_guard<std::mutex> lock(traceMutex);
+
+		// Tracing may have been stopped since the caller checked.
+		if (!bTracing)
+			return;
+
+		event.thread = getThreadNumber();
+		trace.push_back(std::move(event));
+	}
+
+	inline uint32_t Profiler::getThreadNumber()
+	{
+		const std::thread::id id = std::this_thread::get_id();
+		auto found = std::find(threads.begin(), threads.end(), id);
+		if (found != threads.end())
+			return static_cast<uint32_t>(found - threads.begin());
+
+		threads.push_back(id);
+		return static_cast<uint32_t>(threads.size() - 1);
+	}
+
+	inline void Profiler::writeTrace(std::ostream& out)
+	{
+		std::lock_guard<std::mutex> lock(traceMutex);
+
+		const std::ios::fmtflags flags = out.flags();
+		const std::streamsize precision = out.precision();
+		out.setf(std::ios::fixed, std::ios::floatfield);
+		out.precision(3);
+
+		out << "{\"traceEvents\":[";
+		for (size_t i = 0; i < threads.size(); ++i)
+		{
+			out << (i > 0 ? "," : "") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i << ",\"args\":{\"name\":\"Thread " << i << "\"}}";
+		}
+
+		for (size_t i = 0; i < trace.size(); ++i)
+		{
+			const TraceEvent& event = trace[i];
+			out << (i > 0 || !threads.empty() ? "," : "") << "\n{\"name\":";
+			writeString(out, event.name);
+			out << ",\"cat\":\"" << event.category << "\",\"pid\":1,\"tid\":" << event.thread << ",\"ts\":" << event.start;
+
+			if (event.duration >= 0.0)
+			{
+				out << ",\"ph\":\"X\",\"dur\":" << event.duration << "}";
+				continue;
+			}
+
+			out << ",\"ph\":\"C\",\"args\":{";
+			for (size_t j = 0; j < event.values.size(); ++j)
+			{
+				out << (j > 0 ? "," : "");
+				writeString(out, event.values[j].first);
+				out << ":" << event.values[j].second;
+			}
+			out << "}}";
+		}
+		out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+		out.flags(flags);
+		out.precision(precision);
+	}
+
+	inline void Profiler::writeStats(std::ostream& out) const
+	{
+		static const char* const phaseNames[PhaseCount] = { "cleanup", "systems", "commands", "events" };
+
+		const std::ios::fmtflags flags = out.flags();
+		const std::streamsize precision = out.precision();
+		out.setf(std::ios::fixed, std::ios::floatfield);
+		out.precision(4);
+
+		out << "{\n\"tick\":";
+		writeHistory(out, tickTime, true);
+
+		out << ",\n\"phases\":{";
+		for (size_t i = 0; i < PhaseCount; ++i)
+		{
+			out << (i > 0 ? "," : "") << "\"" << phaseNames[i] << "\":";
+			writeHistory(out, phaseTimes[i], true);
+		}
+
+		out << "},\n\"created\":";
+		writeHistory(out, created, false);
+		out << ",\n\"destroyed\":";
+		writeHistory(out, destroyed, false);
+		out << ",\n\"entitiesVisited\":";
+		writeHistory(out, entitiesVisited, false);
+
+		out << ",\n\"systems\":[";
+		for (size_t i = 0; i < systems.size(); ++i)
+		{
+			out << (i > 0 ? "," : "") << "\n{\"name\":";
+			writeString(out, systems[i]->name);
+			out << ",\"milliseconds\":";
+			writeHistory(out, systems[i]->milliseconds, true);
+			out << ",\"entities\":";
+			writeHistory(out, systems[i]->entities, false);
+			out << "}";
+		}
+
+		out << "],\n\"events\":[";
+		bool bFirst = true;
+		for (auto& stats : events)
+		{
+			if (stats == nullptr || !stats->bEmitted)
+				continue;
+
+			out << (bFirst ? "" : ",") << "\n{\"name\":";
+			writeString(out, stats->name);
+			out << ",\"emitted\":";
+			writeHistory(out, stats->emitted, false);
+			out << "}";
+			bFirst = false;
+		}
+		out << "]\n}\n";
+
+		out.flags(flags);
+		out.precision(precision);
+	}
+
+	inline void Profiler::writeString(std::ostream& out, const std::string& str)
+	{
+		static const char hex[] = "0123456789abcdef";
+
+		out << '"';
+		for (char c : str)
+		{
+			if (c == '"' || c == '\\')
+				out << '\\' << c;
+			else if (static_cast<unsigned char>(c) < 0x20)
+				out << "\\u00" << hex[(c >> 4) & 0xF] << hex[c & 0xF];
+			else
+				out << c;
+		}
+		out << '"';
+	}
+
+	inline void Profiler::writeHistory(std::ostream& out, const History& history, bool bTime)
+	{
+		out << "{\"count\":" << history.getCount() << ",\"last\":" << history.getLast() << ",\"min\":" << history.getMin()
+			<< ",\"mean\":" << history.getMean() << ",\"max\":" << history.getMax() << ",\"p50\":" << history.getPercentile(50.0)
+			<< ",\"p90\":" << history.getPercentile(90.0) << ",\"p99\":" << history.getPercentile(99.0);
+
+		if (bTime)
+		{
+			// Bucketed by milliseconds, with the last buckets at two and four frames of 60 Hz.
+			static const std::vector<double> bounds = { 0.1, 0.25, 0.5, 1.0, 2.0, 4.0, 8.0, 16.0, 33.0, 66.0 };
+
+			const std::vector<size_t> buckets = history.getHistogram(bounds);
+			out << ",\"histogram\":[";
+			for (size_t i = 0; i < buckets.size(); ++i)
+			{
+				out << (i > 0 ? "," : "") << "{\"upTo\":";
+				if (i < bounds.size())
+					out << bounds[i];
+				else
+					out << "null";
+				out << ",\"count\":" << buckets[i] << "}";
+			}
+			out << "]";
+		}
+
+		out << "}";
+	}
+#endif
+
+	inline World::~World()
+	{
+		for (auto* system : systems)
+		{
+			system->unconfigure(this);
+		}
+
+		CommandBufferAllocator commandBufferAlloc(entAlloc);
+		for (auto& entry : commandBuffers)
+		{
+			std::allocator_traits<CommandBufferAllocator>::destroy(commandBufferAlloc, entry.buffer);
+			std::allocator_traits<CommandBufferAllocator>::deallocate(commandBufferAlloc, entry.buffer, 1);
+		}
+
+		for (auto* ent : entities)
+		{
+			if (!ent->isPendingDestroy())
+			{
+				ent->bPendingDestroy = true;
+				emit<Events::OnEntityDestroyed>({ ent });
+			}
+
+			freeEntity(ent);
+		}
+
+		for (auto* system : systems)
+		{
+			// Systems are created with new by their owners, not by the world's allocator.
+			delete system;
+		}
+
+		for (auto* query : queries)
+		{
+			query->destroy(this);
+		}
+
+		for (auto* queue : eventQueues)
+		{
+			if (queue != nullptr)
+				queue->destroy(this);
+		}
+
+		for (auto& slot : eventSlots)
+		{
+			for (auto& callback : slot.callbacks)
+			{
+				if (callback.destroy != nullptr)
+					callback.destroy(callback.object, this);
+			}
+		}
+
+		for (auto* resource : resources)
+		{
+			if (resource != nullptr)
+				resource->destroy(this);
+		}
+
+#ifdef ECS_ARCHETYPE_STORAGE
+		ArchetypeAllocator archetypeAlloc(entAlloc);
+		for (auto* archetype : archetypes)
+		{
+			archetype->releaseChunks(entAlloc);
+			std::allocator_traits<ArchetypeAllocator>::destroy(archetypeAlloc, archetype);
+			std::allocator_traits<ArchetypeAllocator>::deallocate(archetypeAlloc, archetype, 1);
+		}
+#else
+		for (auto* pool : poolList)
+		{
+			pool->destroy(this);
+		}
+#endif
+
+		setWorkerCount(0);
+	}
+
+	namespace Internal
+	{
+		// Only a PoolAllocator knows what it does with its memory.
+		template<typename Alloc>
+		void countAllocator(const Alloc&, AllocatorMemoryStats&)
+		{
+		}
+
+		template<typename T>
+		void countAllocator(const PoolAllocator<T>& alloc, AllocatorMemoryStats& stats)
+		{
+			MemoryPool* pool = alloc.getPool();
+			stats.bPooled = true;
+			stats.reserved = pool->getReservedBytes();
+			stats.handedOut = pool->getHandedOutBytes();
+			stats.requested = pool->getRequestedBytes();
+			stats.free = pool->getFreeBytes();
+		}
+	}
+
+	template<typename T>
+	const ComponentMemoryStats* MemoryStats::getComponent() const
+	{
+		const uint32_t id = Internal::getComponentId<T>();
+		auto found = std::lower_bound(components.begin(), components.end(), id, [](const ComponentMemoryStats& component, uint32_t id) {
+			return component.componentId < id;
+		});
+
+		return found != components.end() && found->componentId == id ? &*found : nullptr;
+	}
+
+	inline MemoryStats World::memoryStats() const
+	{
+		MemoryStats stats;
+		stats.entityCount = entities.size();
+
+		stats.entities.add(entities.size() * sizeof(Entity), entities.size() * sizeof(Entity));
+		stats.entities.addVector(entities);
+		// Slot 0 is never used, and the slots of destroyed entities are slack until they are reused.
+		size_t usedSlots = 0;
+		for (auto& slot : slots)
+		{
+			usedSlots += slot.entity != nullptr ? 1 : 0;
+		}
+
+		stats.entities.add(usedSlots * sizeof(Internal::EntitySlot), slots.capacity() * sizeof(Internal::EntitySlot));
+		stats.entities.addVector(freeIndices);
+		stats.entities.addVector(pendingDestroy);
+
+#ifdef ECS_ARCHETYPE_STORAGE
+		for (auto* archetype : archetypes)
+		{
+			archetype->countMemory(stats);
+		}
+
+		stats.storage.addVector(archetypes);
+#else
+		for (auto* pool : poolList)
+		{
+			pool->countMemory(stats);
+		}
+
+		stats.storage.addVector(pools);
+		stats.storage.addVector(poolList);
+#endif
+
+		// Component ids that were skipped over don't have any storage.
+		stats.components.erase(std::remove_if(stats.components.begin(), stats.components.end(), [](const ComponentMemoryStats& component) {
+			return component.components.allocated == 0 && component.bookkeeping.allocated == 0;
+		}), stats.components.end());
+
+		stats.events.addVector(eventSlots);
+		for (auto& slot : eventSlots)
+		{
+			stats.events.addVector(slot.subscribers);
+			stats.events.addVector(slot.callbacks);
+		}
+
+		for (auto* queue : eventQueues)
+		{
+			if (queue != nullptr)
+				queue->countMemory(stats.events);
+		}
+
+		stats.events.addVector(eventQueues);
+		stats.events.addVector(pendingEventQueues);
+		stats.events.addVector(flushingEventQueues);
+
+		stats.commands.addVector(commandBuffers);
+		for (auto& threadBuffer : commandBuffers)
+		{
+			threadBuffer.buffer->countMemory(stats.commands);
+		}
+
+		stats.arena.add(tickArena.getUsedBytes(), tickArena.getReservedBytes());
+
+		stats.queries.addVector(queries);
+		for (auto* query : queries)
+		{
+			query->countMemory(stats.queries);
+		}
+
+		stats.resources.addVector(resources);
+		for (auto* resource : resources)
+		{
+			if (resource != nullptr)
+				stats.resources.add(resource->getSize(), resource->getSize());
+		}
+
+		stats.systems.addVector(systems);
+		stats.systems.addVector(schedule);
+		for (auto& stage : schedule)
+		{
+			stats.systems.addVector(stage.systems);
+		}
+
+		Internal::countAllocator(entAlloc, stats.allocator);
+		return stats;
+	}
+
+	inline void World::buildSchedule()
+	{
+		const size_t count = systems.size();
+
+		std::vector<SystemAccess> access(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			systems[i]->declareAccess(access[i]);
+		}
+
+		// mustPrecede[i * count + j] is true if system i has to run before system j.
+		std::vector<bool> mustPrecede(count * count, false);
+		auto indexOf = [&](EntitySystem* system) {
+			return static_cast<size_t>(std::find(systems.begin(), systems.end(), system) - systems.begin());
+		};
+
+		for (size_t i = 0; i < count; ++i)
+		{
+			for (auto* other : access[i].runAfter)
+			{
+				size_t j = indexOf(other);
+				if (j < count && j != i)
+					mustPrecede[j * count + i] = true;
+			}
+
+			for (auto* other : access[i].runBefore)
+			{
+				size_t j = indexOf(other);
+				if (j < count && j != i)
+					mustPrecede[i * count + j] = true;
+			}
+		}
+
+		// Order the systems by registration, except that a system's explicit predecessors get pulled in front of it. Constraints
+		// that form a cycle are ignored once the cycle is found.
+		std::vector<size_t> order;
+		std::vector<int> state(count, 0); // 0 = not visited, 1 = visiting, 2 = placed
+		order.reserve(count);
+		std::function<void(size_t)> place = [&](size_t j) {
+			state[j] = 1;
+			for (size_t i = 0; i < count; ++i)
+			{
+				if (state[i] == 0 && mustPrecede[i * count + j])
+					place(i);
+			}
+
+			state[j] = 2;
+			order.push_back(j);
+		};
+
+		for (size_t j = 0; j < count; ++j)
+		{
+			if (state[j] == 0)
+				place(j);
+		}
+
+		// Each system goes into the first stage after every system that it conflicts with (or has to run after) that came
+		// before it in the order.
+		std::vector<size_t> stageOf(count, 0);
+		size_t stageCount = 0;
+		for (size_t p = 0; p < count; ++p)
+		{
+			const size_t j = order[p];
+			for (size_t q = 0; q < p; ++q)
+			{
+				const size_t i = order[q];
+				if (mustPrecede[i * count + j] || access[i].conflictsWith(access[j]))
+					stageOf[j] = std::max(stageOf[j], stageOf[i] + 1);
+			}
+
+			stageCount = std::max(stageCount, stageOf[j] + 1);
+		}
+
+		schedule.clear();
+		schedule.resize(stageCount);
+		for (size_t p = 0; p < count; ++p)
+		{
+			const size_t j = order[p];
+			schedule[stageOf[j]].systems.push_back(systems[j]);
+			schedule[stageOf[j]].bExclusive = access[j].isExclusive();
+		}
+
+		bScheduleDirty = false;
+
+#ifdef ECS_PROFILING
+		profiler.setSystems(Span<EntitySystem* const>(systems.data(), systems.size()));
+#endif
+	}
+
+	inline Entity* World::allocateEntity()
+	{
+		uint32_t index;
+		if (freeIndices.empty())
+		{
+			index = static_cast<uint32_t>(slots.size());
+			slots.push_back(Internal::EntitySlot());
+		}
+		else
+		{
+			index = freeIndices.back();
+			freeIndices.pop_back();
+		}
+
+		return allocateEntityAt(index);
+	}
+
+	inline Entity* World::allocateEntityAt(uint32_t index)
+	{
+		Entity* ent = std::allocator_traits<EntityAllocator>::allocate(entAlloc, 1);
+		std::allocator_traits<EntityAllocator>::construct(entAlloc, ent, this, EntityHandle(index, slots[index].generation));
+		ent->listIndex = static_cast<uint32_t>(entities.size());
+		entities.push_back(ent);
+		slots[index].entity = ent;
+
+#ifdef ECS_PROFILING
+		++profiler.createdThisTick;
+#endif
+
+		return ent;
+	}
+
+	inline Entity* World::createAt(uint32_t index)
+	{
+		Entity* ent = allocateEntityAt(index);
+#ifdef ECS_ARCHETYPE_STORAGE
+		ent->archetype = rootArchetype;
+		ent->archetypeRow = rootArchetype->pushRow(ent, entAlloc);
+#endif
+
+		emit<Events::OnEntityCreated>({ ent });
+
+		return ent;
+	}
+
+	template<typename... Types>
+	void World::emitCreatedMany(size_t first, size_t count)
+	{
+		// Subscribers may create more entities, which are added after these ones, so don't hold on to pointers.
+		for (size_t i = first; i < first + count; ++i)
+		{
+			Entity* ent = entities[i];
+			emit<Events::OnEntityCreated>({ ent });
+
+			int expand[] = { 0, (emitAssigned<Types>(ent), 0)... };
+			(void)expand;
+		}
+
+		emit<Events::OnEntitiesCreated>({ Span<Entity* const>(entities.data() + first, count) });
+	}
+
+	template<typename T>
+	void World::emitAssigned(Entity* ent)
+	{
+		// Looking up the component isn't free, so skip it if nobody is listening.
+		if (hasSubscribers<Events::OnComponentAssigned<T>>())
+		{
+			emitAssigned<T>(ent, Internal::IsSoA<T>());
+		}
+	}
+
+	template<typename T>
+	void World::enqueue(const T& event)
+	{
+		std::unique_lock<std::mutex> lock(eventQueueMutex, std::defer_lock);
+		if (isStructureLocked())
+			lock.lock();
+
+		auto index = getTypeIndex<T>();
+		if (index >= eventQueues.size())
+		{
+			eventQueues.resize(index + 1, nullptr);
+		}
+
+		Internal::BaseEventQueue* queue = eventQueues[index];
+		if (queue == nullptr)
+		{
+			using QueueAllocator = std::allocator_traits<EntityAllocator>::template rebind_alloc<Internal::EventQueue<T>>;
+
+			QueueAllocator alloc(entAlloc);
+			Internal::EventQueue<T>* typedQueue = std::allocator_traits<QueueAllocator>::allocate(alloc, 1);
+			std::allocator_traits<QueueAllocator>::construct(alloc, typedQueue, Allocator(entAlloc));
+			eventQueues[index] = queue = typedQueue;
+		}
+
+		static_cast<Internal::EventQueue<T>*>(queue)->push(event);
+		if (!queue->bPending)
+		{
+			queue->bPending = true;
+			pendingEventQueues.push_back(queue);
+		}
+	}
+
+	inline void World::flushEvents()
+	{
+		assert(!isStructureLocked() && "Events can't be flushed while the world is locked by a parallel loop");
+		if (isStructureLocked())
+			return;
+
+		if (!flushingEventQueues.empty())
+			return;
+
+		flushingEventQueues.swap(pendingEventQueues);
+		for (auto* queue : flushingEventQueues)
+		{
+			queue->bPending = false;
+		}
+
+		for (auto* queue : flushingEventQueues)
+		{
+			queue->flush(this);
+		}
+
+		flushingEventQueues.clear();
+	}
+
+	inline CommandBuffer* World::getCommandBuffer()
+	{
+		CommandBufferCache& cache = currentCommandBufferCache();
+		if (cache.world == this && cache.serial == serial)
+			return cache.buffer;
+
+		std::lock_guard<std::mutex> lock(commandBufferMutex);
+
+		CommandBuffer* buffer = nullptr;
+		const std::thread::id thread = std::this_thread::get_id();
+		for (auto& entry : commandBuffers)
+		{
+			if (entry.thread == thread)
+				buffer = entry.buffer;
+		}
+
+		if (buffer == nullptr)
+		{
+			CommandBufferAllocator alloc(entAlloc);
+			buffer = std::allocator_traits<CommandBufferAllocator>::allocate(alloc, 1);
+			std::allocator_traits<CommandBufferAllocator>::construct(alloc, buffer, this);
+			commandBuffers.push_back({ thread, buffer });
+		}
+
+		cache.world = this;
+		cache.serial = serial;
+		cache.buffer = buffer;
+		return buffer;
+	}
+
+	inline void World::playbackCommands()
+	{
+		assert(!isStructureLocked() && "Commands can't be played back while the world is locked by a parallel loop");
+		if (isStructureLocked())
+			return;
+
+		// Playing back a buffer may hand out buffers to more threads, so don't hold on to an iterator.
+		for (size_t i = 0; i < commandBuffers.size(); ++i)
+		{
+			commandBuffers[i].buffer->playback();
+		}
+	}
+
+	template<typename T, typename Func>
+	typename std::enable_if<Internal::IsCallable<Func, World*, const T&>::value && !std::is_convertible<Func, EventSubscriber<T>*>::value, EventSubscription>::type
+		World::subscribe(Func&& func, const void* owner)
+	{
+		using StoredFunc = typename std::decay<Func>::type;
+		using FuncAllocator = std::allocator_traits<EntityAllocator>::template rebind_alloc<StoredFunc>;
+		using Thunks = Internal::CallableThunks<T, StoredFunc>;
+
+		FuncAllocator alloc(entAlloc);
+		StoredFunc* stored = std::allocator_traits<FuncAllocator>::allocate(alloc, 1);
+		std::allocator_traits<FuncAllocator>::construct(alloc, stored, std::forward<Func>(func));
+
+		getEventSlot<T>().callbacks.push_back({ stored, owner != nullptr ? owner : stored, &Thunks::receive, &Thunks::receiveBatch, &Thunks::destroy });
+
+		EventSubscription subscription;
+		subscription.type = getTypeIndex<T>();
+		subscription.object = stored;
+		return subscription;
+	}
+
+	namespace Internal
+	{
+		template<typename T, typename Func>
+		void CallableThunks<T, Func>::destroy(void* object, World* world)
+		{
+			using FuncAllocator = std::allocator_traits<World::EntityAllocator>::template rebind_alloc<Func>;
+
+			FuncAllocator alloc(world->getPrimaryAllocator());
+			std::allocator_traits<FuncAllocator>::destroy(alloc, static_cast<Func*>(object));
+			std::allocator_traits<FuncAllocator>::deallocate(alloc, static_cast<Func*>(object), 1);
+		}
+
+		template<typename T>
+		void EventQueue<T>::flush(World* world)
+		{
+			flushing.swap(events);
+			world->emitBatch(Span<const T>(flushing.data(), flushing.size()));
+			flushing.clear();
+		}
+
+		template<typename T>
+		void EventQueue<T>::destroy(World* world)
+		{
+			using QueueAllocator = std::allocator_traits<World::EntityAllocator>::template rebind_alloc<EventQueue<T>>;
+
+			QueueAllocator alloc(world->getPrimaryAllocator());
+			std::allocator_traits<QueueAllocator>::destroy(alloc, this);
+			std::allocator_traits<QueueAllocator>::deallocate(alloc, this, 1);
+		}
+
+		template<typename T>
+		void Resource<T>::destroy(World* world)
+		{
+			using ResourceAllocator = std::allocator_traits<World::EntityAllocator>::template rebind_alloc<Resource<T>>;
+
+			ResourceAllocator alloc(world->getPrimaryAllocator());
+			std::allocator_traits<ResourceAllocator>::destroy(alloc, this);
+			std::allocator_traits<ResourceAllocator>::deallocate(alloc, this, 1);
+		}
+	}
+
+	template<typename T, typename... Args>
+	T& World::setResource(Args&&... args)
+	{
+		T* existing = resource<T>();
+		if (existing != nullptr)
+		{
+			*existing = T(std::forward<Args>(args)...);
+			return *existing;
+		}
+
+		assert(!isStructureLocked() && "Resources can't be added while the world is locked by a parallel loop");
+
+		using ResourceAllocator = std::allocator_traits<EntityAllocator>::template rebind_alloc<Internal::Resource<T>>;
+
+		const uint32_t id = Internal::getResourceId<T>();
+		if (id >= resources.size())
+			resources.resize(id + 1, nullptr);
+
+		ResourceAllocator alloc(entAlloc);
+		Internal::Resource<T>* created = std::allocator_traits<ResourceAllocator>::allocate(alloc, 1);
+		std::allocator_traits<ResourceAllocator>::construct(alloc, created, std::forward<Args>(args)...);
+		resources[id] = created;
+		return created->value;
+	}
+
+	template<typename T>
+	bool World::removeResource()
+	{
+		const uint32_t id = Internal::getResourceId<T>();
+		if (id >= resources.size() || resources[id] == nullptr)
+			return false;
+
+		assert(!isStructureLocked() && "Resources can't be removed while the world is locked by a parallel loop");
+
+		resources[id]->destroy(this);
+		resources[id] = nullptr;
+		return true;
+	}
+
+	inline void World::unlistEntity(Entity* ent)
+	{
+		Entity* last = entities.back();
+		entities[ent->listIndex] = last;
+		last->listIndex = ent->listIndex;
+		entities.pop_back();
+	}
+
+	inline void World::freeEntity(Entity* ent)
+	{
+		uint32_t index = ent->index;
+
+		std::allocator_traits<EntityAllocator>::destroy(entAlloc, ent);
+		std::allocator_traits<EntityAllocator>::deallocate(entAlloc, ent, 1);
+
+		// Bumping the generation invalidates all outstanding handles to the entity.
+		slots[index].entity = nullptr;
+		++slots[index].generation;
+		freeIndices.push_back(index);
+#ifdef ECS_PROFILING
+		++profiler.destroyedThisTick;
+#endif
+	}
+
+	inline void World::destroy(Entity* ent, bool immediate)
+	{
+		if (ent == nullptr)
+			return;
+
+		if (isStructureLocked())
+		{
+			getCommandBuffer()->destroy(ent->getHandle());
+			return;
+		}
+
+		if (ent->isPendingDestroy())
+		{
+			// The entity stays in the pending destroy queue, but its handle won't resolve anymore so cleanup() skips it.
+			if (immediate)
+			{
+				unlistEntity(ent);
+				freeEntity(ent);
+			}
+
+			return;
+		}
+
+		ent->bPendingDestroy = true;
+
+		emit<Events::OnEntityDestroyed>({ ent });
+
+		if (immediate)
+		{
+			unlistEntity(ent);
+			freeEntity(ent);
+		}
+		else
+		{
+			pendingDestroy.push_back(ent->getHandle());
+		}
+	}
+
+	inline bool World::cleanup()
+	{
+		assert(!isStructureLocked() && "The world can't be cleaned up while it is locked by a parallel loop");
+
+		if (pendingDestroy.empty() || isStructureLocked())
+			return false;
+
+		// Freeing an entity emits OnComponentRemoved, whose subscribers may destroy more entities, so don't hold on to an iterator.
+		size_t count = 0;
+		for (size_t i = 0; i < pendingDestroy.size(); ++i)
+		{
+			Entity* ent = resolve(pendingDestroy[i]);
+			if (ent != nullptr)
+			{
+				unlistEntity(ent);
+				freeEntity(ent);
+				++count;
+			}
+		}
+
+		pendingDestroy.clear();
+
+		return count > 0;
+	}
+
+	inline void World::reset()
+	{
+		assert(!isStructureLocked() && "The world can't be reset while it is locked by a parallel loop");
+		if (isStructureLocked())
+			return;
+
+		for (auto* ent : entities)
+		{
+			if (!ent->isPendingDestroy())
+			{
+				ent->bPendingDestroy = true;
+				emit<Events::OnEntityDestroyed>({ ent });
+			}
+			freeEntity(ent);
+		}
+
+		entities.clear();
+		pendingDestroy.clear();
+
+		// freeEntity() bumped the generation of every slot, so keep them and only reorder the free list.
+		freeIndices.clear();
+		for (size_t index = slots.size() - 1; index > 0; --index)
+		{
+			freeIndices.push_back(static_cast<uint32_t>(index));
+		}
+	}
+
+	inline void World::all(std::function<void(Entity*)> viewFunc, bool bIncludePendingDestroy)
+	{
+		for (auto* ent : all(bIncludePendingDestroy))
+		{
+			viewFunc(ent);
+		}
+	}
+
+	template<typename Func>
+	typename Internal::EnableForCallable<Func, Internal::IsCallable<Func, Entity*>::value ? Internal::CallStyle::Handles : Internal::CallStyle::None>::type
+		World::all(Func&& func, bool bIncludePendingDestroy)
+	{
+		for (auto* ent : all(bIncludePendingDestroy))
+		{
+			func(ent);
+		}
+	}
+
+	inline Internal::EntityView World::all(bool bIncludePendingDestroy)
+	{
+		Internal::EntityIterator first(this, 0, false, bIncludePendingDestroy);
+		Internal::EntityIterator last(this, getCount(), true, bIncludePendingDestroy);
+		return Internal::EntityView(first, last);
+	}
+
+	inline EntityHandle::EntityHandle(const Entity* ent)
+		: index(InvalidIndex), generation(0)
+	{
+		if (ent != nullptr)
+			*this = ent->getHandle();
+	}
+
+	template<typename... Types>
+	void World::each(typename Internal::QueryTerms<Types...>::HandleFunction viewFunc, bool bIncludePendingDestroy)
+	{
+		eachWith<Internal::Caller<Internal::CallStyle::Handles>>(viewFunc, typename Internal::QueryTerms<Types...>::Arguments(),
+			Internal::getQueryMatcher<Types...>(), getChangeSince(), bIncludePendingDestroy);
+	}
+
+	template<typename... Types, typename Func>
+	typename Internal::EnableForCallable<Func, Internal::EachCallStyle<Func, Types...>::value>::type World::each(Func&& func, bool bIncludePendingDestroy)
+	{
+		eachWith<Internal::Caller<Internal::EachCallStyle<Func, Types...>::value>>(func, typename Internal::QueryTerms<Types...>::Arguments(),
+			Internal::getQueryMatcher<Types...>(), getChangeSince(), bIncludePendingDestroy);
+	}
+
+	template<typename Caller, typename Func, typename... Types>
+	void World::eachWith(Func& func, Internal::TypeList<Types...>, const Internal::QueryMatcher& matcher, uint32_t since, bool bIncludePendingDestroy)
+	{
+		typedef typename Internal::MakeIndexSequence<sizeof...(Types)>::Type Indices;
+#ifdef ECS_PROFILING
+		Internal::CountCalls<Func> target = { func, 0 };
+#else
+		Func& target = func;
+#endif
+#ifdef ECS_ARCHETYPE_STORAGE
+		// Archetypes may be created while iterating, so don't hold on to an iterator.
+		for (size_t i = 0; i < archetypes.size(); ++i)
+		{
+			Internal::Archetype* archetype = archetypes[i];
+			if (archetype->getCount() > 0 && matcher.matches(archetype->getMask()))
+			{
+				eachInArchetype<Caller, Types...>(archetype, 0, SIZE_MAX, Indices(), target, since, false, bIncludePendingDestroy);
+			}
+		}
+#else
+		// Iterate the smallest pool, and look up the rest of the components from the other pools.
+		Internal::BaseComponentPool* pool = getSmallestPool<Types...>();
+		if (pool != nullptr)
+		{
+			eachInPools<Caller, Types...>(pool, 0, SIZE_MAX, Indices(), matcher, target, since, false, bIncludePendingDestroy);
+		}
+#endif
+
+#ifdef ECS_PROFILING
+		getEntityCounter() += target.count;
+#endif
+	}
+
+	template<typename... Types, typename Func>
+	void World::eachChunk(Func&& func, bool bIncludePendingDestroy)
+	{
+#ifdef ECS_PROFILING
+		Internal::CountChunkEntities<typename std::remove_reference<Func>::type> target = { func, 0 };
+#else
+		auto& target = func;
+#endif
+
+		++structureLocks;
+		eachChunkWith(target, typename Internal::QueryTerms<Types...>::Arguments(), Internal::getQueryMatcher<Types...>(), nullptr, bIncludePendingDestroy);
+		--structureLocks;
+
+#ifdef ECS_PROFILING
+		getEntityCounter() += target.count;
+#endif
+	}
+
+	template<typename... Types, typename Func>
+	void World::eachSoA(Func&& func, bool bIncludePendingDestroy)
+	{
+		static_assert(Internal::AllSoATerms<typename Internal::QueryTerms<Types...>::Arguments>::value, "eachSoA() only works with components stored as structures of arrays");
+
+		Internal::WithoutEntities<typename std::remove_reference<Func>::type> withoutEntities = { func };
+		eachChunk<Types...>(withoutEntities, bIncludePendingDestroy);
+	}
+
+	template<typename... Types, typename Func>
+	void World::parallelEachChunk(Func&& func, size_t grainSize, bool bIncludePendingDestroy)
+	{
+		typedef typename Internal::QueryTerms<Types...>::Arguments Arguments;
+		const Internal::QueryMatcher& matcher = Internal::getQueryMatcher<Types...>();
+
+#ifdef ECS_PROFILING
+		std::atomic<uint64_t>& counter = getEntityCounter();
+#endif
+		markBlocksChanged(Arguments(), matcher);
+		runParallel(Arguments(), matcher, grainSize, [&](const Internal::ParallelRange& range) {
+#ifdef ECS_PROFILING
+			Internal::CountChunkEntities<typename std::remove_reference<Func>::type> target = { func, 0 };
+			eachChunkWith(target, Arguments(), matcher, &range, bIncludePendingDestroy);
+			counter += target.count;
+#else
+			eachChunkWith(func, Arguments(), matcher, &range, bIncludePendingDestroy);
+#endif
+		});
+	}
+
+	template<typename Func, typename... Types>
+	void World::eachChunkWith(Func& func, Internal::TypeList<Types...>, const Internal::QueryMatcher& matcher, const Internal::ParallelRange* range,
+		bool bIncludePendingDestroy)
+	{
+		static_assert(Internal::AllTrue<std::is_same<typename Internal::Term<Types>::Argument, Types>::value...>::value,
+			"eachChunk() doesn't support Changed, Added or Optional");
+
+		typedef typename Internal::MakeIndexSequence<sizeof...(Types)>::Type Indices;
+#ifdef ECS_ARCHETYPE_STORAGE
+		if (range != nullptr)
+		{
+			eachChunkInArchetype<Types...>(range->archetype, range->begin, range->end, Indices(), func, true, bIncludePendingDestroy);
+			return;
+		}
+
+		for (size_t i = 0; i < archetypes.size(); ++i)
+		{
+			Internal::Archetype* archetype = archetypes[i];
+			if (archetype->getCount() > 0 && matcher.matches(archetype->getMask()))
+			{
+				eachChunkInArchetype<Types...>(archetype, 0, archetype->getCount(), Indices(), func, false, bIncludePendingDestroy);
+			}
+		}
+#else
+		if (range != nullptr)
+		{
+			eachChunkInPools<Types...>(range->pool, range->begin, range->end, Indices(), matcher, func, true, bIncludePendingDestroy);
+			return;
+		}
+
+		Internal::BaseComponentPool* pool = getSmallestPool<Types...>();
+		if (pool != nullptr)
+		{
+			eachChunkInPools<Types...>(pool, 0, pool->getCount(), Indices(), matcher, func, false, bIncludePendingDestroy);
+		}
+#endif
+	}
+
+	template<typename... Types>
+	void World::parallelEach(typename Internal::QueryTerms<Types...>::HandleFunction viewFunc, size_t grainSize, bool bIncludePendingDestroy)
+	{
+		parallelEachWith<Internal::Caller<Internal::CallStyle::Handles>, const typename Internal::QueryTerms<Types...>::HandleFunction, Types...>(
+			viewFunc, grainSize, bIncludePendingDestroy);
+	}
+
+	template<typename... Types, typename Func>
+	typename Internal::EnableForCallable<Func, Internal::EachCallStyle<Func, Types...>::value>::type World::parallelEach(Func&& func,
+		size_t grainSize, bool bIncludePendingDestroy)
+	{
+		parallelEachWith<Internal::Caller<Internal::EachCallStyle<Func, Types...>::value>, typename std::remove_reference<Func>::type, Types...>(
+			func, grainSize, bIncludePendingDestroy);
+	}
+
+	template<typename Caller, typename Func, typename... Types>
+	void World::parallelEachWith(Func& func, size_t grainSize, bool bIncludePendingDestroy)
+	{
+		typedef typename Internal::QueryTerms<Types...>::Arguments Arguments;
+		const Internal::QueryMatcher& matcher = Internal::getQueryMatcher<Types...>();
+
+		// Worker threads don't know which system they are running for, so read the tick to compare against up front.
+		const uint32_t since = getChangeSince();
+#ifdef ECS_PROFILING
+		std::atomic<uint64_t>& counter = getEntityCounter();
+#endif
+		markBlocksChanged(Arguments(), matcher);
+		runParallel(Arguments(), matcher, grainSize, [&](const Internal::ParallelRange& range) {
+#ifdef ECS_PROFILING
+			Internal::CountCalls<Func> counted = { func, 0 };
+			eachInRange<Caller>(range, counted, Arguments(), matcher, since, bIncludePendingDestroy);
+			counter += counted.count;
+#else
+			eachInRange<Caller>(range, func, Arguments(), matcher, since, bIncludePendingDestroy);
+#endif
+		});
+	}
+
+	template<typename... Types>
+	void World::parallelEachRange(std::function<void(Span<Entity* const>)> rangeFunc, size_t grainSize, bool bIncludePendingDestroy)
+	{
+		parallelEachRangeWith<std::function<void(Span<Entity* const>)>, Types...>(rangeFunc, grainSize, bIncludePendingDestroy);
+	}
+
+	template<typename... Types, typename Func>
+	typename Internal::EnableForCallable<Func, Internal::IsCallable<Func, Span<Entity* const>>::value ? Internal::CallStyle::Handles : Internal::CallStyle::None>::type
+		World::parallelEachRange(Func&& rangeFunc, size_t grainSize, bool bIncludePendingDestroy)
+	{
+		parallelEachRangeWith<typename std::remove_reference<Func>::type, Types...>(rangeFunc, grainSize, bIncludePendingDestroy);
+	}
+
+	template<typename Func, typename... Types>
+	void World::parallelEachRangeWith(Func& rangeFunc, size_t grainSize, bool bIncludePendingDestroy)
+	{
+		typedef typename Internal::QueryTerms<Types...>::Arguments Arguments;
+		const Internal::QueryMatcher& matcher = Internal::getQueryMatcher<Types...>();
+
+		const uint32_t since = getChangeSince();
+#ifdef ECS_PROFILING
+		std::atomic<uint64_t>& counter = getEntityCounter();
+#endif
+		markBlocksChanged(Arguments(), matcher);
+		runParallel(Arguments(), matcher, grainSize, [&](const Internal::ParallelRange& range) {
+			// Every thread keeps its buffer between ranges and calls. It is taken out while in use, so a nested call on the same
+			// thread gets a buffer of its own rather than overwriting this one.
+			static thread_local std::vector<Entity*> spare;
+			std::vector<Entity*> matched;
+			matched.swap(spare);
+			matched.clear();
+			matched.reserve(range.end - range.begin);
+
+			Internal::CollectEntities collect = { matched };
+			eachInRange<Internal::Caller<Internal::CallStyle::Handles>>(range, collect, Arguments(), matcher, since, bIncludePendingDestroy);
+#ifdef ECS_PROFILING
+			counter += matched.size();
+#endif
+
+			if (!matched.empty())
+			{
+				rangeFunc(Span<Entity* const>(matched.data(), matched.size()));
+			}
+
+			matched.swap(spare);
+		});
+	}
+
+	template<typename... Types>
+	void World::markBlocksChanged(Internal::TypeList<Types...>, const Internal::QueryMatcher& matcher)
+	{
+		const bool writes[] = { !std::is_const<typename Internal::Term<Types>::Argument>::value... };
+#ifdef ECS_ARCHETYPE_STORAGE
+		const uint32_t ids[] = { Internal::getComponentId<typename Internal::Term<Types>::Component>()... };
+		for (auto* archetype : archetypes)
+		{
+			if (archetype->getCount() == 0 || !matcher.matches(archetype->getMask()))
+				continue;
+
+			for (size_t i = 0; i < sizeof...(Types); ++i)
+			{
+				// Optional components may be missing from the archetype.
+				const int column = writes[i] ? archetype->findColumn(ids[i]) : -1;
+				if (column >= 0)
+					archetype->markAllChunksChanged(column, changeTick);
+			}
+		}
+#else
+		Internal::BaseComponentPool* const writtenPools[] = { getPool<typename Internal::Term<Types>::Component>()... };
+		for (size_t i = 0; i < sizeof...(Types); ++i)
+		{
+			if (writes[i] && writtenPools[i] != nullptr)
+				writtenPools[i]->markAllBlocksChanged(changeTick);
+		}
+#endif
+	}
+
+	template<typename... Types>
+	void World::runParallel(Internal::TypeList<Types...>, const Internal::QueryMatcher& matcher, size_t grainSize,
+		const std::function<void(const Internal::ParallelRange&)>& rangeFunc)
+	{
+		if (grainSize == 0)
+			grainSize = this->grainSize;
+
+		std::vector<Internal::ParallelRange> ranges;
+#ifdef ECS_ARCHETYPE_STORAGE
+		for (auto* archetype : archetypes)
+		{
+			if (archetype->getCount() == 0 || !matcher.matches(archetype->getMask()))
+				continue;
+
+			// Don't split chunks between threads unless the batches are smaller than a chunk.
+			size_t step = grainSize;
+			if (step > archetype->getChunkCapacity())
+				step -= step % archetype->getChunkCapacity();
+
+			for (size_t begin = 0; begin < archetype->getCount(); begin += step)
+			{
+				ranges.push_back({ archetype, begin, std::min(begin + step, archetype->getCount()) });
+			}
+		}
+#else
+		Internal::BaseComponentPool* pool = getSmallestPool<Types...>();
+		if (pool != nullptr)
+		{
+			for (size_t begin = 0; begin < pool->getCount(); begin += grainSize)
+			{
+				ranges.push_back({ pool, begin, std::min(begin + grainSize, pool->getCount()) });
+			}
+		}
+#endif
+
+		if (ranges.empty())
+			return;
+
+		++structureLocks;
+		if (ranges.size() == 1)
+		{
+			rangeFunc(ranges[0]);
+		}
+		else
+		{
+			getThreadPool()->parallelFor(ranges.size(), [&](size_t idx) {
+				rangeFunc(ranges[idx]);
+			});
+		}
+		--structureLocks;
+	}
+
+	template<typename Caller, typename Func, typename... Types>
+	void World::eachInRange(const Internal::ParallelRange& range, Func& func, Internal::TypeList<Types...>, const Internal::QueryMatcher& matcher,
+		uint32_t since, bool bIncludePendingDestroy)
+	{
+#ifdef ECS_ARCHETYPE_STORAGE
+		(void)matcher;
+		eachInArchetype<Caller, Types...>(range.archetype, range.begin, range.end,
+			typename Internal::MakeIndexSequence<sizeof...(Types)>::Type(), func, since, true, bIncludePendingDestroy);
+#else
+		eachInPools<Caller, Types...>(range.pool, range.begin, range.end,
+			typename Internal::MakeIndexSequence<sizeof...(Types)>::Type(), matcher, func, since, true, bIncludePendingDestroy);
+#endif
+	}
+
+	inline ThreadPool* World::getThreadPool()
+	{
+		if (threadPool == nullptr)
+		{
+			using ThreadPoolAllocator = std::allocator_traits<EntityAllocator>::template rebind_alloc<ThreadPool>;
+
+			ThreadPoolAllocator alloc(entAlloc);
+			threadPool = std::allocator_traits<ThreadPoolAllocator>::allocate(alloc, 1);
+			std::allocator_traits<ThreadPoolAllocator>::construct(alloc, threadPool, workerCount);
+		}
+
+		return threadPool;
+	}
+
+	inline void World::setWorkerCount(size_t count)
+	{
+		assert(!isStructureLocked() && "Can't change the worker count from inside of a parallel loop");
+
+		workerCount = count;
+		if (threadPool != nullptr)
+		{
+			using ThreadPoolAllocator = std::allocator_traits<EntityAllocator>::template rebind_alloc<ThreadPool>;
+
+			ThreadPoolAllocator alloc(entAlloc);
+			std::allocator_traits<ThreadPoolAllocator>::destroy(alloc, threadPool);
+			std::allocator_traits<ThreadPoolAllocator>::deallocate(alloc, threadPool, 1);
+			threadPool = nullptr;
+		}
+	}
+
+#ifdef ECS_ARCHETYPE_STORAGE
+	template<typename Caller, typename... Types, typename Func, size_t... Indices>
+	void World::eachInArchetype(Internal::Archetype* archetype, size_t begin, size_t end, Internal::IndexSequence<Indices...>,
+		Func& func, uint32_t since, bool bParallel, bool bIncludePendingDestroy)
+	{
+		static_assert(!Internal::AnySoA<typename Internal::Term<Types>::Component...>::value, "Components stored as structures of arrays can only be iterated over with eachSoA()");
+
+		typedef Internal::TermFilter TermFilter;
+
+		// Optional components the archetype doesn't have are at column -1.
+		const int columns[] = { archetype->findColumn(Internal::getComponentId<typename Internal::Term<Types>::Component>())... };
+		const uint32_t* const versions[] = { (static_cast<void>(Indices), archetype->getVersion())... };
+		const size_t capacity = archetype->getChunkCapacity();
+
+		// Components passed to the callback are stamped with the current change tick, unless they are const.
+		const TermFilter filters[] = { Internal::Term<Types>::filter... };
+		const bool writes[] = { !std::is_const<typename Internal::Term<Types>::Argument>::value... };
+		const uint32_t tick = changeTick;
+
+		bool bFiltered = false;
+		for (size_t i = 0; i < sizeof...(Types); ++i)
+		{
+			if (filters[i] != TermFilter::None)
+				bFiltered = true;
+		}
+
+		// Walk a chunk at a time, so that the loop only has to offset a pointer per component. If the callback moves
+		// components around in this archetype, start over from the chunk of the row we're at.
+		size_t row = begin;
+		while (row < end && row < archetype->getCount())
+		{
+			const size_t chunk = row / capacity;
+			const size_t chunkStart = chunk * capacity;
+			const size_t chunkEnd = std::min(std::min(chunkStart + capacity, archetype->getCount()), end);
+			const uint32_t version = *archetype->getVersion();
+
+			// Chunks without any rows that pass the filters are skipped without looking at the rows.
+			bool bChunkPasses = true;
+			for (size_t i = 0; i < sizeof...(Types); ++i)
+			{
+				if (filters[i] != TermFilter::None && !archetype->chunkPasses(filters[i], columns[i], chunk, since))
+					bChunkPasses = false;
+			}
+
+			if (!bChunkPasses)
+			{
+				row = chunkEnd;
+				continue;
+			}
+
+			for (size_t i = 0; i < sizeof...(Types); ++i)
+			{
+				if (writes[i] && columns[i] >= 0 && !bParallel)
+					archetype->markChunkChanged(columns[i], chunk, tick);
+			}
+
+			Entity** entities = archetype->getChunkEntities(chunk);
+			std::tuple<typename Internal::Term<Types>::Pointer...> components(getTermComponents<Types>(archetype, columns[Indices], chunk)...);
+			uint32_t* const changedTicks[] = { (columns[Indices] >= 0 ? archetype->getChunkChangedTicks(columns[Indices], chunk) : nullptr)... };
+			const uint32_t* const filterTicks[] = { (filters[Indices] == TermFilter::Added ? archetype->getChunkAddedTicks(columns[Indices], chunk)
+				: changedTicks[Indices])... };
+
+			// Without filters, every row left in the chunk is visited (give or take entities pending destruction), so stamp them
+			// all at once. This keeps the stamping out of the loop, which the compiler can then vectorize.
+			if (!bFiltered)
+			{
+				for (size_t i = 0; i < sizeof...(Types); ++i)
+				{
+					if (writes[i] && changedTicks[i] != nullptr)
+						std::fill(changedTicks[i] + (row - chunkStart), changedTicks[i] + (chunkEnd - chunkStart), tick);
+				}
+			}
+
+			for (; row < chunkEnd; ++row)
+			{
+				Entity* ent = entities[row - chunkStart];
+				if (ent->isPendingDestroy() && !bIncludePendingDestroy)
+					continue;
+
+				if (bFiltered)
+				{
+					bool bPasses = true;
+					for (size_t i = 0; i < sizeof...(Types); ++i)
+					{
+						if (filters[i] != TermFilter::None && !Internal::isTickNewer(filterTicks[i][row - chunkStart], since))
+							bPasses = false;
+					}
+
+					if (!bPasses)
+						continue;
+
+					// Stamp the components before calling back, as the callback may move them.
+					for (size_t i = 0; i < sizeof...(Types); ++i)
+					{
+						if (writes[i] && changedTicks[i] != nullptr)
+							changedTicks[i][row - chunkStart] = tick;
+					}
+				}
+
+				Caller::call(func, Internal::IndexSequence<Indices...>(), versions, ent, (std::get<Indices>(components) + (row - chunkStart))...);
+
+				if (*archetype->getVersion() != version)
+				{
+					// If the entity left the archetype, another entity was moved into its place.
+					if (row >= archetype->getCount() || archetype->getEntity(row) == ent)
+						++row;
+
+					break;
+				}
+			}
+		}
+	}
+
+	template<typename... Types, typename Func, size_t... Indices>
+	void World::eachChunkInArchetype(Internal::Archetype* archetype, size_t begin, size_t end, Internal::IndexSequence<Indices...>,
+		Func& func, bool bParallel, bool bIncludePendingDestroy)
+	{
+		const size_t columns[] = { static_cast<size_t>(archetype->findColumn(Internal::getComponentId<typename std::remove_const<Types>::type>()))... };
+		const bool writes[] = { !std::is_const<Types>::value... };
+		const uint32_t tick = changeTick;
+		const size_t capacity = archetype->getChunkCapacity();
+
+		for (size_t row = begin; row < end;)
+		{
+			const size_t chunk = row / capacity;
+			const size_t chunkStart = chunk * capacity;
+			const size_t chunkEnd = std::min(chunkStart + capacity, end);
+
+			for (size_t i = 0; i < sizeof...(Types); ++i)
+			{
+				if (!writes[i])
+					continue;
+
+				if (!bParallel)
+					archetype->markChunkChanged(columns[i], chunk, tick);
+
+				uint32_t* changedTicks = archetype->getChunkChangedTicks(columns[i], chunk);
+				std::fill(changedTicks + (row - chunkStart), changedTicks + (chunkEnd - chunkStart), tick);
+			}
+
+			// Split the chunk around entities pending destruction.
+			Entity** entities = archetype->getChunkEntities(chunk);
+			while (row < chunkEnd)
+			{
+				size_t last = row;
+				while (last < chunkEnd && (bIncludePendingDestroy || !entities[last - chunkStart]->isPendingDestroy()))
+					++last;
+
+				if (last > row)
+				{
+					func(last - row, entities + (row - chunkStart),
+						getChunkArray<Types>(archetype, columns[Indices], row, Internal::IsSoA<typename std::remove_const<Types>::type>())...);
+				}
+
+				row = last + 1;
+			}
+
+			row = chunkEnd;
+		}
+	}
+
+	inline Internal::Archetype* World::getArchetype(const std::vector<const Internal::ComponentInfo*>& components)
+	{
+		std::vector<uint32_t> key;
+		key.reserve(components.size());
+		for (auto* info : components)
+		{
+			key.push_back(info->id);
+		}
+
+		auto found = archetypeLookup.find(key);
+		if (found != archetypeLookup.end())
+			return found->second;
+
+		ArchetypeAllocator alloc(entAlloc);
+		Internal::Archetype* archetype = std::allocator_traits<ArchetypeAllocator>::allocate(alloc, 1);
+		std::allocator_traits<ArchetypeAllocator>::construct(alloc, archetype, components);
+
+		archetypes.push_back(archetype);
+		archetypeLookup.insert({ key, archetype });
+
+		for (auto* query : queries)
+		{
+			query->onArchetypeCreated(archetype);
+		}
+
+		return archetype;
+	}
+
+	inline Internal::Archetype* World::getArchetypeWith(Internal::Archetype* source, const Internal::ComponentInfo* info)
+	{
+		if (info->id < source->addEdges.size() && source->addEdges[info->id] != nullptr)
+			return source->addEdges[info->id];
+
+		std::vector<const Internal::ComponentInfo*> components;
+		components.reserve(source->getColumnCount() + 1);
+		for (size_t i = 0; i < source->getColumnCount(); ++i)
+		{
+			components.push_back(source->getInfo(i));
+		}
+
+		components.insert(std::upper_bound(components.begin(), components.end(), info, [](const Internal::ComponentInfo* a, const Internal::ComponentInfo* b) {
+			return a->id < b->id;
+		}), info);
+
+		Internal::Archetype* target = getArchetype(components);
+		setArchetypeEdge(source->addEdges, info->id, target);
+		setArchetypeEdge(target->removeEdges, info->id, source);
+
+		return target;
+	}
+
+	inline Internal::Archetype* World::getArchetypeWithout(Internal::Archetype* source, uint32_t componentId)
+	{
+		if (componentId < source->removeEdges.size() && source->removeEdges[componentId] != nullptr)
+			return source->removeEdges[componentId];
+
+		std::vector<const Internal::ComponentInfo*> components;
+		components.reserve(source->getColumnCount());
+		for (size_t i = 0; i < source->getColumnCount(); ++i)
+		{
+			if (source->getInfo(i)->id != componentId)
+				components.push_back(source->getInfo(i));
+		}
+
+		Internal::Archetype* target = getArchetype(components);
+		setArchetypeEdge(source->removeEdges, componentId, target);
+		setArchetypeEdge(target->addEdges, componentId, source);
+
+		return target;
+	}
+
+	inline void World::moveEntity(Entity* ent, Internal::Archetype* target)
+	{
+		Internal::Archetype* source = ent->archetype;
+		if (source == target)
+			return;
+
+		size_t sourceRow = ent->archetypeRow;
+		size_t targetRow = target->pushRow(ent, entAlloc);
+
+		for (size_t column = 0; column < source->getColumnCount(); ++column)
+		{
+			int targetColumn = target->findColumn(source->getInfo(column)->id);
+			if (targetColumn >= 0)
+			{
+				target->moveComponent(targetColumn, targetRow, *source, column, sourceRow);
+				target->setTicks(targetColumn, targetRow, source->getAddedTick(column, sourceRow), source->getChangedTick(column, sourceRow));
+			}
+			else
+			{
+				source->destroyComponent(column, sourceRow);
+			}
+		}
+
+		source->removeRow(sourceRow, entAlloc);
+
+		ent->archetype = target;
+		ent->archetypeRow = targetRow;
+	}
+
+	inline Entity::~Entity()
+	{
+		removeAll();
+		archetype->removeRow(archetypeRow, world->getPrimaryAllocator());
+	}
+
+	template<typename T>
+	bool Entity::has() const
+	{
+		return archetype->getMask().test(Internal::getComponentId<T>());
+	}
+
+	template<typename T>
+	bool Entity::remove()
+	{
+		if (world->isStructureLocked())
+		{
+			world->getCommandBuffer()->remove<T>(getHandle());
+			return has<T>();
+		}
+
+		int column = archetype->findColumn(Internal::getComponentId<T>());
+		if (column < 0)
+			return false;
+
+		archetype->getInfo(column)->removed(this, archetype->getComponent(column, archetypeRow));
+
+		// A subscriber may have already removed the component.
+		if (has<T>())
+		{
+			world->moveEntity(this, world->getArchetypeWithout(archetype, Internal::getComponentId<T>()));
+		}
+
+		return true;
+	}
+
+	inline void Entity::removeAll()
+	{
+		assert(!world->isStructureLocked() && "Components can't be removed all at once while the world is locked by a parallel loop");
+		if (world->isStructureLocked())
+			return;
+
+		for (size_t column = 0; column < archetype->getColumnCount(); ++column)
+		{
+			archetype->getInfo(column)->removed(this, archetype->getComponent(column, archetypeRow));
+		}
+
+		world->moveEntity(this, world->rootArchetype);
+	}
+
+	template<typename T, typename... Args>
+	ComponentHandle<T> Entity::assignComponent(std::false_type, Args&&... args)
+	{
+		assert(!world->isStructureLocked() && "Components can't be assigned or removed while the world is locked by a parallel loop");
+
+		int column = archetype->findColumn(Internal::getComponentId<T>());
+		if (column >= 0)
+		{
+			T* component = static_cast<T*>(archetype->getComponent(column, archetypeRow));
+			*component = T(std::forward<Args>(args)...);
+			archetype->markChanged(column, archetypeRow, world->getChangeTick());
+
+			auto handle = ComponentHandle<T>(component, this, archetype->getVersion());
+			world->emit<Events::OnComponentAssigned<T>>({ this, handle });
+			return handle;
+		}
+		else
+		{
+			world->moveEntity(this, world->getArchetypeWith(archetype, Internal::getComponentInfo<T>()));
+
+			column = archetype->findColumn(Internal::getComponentId<T>());
+			T* component = new (archetype->getComponent(column, archetypeRow)) T(std::forward<Args>(args)...);
+			archetype->setTicks(column, archetypeRow, world->getChangeTick(), world->getChangeTick());
+
+			auto handle = ComponentHandle<T>(component, this, archetype->getVersion());
+			world->emit<Events::OnComponentAssigned<T>>({ this, handle });
+			return handle;
+		}
+	}
+
+	template<typename T, typename... Args>
+	SoAHandle<T> Entity::assignComponent(std::true_type, Args&&... args)
+	{
+		assert(!world->isStructureLocked() && "Components can't be assigned or removed while the world is locked by a parallel loop");
+
+		int column = archetype->findColumn(Internal::getComponentId<T>());
+		if (column >= 0)
+		{
+			void* fields[T::SoAFields::FieldCount];
+			archetype->getFields(column, archetypeRow, fields);
+			T::SoAFields::store(T(std::forward<Args>(args)...), fields);
+			archetype->markChanged(column, archetypeRow, world->getChangeTick());
+		}
+		else
+		{
+			world->moveEntity(this, world->getArchetypeWith(archetype, Internal::getComponentInfo<T>()));
+
+			column = archetype->findColumn(Internal::getComponentId<T>());
+			archetype->construct<T>(column, archetypeRow, std::forward<Args>(args)...);
+			archetype->setTicks(column, archetypeRow, world->getChangeTick(), world->getChangeTick());
+		}
+
+		world->emitAssigned<T>(this);
+		return SoAHandle<T>(this);
+	}
+
+	template<typename... Types>
+	Span<Entity* const> World::createMany(size_t count, const Types&... prototypes)
+	{
+		static_assert(Internal::AreDistinct<Types...>::value, "A component type can only be given once to createMany().");
+		assert(!isStructureLocked() && "Entities can't be created while the world is locked by a parallel loop, use a command buffer");
+		if (isStructureLocked())
+			return Span<Entity* const>();
+
+		// The first element only keeps the array from being empty.
+		const Internal::ComponentInfo* infos[] = { nullptr, Internal::getComponentInfo<Types>()... };
+
+		Internal::Archetype* archetype = rootArchetype;
+		for (size_t i = 1; i < sizeof(infos) / sizeof(infos[0]); ++i)
+		{
+			archetype = getArchetypeWith(archetype, infos[i]);
+		}
+
+		const size_t columns[] = { 0, static_cast<size_t>(archetype->findColumn(Internal::getComponentId<Types>()))... };
+
+		size_t first = entities.size();
+		if (first + count > entities.capacity())
+			entities.reserve(std::max(first + count, entities.capacity() * 2));
+		for (size_t i = 0; i < count; ++i)
+		{
+			Entity* ent = allocateEntity();
+			size_t row = archetype->pushRow(ent, entAlloc);
+			ent->archetype = archetype;
+			ent->archetypeRow = row;
+
+			// Braced lists are evaluated in order, so column walks columns[] in step with Types.
+			size_t column = 1;
+			int expand[] = { 0, (archetype->construct<Types>(columns[column++], row, prototypes), 0)... };
+			(void)expand;
+			(void)column;
+
+			for (size_t k = 1; k < sizeof(columns) / sizeof(columns[0]); ++k)
+			{
+				archetype->setTicks(columns[k], row, changeTick, changeTick);
+			}
+		}
+
+		emitCreatedMany<Types...>(first, count);
+
+		return Span<Entity* const>(entities.data() + first, count);
+	}
+
+	template<typename T>
+	ComponentHandle<T> Entity::getComponent(std::false_type)
+	{
+		int column = archetype->findColumn(Internal::getComponentId<T>());
+		if (column >= 0)
+		{
+			return ComponentHandle<T>(static_cast<T*>(archetype->getComponent(column, archetypeRow)), this, archetype->getVersion());
+		}
+
+		return ComponentHandle<T>();
+	}
+
+	template<typename T>
+	bool Entity::getFields(void** fields)
+	{
+		int column = archetype->findColumn(Internal::getComponentId<T>());
+		if (column < 0)
+			return false;
+
+		archetype->getFields(column, archetypeRow, fields);
+		return true;
+	}
+
+	template<typename T>
+	bool Entity::markChanged()
+	{
+		int column = archetype->findColumn(Internal::getComponentId<T>());
+		if (column < 0)
+			return false;
+
+		archetype->markChanged(column, archetypeRow, world->getChangeTick());
+		return true;
+	}
+#else
+	template<typename Caller, typename... Types, typename Func, size_t... Indices>
+	void World::eachInPools(Internal::BaseComponentPool* pool, size_t begin, size_t end, Internal::IndexSequence<Indices...>,
+		const Internal::QueryMatcher& matcher, Func& func, uint32_t since, bool bParallel, bool bIncludePendingDestroy)
+	{
+		static_assert(!Internal::AnySoA<typename Internal::Term<Types>::Component...>::value, "Components stored as structures of arrays can only be iterated over with eachSoA()");
+
+		typedef Internal::TermFilter TermFilter;
+
+		std::tuple<Internal::ComponentPool<typename Internal::Term<Types>::Component>*...> typedPools(
+			getPool<typename Internal::Term<Types>::Component>()...);
+		Internal::BaseComponentPool* const basePools[] = { std::get<Indices>(typedPools)... };
+
+		// Optional components may not have a pool at all.
+		const uint32_t* const versions[] = { (basePools[Indices] != nullptr ? basePools[Indices]->getVersion() : nullptr)... };
+
+		// Components passed to the callback are stamped with the current change tick, unless they are const.
+		const TermFilter filters[] = { Internal::Term<Types>::filter... };
+		const bool writes[] = { !std::is_const<typename Internal::Term<Types>::Argument>::value... };
+		const uint32_t tick = changeTick;
+
+		const size_t blockSize = Internal::BaseComponentPool::TickBlockSize;
+		bool bFiltersPool = false;
+		for (size_t k = 0; k < sizeof...(Types); ++k)
+		{
+			if (filters[k] != TermFilter::None && basePools[k] == pool)
+				bFiltersPool = true;
+		}
+
+		for (size_t i = begin; i < end && i < pool->getCount();)
+		{
+			// Skip blocks of the pool being iterated that don't have any changes at all.
+			if (bFiltersPool && (i == begin || i % blockSize == 0))
+			{
+				bool bBlockPasses = true;
+				for (size_t k = 0; k < sizeof...(Types); ++k)
+				{
+					if (filters[k] != TermFilter::None && basePools[k] == pool && !pool->blockPasses(filters[k], i / blockSize, since))
+						bBlockPasses = false;
+				}
+
+				if (!bBlockPasses)
+				{
+					i = (i / blockSize + 1) * blockSize;
+					continue;
+				}
+			}
+
+			Entity* ent = pool->getEntity(i);
+			if ((!ent->isPendingDestroy() || bIncludePendingDestroy) && matcher.matches(ent->signature))
 			{
-				kv.second.erase(std::remove(kv.second.begin(), kv.second.end(), subscriber), kv.second.end());
-				if (kv.second.size() == 0)
+				const uint32_t denseIndices[] = { (basePools[Indices] != nullptr ? basePools[Indices]->find(ent->index, pool, i)
+					: static_cast<uint32_t>(Internal::BaseComponentPool::InvalidIndex))... };
+
+				bool bPasses = true;
+				for (size_t k = 0; k < sizeof...(Types); ++k)
+				{
+					if (filters[k] != TermFilter::None && !basePools[k]->passes(filters[k], denseIndices[k], since))
+						bPasses = false;
+				}
+
+				if (bPasses)
 				{
-					subscribers.erase(kv.first);
+					// Stamp the components before calling back, as the callback may move them.
+					for (size_t k = 0; k < sizeof...(Types); ++k)
+					{
+						if (!writes[k] || denseIndices[k] == Internal::BaseComponentPool::InvalidIndex)
+							continue;
+
+						if (bParallel)
+							basePools[k]->markRowChanged(denseIndices[k], tick);
+						else
+							basePools[k]->markChanged(denseIndices[k], tick);
+					}
+
+					Caller::call(func, Internal::IndexSequence<Indices...>(), versions, ent,
+						getTermComponent<Types>(std::get<Indices>(typedPools), denseIndices[Indices])...);
 				}
 			}
+
+			// If the entity lost its component, another entity was moved into its place.
+			if (i < pool->getCount() && pool->getEntity(i) != ent)
+				continue;
+
+			++i;
 		}
+	}
 
-		/**
-		* Emit an event. This will do nothing if there are no subscribers for the event type.
-		*/
-		template<typename T>
-		void emit(const T& event)
+	template<typename... Types, typename Func, size_t... Indices>
+	void World::eachChunkInPools(Internal::BaseComponentPool* pool, size_t begin, size_t end, Internal::IndexSequence<Indices...>,
+		const Internal::QueryMatcher& matcher, Func& func, bool bParallel, bool bIncludePendingDestroy)
+	{
+		std::tuple<Internal::ComponentPool<typename std::remove_const<Types>::type>*...> typedPools(
+			getPool<typename std::remove_const<Types>::type>()...);
+		Internal::BaseComponentPool* const basePools[] = { std::get<Indices>(typedPools)... };
+		const bool writes[] = { !std::is_const<Types>::value... };
+		const uint32_t tick = changeTick;
+
+		// A run is a range of entities whose components are at consecutive dense indices in every pool.
+		for (size_t i = begin; i < end;)
 		{
-			auto found = subscribers.find(getTypeIndex<T>());
-			if (found != subscribers.end())
+			Entity* ent = pool->getEntity(i);
+			if ((ent->isPendingDestroy() && !bIncludePendingDestroy) || !matcher.matches(ent->signature))
+			{
+				++i;
+				continue;
+			}
+
+			const uint32_t first[] = { basePools[Indices]->find(ent->index, pool, i)... };
+
+			size_t count = 1;
+			for (; i + count < end; ++count)
 			{
-				for (auto* base : found->second)
+				Entity* next = pool->getEntity(i + count);
+				if ((next->isPendingDestroy() && !bIncludePendingDestroy) || !matcher.matches(next->signature))
+					break;
+
+				bool bConsecutive = true;
+				for (size_t k = 0; k < sizeof...(Types); ++k)
 				{
-					auto* sub = reinterpret_cast<EventSubscriber<T>*>(base);
-					sub->receive(this, event);
+					if (basePools[k]->find(next->index, pool, i + count) != first[k] + count)
+						bConsecutive = false;
 				}
+
+				if (!bConsecutive)
+					break;
 			}
-		}
 
-		/**
-		* Run a function on each entity with a specific set of components. This is useful for implementing an EntitySystem.
-		*
-		* If you want to include entities that are pending destruction, set includePendingDestroy to true.
-		*/
-		template<typename... Types>
-		void each(typename std::common_type<std::function<void(Entity*, ComponentHandle<Types>...)>>::type viewFunc, bool bIncludePendingDestroy = false);
+			for (size_t k = 0; k < sizeof...(Types); ++k)
+			{
+				if (!writes[k])
+					continue;
 
-		/**
-		* Run a function on all entities.
-		*/
-		void all(std::function<void(Entity*)> viewFunc, bool bIncludePendingDestroy = false);
+				for (size_t row = first[k]; row < first[k] + count; ++row)
+				{
+					if (bParallel)
+						basePools[k]->markRowChanged(row, tick);
+					else
+						basePools[k]->markChanged(row, tick);
+				}
+			}
 
-		/**
-		* Get a view for entities with a specific set of components. The list of entities is calculated on the fly, so this method itself
-		* has little overhead. This is mostly useful with a range based for loop.
-		*/
-		template<typename... Types>
-		Internal::EntityComponentView<Types...> each(bool bIncludePendingDestroy = false)
-		{
-			Internal::EntityComponentIterator<Types...> first(this, 0, false, bIncludePendingDestroy);
-			Internal::EntityComponentIterator<Types...> last(this, getCount(), true, bIncludePendingDestroy);
-			return Internal::EntityComponentView<Types...>(first, last);
+			func(count, pool->getEntities(i),
+				getChunkArray<Types>(std::get<Indices>(typedPools), first[Indices], Internal::IsSoA<typename std::remove_const<Types>::type>())...);
+			i += count;
 		}
+	}
 
-		Internal::EntityView all(bool bIncludePendingDestroy = false);
+	template<typename T>
+	typename Internal::Term<T>::Pointer World::getTermComponent(Internal::ComponentPool<typename Internal::Term<T>::Component>* pool, uint32_t denseIndex)
+	{
+		typename Internal::Term<T>::Pointer component = { denseIndex != Internal::BaseComponentPool::InvalidIndex ? pool->getDense(denseIndex) : nullptr };
+		return component;
+	}
 
-		size_t getCount() const
+	template<typename T>
+	Internal::ComponentPool<T>* World::getPool() const
+	{
+		uint32_t id = Internal::getComponentId<T>();
+		if (id >= pools.size())
+			return nullptr;
+
+		return static_cast<Internal::ComponentPool<T>*>(pools[id]);
+	}
+
+	template<typename T>
+	Internal::ComponentPool<T>* World::getOrCreatePool()
+	{
+		using PoolAllocator = std::allocator_traits<EntityAllocator>::template rebind_alloc<Internal::ComponentPool<T>>;
+
+		Internal::ComponentPool<T>* pool = getPool<T>();
+		if (pool == nullptr)
 		{
-			return entities.size();
+			PoolAllocator alloc(entAlloc);
+			pool = std::allocator_traits<PoolAllocator>::allocate(alloc, 1);
+			std::allocator_traits<PoolAllocator>::construct(alloc, pool, entAlloc);
+
+			uint32_t id = Internal::getComponentId<T>();
+			if (id >= pools.size())
+				pools.resize(id + 1, nullptr);
+
+			pools[id] = pool;
+			poolList.push_back(pool);
 		}
 
-		Entity* getByIndex(size_t idx)
+		return pool;
+	}
+
+	template<typename... Types>
+	Internal::BaseComponentPool* World::getSmallestPool() const
+	{
+		Internal::BaseComponentPool* candidates[] = { getPool<typename Internal::Term<Types>::Component>()... };
+		const bool optional[] = { Internal::Term<Types>::bOptional... };
+
+		Internal::BaseComponentPool* smallest = nullptr;
+		for (size_t i = 0; i < sizeof...(Types); ++i)
 		{
-			if (idx >= getCount())
+			if (optional[i])
+				continue;
+
+			if (candidates[i] == nullptr)
 				return nullptr;
 
-			return entities[idx];
+			if (smallest == nullptr || candidates[i]->getCount() < smallest->getCount())
+				smallest = candidates[i];
 		}
 
-		/**
-		* Get an entity by an id. This is a slow process.
-		*/
-		Entity* getById(size_t id) const;
+		return smallest;
+	}
 
-		/**
-		* Tick the world. See the definition for ECS_TICK_TYPE at the top of this file for more information on
-		* passing data through tick().
-		*/
-#ifdef ECS_TICK_TYPE_VOID
-		void tick()
-#else
-		void tick(ECS_TICK_TYPE data)
-#endif
+	namespace Internal
+	{
+		inline uint32_t BaseComponentPool::getIndex(const Entity* ent)
 		{
-#ifndef ECS_TICK_NO_CLEANUP
-			cleanup();
-#endif
-			for (auto* system : systems)
+			return ent->index;
+		}
+
+		inline void BaseComponentPool::insertDense(Entity* ent, uint32_t tick)
+		{
+			setSparse(ent->index, static_cast<uint32_t>(entities.size()));
+			entities.push_back(ent);
+			addedTicks.push_back(tick);
+			changedTicks.push_back(tick);
+
+			if (addedTicks.size() > blockAddedTicks.size() * TickBlockSize)
 			{
-#ifdef ECS_TICK_TYPE_VOID
-				system->tick(this);
-#else
-				system->tick(this, data);
-#endif
+				blockAddedTicks.push_back(tick);
+				blockChangedTicks.push_back(tick);
+			}
+			else
+			{
+				blockAddedTicks.back() = tick;
+				blockChangedTicks.back() = tick;
+			}
+			ent->signature.set(componentId);
+
+			for (auto* query : queries)
+			{
+				query->onInserted(ent);
 			}
 		}
 
-		EntityAllocator& getPrimaryAllocator()
+		inline void BaseComponentPool::eraseDense(uint32_t denseIndex)
 		{
-			return entAlloc;
+			Entity* removed = entities[denseIndex];
+
+			if (denseIndex != entities.size() - 1)
+			{
+				entities[denseIndex] = entities.back();
+				addedTicks[denseIndex] = addedTicks.back();
+				changedTicks[denseIndex] = changedTicks.back();
+				setSparse(entities[denseIndex]->index, denseIndex);
+
+				const size_t block = denseIndex / TickBlockSize;
+				if (isTickNewer(addedTicks[denseIndex], blockAddedTicks[block]))
+					blockAddedTicks[block] = addedTicks[denseIndex];
+				if (isTickNewer(changedTicks[denseIndex], blockChangedTicks[block]))
+					blockChangedTicks[block] = changedTicks[denseIndex];
+			}
+
+			entities.pop_back();
+			addedTicks.pop_back();
+			changedTicks.pop_back();
+			if (addedTicks.size() <= (blockAddedTicks.size() - 1) * TickBlockSize)
+			{
+				blockAddedTicks.pop_back();
+				blockChangedTicks.pop_back();
+			}
+			setSparse(removed->index, InvalidIndex);
+			removed->signature.reset(componentId);
+			++version;
+
+			for (auto* query : queries)
+			{
+				query->onErased(removed);
+			}
 		}
 
-	private:
-		EntityAllocator entAlloc;
-		SystemAllocator systemAlloc;
+		inline void BaseQuery::onInserted(Entity* ent)
+		{
+			if (!ent->signature.containsAll(mask))
+				return;
 
-		std::vector<Entity*, EntityPtrAllocator> entities;
-		std::vector<EntitySystem*, SystemPtrAllocator> systems;
-        	std::vector<EntitySystem*> disabledSystems;
-		std::unordered_map<TypeIndex,
-			std::vector<Internal::BaseEventSubscriber*, SubscriberPtrAllocator>,
-			std::hash<TypeIndex>,
-			std::equal_to<TypeIndex>,
-			SubscriberPairAllocator> subscribers;
+			if (ent->index >= positions.size())
+				positions.resize(ent->index + 1, static_cast<uint32_t>(InvalidPosition));
 
-		size_t lastEntityId = 0;
-	};
+			if (positions[ent->index] != InvalidPosition)
+				return;
 
-	namespace Internal
-	{
-		class EntityIterator
+			positions[ent->index] = static_cast<uint32_t>(entities.size());
+			entities.push_back(ent);
+		}
+
+		inline void BaseQuery::onErased(Entity* ent)
 		{
-		public:
-			EntityIterator(World* world, size_t index, bool bIsEnd, bool bIncludePendingDestroy);
+			if (ent->index >= positions.size() || positions[ent->index] == InvalidPosition)
+				return;
 
-			size_t getIndex() const
+			uint32_t position = positions[ent->index];
+			if (position != entities.size() - 1)
 			{
-				return index;
+				entities[position] = entities.back();
+				positions[entities[position]->index] = position;
 			}
 
-			bool isEnd() const;
+			entities.pop_back();
+			positions[ent->index] = InvalidPosition;
+		}
 
-			bool includePendingDestroy() const
-			{
-				return bIncludePendingDestroy;
-			}
+		template<typename T>
+		template<typename... Args>
+		T* ComponentPool<T, false, false>::assign(Entity* ent, Args&&... args)
+		{
+			const uint32_t tick = ent->getWorld()->getChangeTick();
 
-			World* getWorld() const
+			uint32_t denseIndex = find(getIndex(ent));
+			if (denseIndex != InvalidIndex)
 			{
-				return world;
+				components[denseIndex] = T(std::forward<Args>(args)...);
+				markChanged(denseIndex, tick);
+				return &components[denseIndex];
 			}
 
-			Entity* get() const;
+			return insert(ent, tick, std::forward<Args>(args)...);
+		}
 
-			Entity* operator*() const
+		template<typename T>
+		template<typename... Args>
+		T* ComponentPool<T, false, false>::insert(Entity* ent, uint32_t tick, Args&&... args)
+		{
+			const T* data = components.data();
+			components.emplace_back(std::forward<Args>(args)...);
+			if (components.data() != data)
+				++version;
+
+			insertDense(ent, tick);
+			return &components.back();
+		}
+
+		template<typename T>
+		void ComponentPool<T, false, false>::removed(Entity* ent)
+		{
+			// Skip looking up the component if nobody is listening.
+			World* world = ent->getWorld();
+			if (world->hasSubscribers<Events::OnComponentRemoved<T>>())
 			{
-				return get();
+				auto handle = ComponentHandle<T>(get(getIndex(ent)));
+				world->emit<Events::OnComponentRemoved<T>>({ ent, handle });
 			}
+		}
 
-			bool operator==(const EntityIterator& other) const
+		template<typename T>
+		void ComponentPool<T, false, false>::remove(Entity* ent)
+		{
+			uint32_t denseIndex = find(getIndex(ent));
+			if (denseIndex != components.size() - 1)
 			{
-				if (world != other.world)
-					return false;
+				components[denseIndex] = std::move(components.back());
+			}
 
-				if (isEnd())
-					return other.isEnd();
+			components.pop_back();
+			eraseDense(denseIndex);
+		}
 
-				return index == other.index;
-			}
+		template<typename T>
+		template<typename... Args>
+		T* ComponentPool<T, false, true>::assign(Entity* ent, Args&&...)
+		{
+			const uint32_t tick = ent->getWorld()->getChangeTick();
 
-			bool operator!=(const EntityIterator& other) const
+			uint32_t denseIndex = find(getIndex(ent));
+			if (denseIndex != InvalidIndex)
 			{
-				if (world != other.world)
-					return true;
+				markChanged(denseIndex, tick);
+				return &tag;
+			}
 
-				if (isEnd())
-					return !other.isEnd();
+			return insert(ent, tick);
+		}
 
-				return index != other.index;
-			}
+		template<typename T>
+		template<typename... Args>
+		T* ComponentPool<T, false, true>::insert(Entity* ent, uint32_t tick, Args&&...)
+		{
+			insertDense(ent, tick);
+			return &tag;
+		}
 
-			EntityIterator& operator++();
+		template<typename T>
+		void ComponentPool<T, false, true>::removed(Entity* ent)
+		{
+			World* world = ent->getWorld();
+			if (world->hasSubscribers<Events::OnComponentRemoved<T>>())
+			{
+				auto handle = ComponentHandle<T>(&tag);
+				world->emit<Events::OnComponentRemoved<T>>({ ent, handle });
+			}
+		}
 
-		private:
-			bool bIsEnd = false;
-			size_t index;
-			class ECS::World* world;
-			bool bIncludePendingDestroy;
-		};
+		template<typename T>
+		void ComponentPool<T, false, true>::remove(Entity* ent)
+		{
+			eraseDense(find(getIndex(ent)));
+		}
 
-		class EntityView
+		template<typename T>
+		template<typename... Args>
+		void ComponentPool<T, true, false>::assign(Entity* ent, Args&&... args)
 		{
-		public:
-			EntityView(const EntityIterator& first, const EntityIterator& last)
-				: firstItr(first), lastItr(last)
+			const uint32_t tick = ent->getWorld()->getChangeTick();
+			void* target[Layout::FieldCount];
+
+			uint32_t denseIndex = find(getIndex(ent));
+			if (denseIndex != InvalidIndex)
 			{
-				if (firstItr.get() == nullptr || (firstItr.get()->isPendingDestroy() && !firstItr.includePendingDestroy()))
-				{
-					++firstItr;
-				}
+				getFields(denseIndex, target);
+				Layout::store(T(std::forward<Args>(args)...), target);
+				markChanged(denseIndex, tick);
+				return;
 			}
 
-			const EntityIterator& begin() const
+			insert(ent, tick, std::forward<Args>(args)...);
+		}
+
+		template<typename T>
+		template<typename... Args>
+		void ComponentPool<T, true, false>::insert(Entity* ent, uint32_t tick, Args&&... args)
+		{
+			void* target[Layout::FieldCount];
+			if (getCount() == capacity)
+				grow(capacity > 0 ? capacity * 2 : ECS_SOA_ALIGNMENT);
+
+			getFields(getCount(), target);
+			Layout::store(T(std::forward<Args>(args)...), target);
+			insertDense(ent, tick);
+		}
+
+		template<typename T>
+		void ComponentPool<T, true, false>::removed(Entity* ent)
+		{
+			World* world = ent->getWorld();
+			if (world->hasSubscribers<Events::OnComponentRemoved<T>>())
 			{
-				return firstItr;
+				// There's no single object to point to, so subscribers get a copy.
+				T component = ent->get<T>().get();
+				world->emit<Events::OnComponentRemoved<T>>({ ent, ComponentHandle<T>(&component) });
 			}
+		}
 
-			const EntityIterator& end() const
+		template<typename T>
+		void ComponentPool<T, true, false>::remove(Entity* ent)
+		{
+			uint32_t denseIndex = find(getIndex(ent));
+			if (denseIndex != getCount() - 1)
 			{
-				return lastItr;
+				const size_t* sizes = Layout::getFieldSizes();
+				for (size_t field = 0; field < Layout::FieldCount; ++field)
+				{
+					unsigned char* array = static_cast<unsigned char*>(fields[field]);
+					std::memcpy(array + denseIndex * sizes[field], array + (getCount() - 1) * sizes[field], sizes[field]);
+				}
 			}
 
-		private:
-			EntityIterator firstItr;
-			EntityIterator lastItr;
-		};
+			eraseDense(denseIndex);
+		}
 
 		template<typename T>
-		struct ComponentContainer : public BaseComponentContainer
+		void ComponentPool<T, true, false>::grow(size_t newCapacity)
 		{
-			ComponentContainer() {}
-			ComponentContainer(const T& data) : data(data) {}
-
-			T data;
+			const size_t* sizes = Layout::getFieldSizes();
+			const size_t alignment = ECS_SOA_ALIGNMENT;
 
-		protected:
-			virtual void destroy(World* world)
+			// Leave room to align the start of the block, and round every array up so that the next one starts aligned.
+			size_t bytes = alignment;
+			for (size_t field = 0; field < Layout::FieldCount; ++field)
 			{
-				using ComponentAllocator = std::allocator_traits<World::EntityAllocator>::template rebind_alloc<ComponentContainer<T>>;
-
-				ComponentAllocator alloc(world->getPrimaryAllocator());
-				std::allocator_traits<ComponentAllocator>::destroy(alloc, this);
-				std::allocator_traits<ComponentAllocator>::deallocate(alloc, this, 1);
+				bytes += (newCapacity * sizes[field] + alignment - 1) / alignment * alignment;
 			}
 
-			virtual void removed(Entity* ent)
+			size_t newBlockCount = (bytes + sizeof(std::max_align_t) - 1) / sizeof(std::max_align_t);
+			std::max_align_t* newBlock = std::allocator_traits<BlockAllocator>::allocate(blockAlloc, newBlockCount);
+
+			uintptr_t address = (reinterpret_cast<uintptr_t>(newBlock) + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+			for (size_t field = 0; field < Layout::FieldCount; ++field)
 			{
-				auto handle = ComponentHandle<T>(&data);
-				ent->getWorld()->emit<Events::OnComponentRemoved<T>>({ ent, handle });
+				void* array = reinterpret_cast<void*>(address);
+				if (getCount() > 0)
+					std::memcpy(array, fields[field], getCount() * sizes[field]);
+
+				fields[field] = array;
+				address += (newCapacity * sizes[field] + alignment - 1) / alignment * alignment;
 			}
-		};
+
+			if (block != nullptr)
+				std::allocator_traits<BlockAllocator>::deallocate(blockAlloc, block, blockCount);
+
+			block = newBlock;
+			blockCount = newBlockCount;
+			capacity = newCapacity;
+			++version;
+		}
 	}
 
-	inline World::~World()
+	inline Entity::~Entity()
 	{
-		for (auto* system : systems)
+		removeAll();
+	}
+
+	template<typename T>
+	bool Entity::has() const
+	{
+		return signature.test(Internal::getComponentId<T>());
+	}
+
+	template<typename T>
+	bool Entity::remove()
+	{
+		if (world->isStructureLocked())
 		{
-			system->unconfigure(this);
+			world->getCommandBuffer()->remove<T>(getHandle());
+			return has<T>();
 		}
 
-		for (auto* ent : entities)
-		{
-			if (!ent->isPendingDestroy())
-			{
-				ent->bPendingDestroy = true;
-				emit<Events::OnEntityDestroyed>({ ent });
-			}
+		auto* pool = world->getPool<T>();
+		if (pool == nullptr || !pool->contains(index))
+			return false;
 
-			std::allocator_traits<EntityAllocator>::destroy(entAlloc, ent);
-			std::allocator_traits<EntityAllocator>::deallocate(entAlloc, ent, 1);
-		}
+		pool->removed(this);
 
-		for (auto* system : systems)
+		// A subscriber may have already removed the component.
+		if (pool->contains(index))
 		{
-			std::allocator_traits<SystemAllocator>::destroy(systemAlloc, system);
-			std::allocator_traits<SystemAllocator>::deallocate(systemAlloc, system, 1);
+			pool->remove(this);
 		}
+
+		return true;
 	}
 
-	inline void World::destroy(Entity* ent, bool immediate)
+	inline void Entity::removeAll()
 	{
-		if (ent == nullptr)
+		assert(!world->isStructureLocked() && "Components can't be removed all at once while the world is locked by a parallel loop");
+		if (world->isStructureLocked())
 			return;
 
-		if (ent->isPendingDestroy())
+		// Pools may be created by event subscribers, so don't hold on to an iterator.
+		for (size_t i = 0; i < world->poolList.size(); ++i)
 		{
-			if (immediate)
+			Internal::BaseComponentPool* pool = world->poolList[i];
+			if (pool->contains(index))
 			{
-				entities.erase(std::remove(entities.begin(), entities.end(), ent), entities.end());
-				std::allocator_traits<EntityAllocator>::destroy(entAlloc, ent);
-				std::allocator_traits<EntityAllocator>::deallocate(entAlloc, ent, 1);
-			}
+				pool->removed(this);
 
-			return;
+				if (pool->contains(index))
+					pool->remove(this);
+			}
 		}
+	}
 
-		ent->bPendingDestroy = true;
+	template<typename T, typename... Args>
+	ComponentHandle<T> Entity::assignComponent(std::false_type, Args&&... args)
+	{
+		assert(!world->isStructureLocked() && "Components can't be assigned or removed while the world is locked by a parallel loop");
 
-		emit<Events::OnEntityDestroyed>({ ent });
+		auto* pool = world->getOrCreatePool<T>();
+		T* component = pool->assign(this, std::forward<Args>(args)...);
 
-		if (immediate)
-		{
-			entities.erase(std::remove(entities.begin(), entities.end(), ent), entities.end());
-			std::allocator_traits<EntityAllocator>::destroy(entAlloc, ent);
-			std::allocator_traits<EntityAllocator>::deallocate(entAlloc, ent, 1);
-		}
+		auto handle = ComponentHandle<T>(component, this, pool->getVersion());
+		world->emit<Events::OnComponentAssigned<T>>({ this, handle });
+		return handle;
 	}
 
-	inline bool World::cleanup()
+	template<typename T, typename... Args>
+	SoAHandle<T> Entity::assignComponent(std::true_type, Args&&... args)
 	{
-		size_t count = 0;
-		entities.erase(std::remove_if(entities.begin(), entities.end(), [&, this](Entity* ent) {
-			if (ent->isPendingDestroy())
-			{
-				std::allocator_traits<EntityAllocator>::destroy(entAlloc, ent);
-				std::allocator_traits<EntityAllocator>::deallocate(entAlloc, ent, 1);
-				++count;
-				return true;
-			}
-
-			return false;
-		}), entities.end());
+		assert(!world->isStructureLocked() && "Components can't be assigned or removed while the world is locked by a parallel loop");
 
-		return count > 0;
+		world->getOrCreatePool<T>()->assign(this, std::forward<Args>(args)...);
+		world->emitAssigned<T>(this);
+		return SoAHandle<T>(this);
 	}
 
-	inline void World::reset()
+	template<typename... Types>
+	Span<Entity* const> World::createMany(size_t count, const Types&... prototypes)
 	{
-		for (auto* ent : entities)
+		static_assert(Internal::AreDistinct<Types...>::value, "A component type can only be given once to createMany().");
+		assert(!isStructureLocked() && "Entities can't be created while the world is locked by a parallel loop, use a command buffer");
+		if (isStructureLocked())
+			return Span<Entity* const>();
+
+		size_t first = entities.size();
+		if (first + count > entities.capacity())
+			entities.reserve(std::max(first + count, entities.capacity() * 2));
+
+		int reserve[] = { 0, (getOrCreatePool<Types>()->reserveMore(count), 0)... };
+		(void)reserve;
+
+		// The entities are new, so their components can be inserted without checking whether they already have them.
+		for (size_t i = 0; i < count; ++i)
 		{
-			if (!ent->isPendingDestroy())
-			{
-				ent->bPendingDestroy = true;
-				emit<Events::OnEntityDestroyed>({ ent });
-			}
-			std::allocator_traits<EntityAllocator>::destroy(entAlloc, ent);
-			std::allocator_traits<EntityAllocator>::deallocate(entAlloc, ent, 1);
+			Entity* ent = allocateEntity();
+
+			int expand[] = { 0, (getPool<Types>()->insert(ent, changeTick, prototypes), 0)... };
+			(void)expand;
 		}
 
-		entities.clear();
-		lastEntityId = 0;
+		emitCreatedMany<Types...>(first, count);
+
+		return Span<Entity* const>(entities.data() + first, count);
 	}
 
-	inline void World::all(std::function<void(Entity*)> viewFunc, bool bIncludePendingDestroy)
+	template<typename T>
+	ComponentHandle<T> Entity::getComponent(std::false_type)
 	{
-		for (auto* ent : all(bIncludePendingDestroy))
+		auto* pool = world->getPool<T>();
+		if (pool != nullptr)
 		{
-			viewFunc(ent);
+			T* component = pool->get(index);
+			if (component != nullptr)
+				return ComponentHandle<T>(component, this, pool->getVersion());
 		}
+
+		return ComponentHandle<T>();
 	}
 
-	inline Internal::EntityView World::all(bool bIncludePendingDestroy)
+	template<typename T>
+	bool Entity::getFields(void** fields)
 	{
-		Internal::EntityIterator first(this, 0, false, bIncludePendingDestroy);
-		Internal::EntityIterator last(this, getCount(), true, bIncludePendingDestroy);
-		return Internal::EntityView(first, last);
+		auto* pool = world->getPool<T>();
+		if (pool == nullptr)
+			return false;
+
+		uint32_t denseIndex = pool->find(index);
+		if (denseIndex == Internal::BaseComponentPool::InvalidIndex)
+			return false;
+
+		pool->getFields(denseIndex, fields);
+		return true;
 	}
 
-	inline Entity* World::getById(size_t id) const
+	template<typename T>
+	bool Entity::markChanged()
 	{
-		if (id == Entity::InvalidEntityId || id > lastEntityId)
-			return nullptr;
+		auto* pool = world->getPool<T>();
+		if (pool == nullptr)
+			return false;
 
-		// We should likely store entities in a map of id -> entity so that this is faster.
-		for (auto* ent : entities)
-		{
-			if (ent->getEntityId() == id)
-				return ent;
-		}
+		uint32_t denseIndex = pool->find(index);
+		if (denseIndex == Internal::BaseComponentPool::InvalidIndex)
+			return false;
 
-		return nullptr;
+		pool->markChanged(denseIndex, world->getChangeTick());
+		return true;
 	}
+#endif
 
-	template<typename... Types>
-	void World::each(typename std::common_type<std::function<void(Entity*, ComponentHandle<Types>...)>>::type viewFunc, bool bIncludePendingDestroy)
+	template<typename T, typename... Args>
+	typename Internal::HandleOf<T>::Type Entity::assign(Args&&... args)
 	{
-		for (auto* ent : each<Types...>(bIncludePendingDestroy))
+		if (world->isStructureLocked())
 		{
-			viewFunc(ent, ent->template get<Types>()...);
+			world->getCommandBuffer()->assign<T>(getHandle(), std::forward<Args>(args)...);
+			return typename Internal::HandleOf<T>::Type();
 		}
+
+		return assignComponent<T>(Internal::IsSoA<T>(), std::forward<Args>(args)...);
 	}
 
-	template<typename T, typename... Args>
-	ComponentHandle<T> Entity::assign(Args&&... args)
+	template<typename T>
+	ComponentHandle<T>::ComponentHandle(T* component, Entity* owner, const uint32_t* version)
+		: component(component), version(version), seenVersion(*version), world(owner->getWorld()), owner(owner->getHandle())
 	{
-		using ComponentAllocator = std::allocator_traits<World::EntityAllocator>::template rebind_alloc<Internal::ComponentContainer<T>>;
+	}
+
+	template<typename T>
+	ComponentHandle<T> ComponentHandle<T>::lookup(Entity* ent, std::false_type)
+	{
+		return ent->template get<T>();
+	}
 
-		auto found = components.find(getTypeIndex<T>());
-		if (found != components.end())
+	template<typename T>
+	T* ComponentHandle<T>::resolve() const
+	{
+		if (version != nullptr && *version != seenVersion)
 		{
-			Internal::ComponentContainer<T>* container = reinterpret_cast<Internal::ComponentContainer<T>*>(found->second);
-			container->data = T(args...);
+			ComponentHandle<T> current;
 
-			auto handle = ComponentHandle<T>(&container->data);
-			world->emit<Events::OnComponentAssigned<T>>({ this, handle });
-			return handle;
+			Entity* ent = world->resolve(owner);
+			if (ent != nullptr)
+				current = lookup(ent, Internal::IsSoA<T>());
+
+			component = current.component;
+			version = current.version;
+			seenVersion = current.seenVersion;
 		}
-		else
-		{
-			ComponentAllocator alloc(world->getPrimaryAllocator());
 
-			Internal::ComponentContainer<T>* container = std::allocator_traits<ComponentAllocator>::allocate(alloc, 1);
-			std::allocator_traits<ComponentAllocator>::construct(alloc, container, T(args...));
+		return component;
+	}
+
+	template<typename T>
+	SoAHandle<T>::SoAHandle(Entity* owner)
+		: world(owner->getWorld()), owner(owner->getHandle())
+	{
+	}
+
+	template<typename T>
+	T SoAHandle<T>::get() const
+	{
+		T component;
+		void* fields[Layout::FieldCount];
+		bool bValid = getFields(fields);
+		assert(bValid && "The component of an SoAHandle is gone");
+		(void)bValid;
+
+		Layout::load(component, fields);
+		return component;
+	}
 
-			components.insert({ getTypeIndex<T>(), container });
+	template<typename T>
+	void SoAHandle<T>::set(const T& component) const
+	{
+		void* fields[Layout::FieldCount];
+		bool bValid = getFields(fields);
+		assert(bValid && "The component of an SoAHandle is gone");
+		(void)bValid;
 
-			auto handle = ComponentHandle<T>(&container->data);
-			world->emit<Events::OnComponentAssigned<T>>({ this, handle });
-			return handle;
-		}
+		Layout::store(component, fields);
 	}
 
 	template<typename T>
-	ComponentHandle<T> Entity::get()
+	bool SoAHandle<T>::isValid() const
 	{
-		auto found = components.find(getTypeIndex<T>());
-		if (found != components.end())
-		{
-			return ComponentHandle<T>(&reinterpret_cast<Internal::ComponentContainer<T>*>(found->second)->data);
-		}
-	
-		return ComponentHandle<T>();
+		void* fields[Layout::FieldCount];
+		return getFields(fields);
+	}
+
+	template<typename T>
+	bool SoAHandle<T>::getFields(void** fields) const
+	{
+		Entity* ent = world != nullptr ? world->resolve(owner) : nullptr;
+		return ent != nullptr && ent->template getFields<T>(fields);
 	}
 
 	namespace Internal
@@ -1146,44 +9383,124 @@ namespace ECS
 			return *this;
 		}
 
+#ifdef ECS_ARCHETYPE_STORAGE
 		template<typename... Types>
 		EntityComponentIterator<Types...>::EntityComponentIterator(World* world, size_t index, bool bIsEnd, bool bIncludePendingDestroy)
 			: bIsEnd(bIsEnd), index(index), world(world), bIncludePendingDestroy(bIncludePendingDestroy)
 		{
-			if (index >= world->getCount())
-				this->bIsEnd = true;
+			if (!bIsEnd)
+				seek();
 		}
 
 		template<typename... Types>
 		bool EntityComponentIterator<Types...>::isEnd() const
 		{
-			return bIsEnd || index >= world->getCount();
+			return bIsEnd || archetypeIndex >= world->archetypes.size();
 		}
 
 		template<typename... Types>
 		Entity* EntityComponentIterator<Types...>::get() const
 		{
-			if (isEnd())
+			if (isEnd() || index >= world->archetypes[archetypeIndex]->getCount())
 				return nullptr;
 
-			return world->getByIndex(index);
+			return world->archetypes[archetypeIndex]->getEntity(index);
 		}
 
 		template<typename... Types>
 		EntityComponentIterator<Types...>& EntityComponentIterator<Types...>::operator++()
 		{
-			++index;
-			while (index < world->getCount() && (get() == nullptr || !get()->template has<Types...>() || (get()->isPendingDestroy() && !bIncludePendingDestroy)))
+			if (!isEnd())
 			{
 				++index;
+				seek();
 			}
 
-			if (index >= world->getCount())
-				bIsEnd = true;
+			return *this;
+		}
+
+		template<typename... Types>
+		void EntityComponentIterator<Types...>::seek()
+		{
+			while (archetypeIndex < world->archetypes.size())
+			{
+				Archetype* archetype = world->archetypes[archetypeIndex];
+				if (index >= archetype->getCount() || !archetype->template has<Types...>())
+				{
+					++archetypeIndex;
+					index = 0;
+				}
+				else if (archetype->getEntity(index)->isPendingDestroy() && !bIncludePendingDestroy)
+				{
+					++index;
+				}
+				else
+				{
+					return;
+				}
+			}
+
+			bIsEnd = true;
+		}
+#else
+		template<typename... Types>
+		EntityComponentIterator<Types...>::EntityComponentIterator(World* world, size_t index, bool bIsEnd, bool bIncludePendingDestroy)
+			: bIsEnd(bIsEnd), index(index), world(world), bIncludePendingDestroy(bIncludePendingDestroy)
+		{
+			if (!bIsEnd)
+			{
+				pool = world->template getSmallestPool<Types...>();
+				seek();
+			}
+		}
+
+		template<typename... Types>
+		bool EntityComponentIterator<Types...>::isEnd() const
+		{
+			return bIsEnd || pool == nullptr || index >= pool->getCount();
+		}
+
+		template<typename... Types>
+		Entity* EntityComponentIterator<Types...>::get() const
+		{
+			if (isEnd())
+				return nullptr;
+
+			return pool->getEntity(index);
+		}
+
+		template<typename... Types>
+		EntityComponentIterator<Types...>& EntityComponentIterator<Types...>::operator++()
+		{
+			if (!isEnd())
+			{
+				++index;
+				seek();
+			}
 
 			return *this;
 		}
 
+		template<typename... Types>
+		void EntityComponentIterator<Types...>::seek()
+		{
+			while (pool != nullptr && index < pool->getCount())
+			{
+				Entity* ent = pool->getEntity(index);
+				if (!ent->template has<Types...>() || (ent->isPendingDestroy() && !bIncludePendingDestroy))
+				{
+					++index;
+				}
+				else
+				{
+					return;
+				}
+			}
+
+			bIsEnd = true;
+		}
+#endif
+
 		template<typename... Types>
 		EntityComponentView<Types...>::EntityComponentView(const EntityComponentIterator<Types...>& first, const EntityComponentIterator<Types...>& last)
 			: firstItr(first), lastItr(last)
@@ -1195,4 +9512,111 @@ namespace ECS
 			}
 		}
 	}
-}
\ No newline at end of file
+
+	template<typename... Types>
+	Query<Types...>::Query(World* world)
+		: BaseQuery(world)
+	{
+		mask = Internal::getComponentMask<typename std::remove_const<Types>::type...>();
+
+#ifdef ECS_ARCHETYPE_STORAGE
+		for (auto* archetype : world->archetypes)
+		{
+			onArchetypeCreated(archetype);
+		}
+#else
+		pools = { world->template getOrCreatePool<typename std::remove_const<Types>::type>()... };
+		for (auto* pool : pools)
+		{
+			pool->addQuery(this);
+		}
+
+		// Find the entities that already match.
+		Internal::BaseComponentPool* smallest = world->template getSmallestPool<typename std::remove_const<Types>::type...>();
+		for (size_t i = 0; i < smallest->getCount(); ++i)
+		{
+			onInserted(smallest->getEntity(i));
+		}
+#endif
+	}
+
+	template<typename... Types>
+	template<typename Caller, typename Func, size_t... Indices>
+	void Query<Types...>::eachImpl(Internal::IndexSequence<Indices...>, Func& func, bool bIncludePendingDestroy)
+	{
+#ifdef ECS_ARCHETYPE_STORAGE
+		// Archetypes may be created while iterating, so don't hold on to an iterator.
+		for (size_t i = 0; i < archetypes.size(); ++i)
+		{
+			if (archetypes[i]->getCount() > 0)
+			{
+				world->template eachInArchetype<Caller, Types...>(archetypes[i], 0, SIZE_MAX, Internal::IndexSequence<Indices...>(), func, 0, false, bIncludePendingDestroy);
+			}
+		}
+#else
+		std::tuple<Internal::ComponentPool<typename std::remove_const<Types>::type>*...> typedPools(
+			static_cast<Internal::ComponentPool<typename std::remove_const<Types>::type>*>(pools[Indices])...);
+		const uint32_t* const versions[] = { std::get<Indices>(typedPools)->getVersion()... };
+		const bool writes[] = { !std::is_const<Types>::value... };
+		const uint32_t tick = world->getChangeTick();
+
+		for (size_t i = 0; i < entities.size();)
+		{
+			Entity* ent = entities[i];
+			if (!ent->isPendingDestroy() || bIncludePendingDestroy)
+			{
+				// Stamp the components as changed unless they are const, like World::each() does.
+				const uint32_t denseIndices[] = { pools[Indices]->find(ent->index)... };
+				for (size_t k = 0; k < sizeof...(Types); ++k)
+				{
+					if (writes[k])
+						pools[k]->markChanged(denseIndices[k], tick);
+				}
+
+				Caller::call(func, Internal::IndexSequence<Indices...>(), versions, ent,
+					static_cast<Types*>(std::get<Indices>(typedPools)->getDense(denseIndices[Indices]))...);
+			}
+
+			// If the entity stopped matching, another entity was moved into its place.
+			if (i < entities.size() && entities[i] != ent)
+				continue;
+
+			++i;
+		}
+#endif
+	}
+
+	template<typename... Types>
+	Query<Types...>* World::query()
+	{
+		using QueryAllocator = std::allocator_traits<EntityAllocator>::template rebind_alloc<Query<Types...>>;
+
+		// Key on the unqualified components, followed by which of them are const, as queries that only differ in which
+		// components are const are different types.
+		std::vector<TypeIndex> key = { getTypeIndex<typename std::remove_const<Types>::type>()..., TypeIndex(std::is_const<Types>::value)... };
+		auto found = queryLookup.find(key);
+		if (found != queryLookup.end())
+			return static_cast<Query<Types...>*>(found->second);
+
+		QueryAllocator alloc(entAlloc);
+		Query<Types...>* query = std::allocator_traits<QueryAllocator>::allocate(alloc, 1);
+		std::allocator_traits<QueryAllocator>::construct(alloc, query, this);
+
+		queries.push_back(query);
+		queryLookup.insert({ key, query });
+
+		return query;
+	}
+}
+
+namespace std
+{
+	template<>
+	struct hash<ECS::EntityHandle>
+	{
+		size_t operator()(const ECS::EntityHandle& handle) const
+		{
+			return hash<uint64_t>()(handle.pack());
+		}
+	};
+}
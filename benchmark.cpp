@@ -0,0 +1,1249 @@
+/*
+Copyright (c) 2016 Sam Bloomberg
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+/*
+Microbenchmarks for the World and Entity hot paths.
+
+Usage: benchmark [max entities] [filter]
+
+Runs every benchmark at 10k entities and at every power of ten above that up to max entities (default 1000000, pass
+10000000 for the full range). If a filter is given, only benchmarks whose name contains it are run.
+
+For each benchmark this prints the time per operation, the number of heap allocations per operation (counted by
+replacing the global operator new) and how much the resident set size of the process grew while it ran. Freed memory is
+handed back to the OS (where the C library allows it) before each benchmark starts, so memory left over from earlier
+benchmarks doesn't hide the growth.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#else
+#include <unistd.h>
+#endif
+
+#if defined(__GLIBC__) || defined(_WIN32)
+#include <malloc.h>
+#endif
+
+#include "ECS.h"
+
+ECS_TYPE_IMPLEMENTATION;
+
+using namespace ECS;
+
+namespace
+{
+	std::atomic<size_t> allocationCount(0);
+}
+
+// GCC can't tell that the replaced operator new below uses malloc, so it warns about the matching free calls.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wpragmas"
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size)
+{
+	++allocationCount;
+	if (void* ptr = std::malloc(size ? size : 1))
+		return ptr;
+
+	throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+	std::free(ptr);
+}
+
+struct A
+{
+	ECS_DECLARE_TYPE;
+
+	A(float value) : value(value) {}
+	A() {}
+
+	float value;
+};
+
+ECS_DEFINE_TYPE(A);
+
+struct B
+{
+	ECS_DECLARE_TYPE;
+
+	B(float value) : value(value) {}
+	B() {}
+
+	float value;
+};
+
+ECS_DEFINE_TYPE(B);
+
+struct C
+{
+	ECS_DECLARE_TYPE;
+
+	C(float value) : value(value) {}
+	C() {}
+
+	float value;
+};
+
+ECS_DEFINE_TYPE(C);
+
+struct D
+{
+	ECS_DECLARE_TYPE;
+
+	D(float value) : value(value) {}
+	D() {}
+
+	float value;
+};
+
+ECS_DEFINE_TYPE(D);
+
+// Empty, so it's stored as a tag.
+struct Tag
+{
+	ECS_DECLARE_TYPE;
+};
+
+ECS_DEFINE_TYPE(Tag);
+
+struct BenchEvent
+{
+	ECS_DECLARE_TYPE;
+
+	int value;
+};
+
+ECS_DEFINE_TYPE(BenchEvent);
+
+class BenchSubscriber : public EventSubscriber<BenchEvent>
+{
+public:
+	virtual ~BenchSubscriber() {}
+
+	virtual void receive(World* world, const BenchEvent& event) override
+	{
+		total += event.value;
+	}
+
+	void onEvent(World* world, const BenchEvent& event)
+	{
+		total += event.value;
+	}
+
+	virtual void receiveBatch(World* world, Span<const BenchEvent> events) override
+	{
+		for (const BenchEvent& event : events)
+		{
+			total += event.value;
+		}
+	}
+
+	size_t total = 0;
+};
+
+// The systems ticked by the tick benchmarks. The first three don't conflict with each other and SumSystem reads what
+// they write, so with declared access they run as two stages. Without it every system runs on its own.
+class BenchSystem : public EntitySystem
+{
+public:
+	BenchSystem(bool bDeclareAccess) : bDeclareAccess(bDeclareAccess) {}
+
+	virtual ~BenchSystem() {}
+
+	virtual void declareAccess(SystemAccess& access) override
+	{
+		if (bDeclareAccess)
+			declare(access);
+	}
+
+protected:
+	virtual void declare(SystemAccess& access) = 0;
+
+private:
+	bool bDeclareAccess;
+};
+
+class MoveSystem : public BenchSystem
+{
+public:
+	using BenchSystem::BenchSystem;
+
+	virtual void tick(World* world, ECS_TICK_TYPE data) override
+	{
+		world->each<A, const B>([&](A& a, const B& b) {
+			a.value += b.value * data;
+		});
+	}
+
+protected:
+	virtual void declare(SystemAccess& access) override
+	{
+		access.writes<A>().reads<B>();
+	}
+};
+
+class ScaleSystem : public BenchSystem
+{
+public:
+	using BenchSystem::BenchSystem;
+
+	virtual void tick(World* world, ECS_TICK_TYPE data) override
+	{
+		world->each<C, const B>([&](C& c, const B& b) {
+			c.value *= b.value;
+		});
+	}
+
+protected:
+	virtual void declare(SystemAccess& access) override
+	{
+		access.writes<C>().reads<B>();
+	}
+};
+
+class DecaySystem : public BenchSystem
+{
+public:
+	using BenchSystem::BenchSystem;
+
+	virtual void tick(World* world, ECS_TICK_TYPE data) override
+	{
+		world->each<D>([&](D& d) {
+			d.value -= data;
+		});
+	}
+
+protected:
+	virtual void declare(SystemAccess& access) override
+	{
+		access.writes<D>();
+	}
+};
+
+class SumSystem : public BenchSystem
+{
+public:
+	using BenchSystem::BenchSystem;
+
+	virtual void tick(World* world, ECS_TICK_TYPE data) override
+	{
+		world->each<const A, const C>([&](const A& a, const C& c) {
+			total += a.value + c.value;
+		});
+	}
+
+	float total = 0.f;
+
+protected:
+	virtual void declare(SystemAccess& access) override
+	{
+		access.reads<A>().reads<C>();
+	}
+};
+
+namespace
+{
+	using Clock = std::chrono::steady_clock;
+
+	std::string filter;
+
+	// Keeps the optimizer from throwing away work whose result is otherwise unused.
+	volatile float sink;
+
+	size_t getCurrentRSS()
+	{
+#if defined(_WIN32)
+		PROCESS_MEMORY_COUNTERS counters;
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+			return counters.WorkingSetSize;
+		return 0;
+#elif defined(__APPLE__)
+		mach_task_basic_info_data_t info;
+		mach_msg_type_number_t infoCount = MACH_TASK_BASIC_INFO_COUNT;
+		if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, reinterpret_cast<task_info_t>(&info), &infoCount) != KERN_SUCCESS)
+			return 0;
+		return static_cast<size_t>(info.resident_size);
+#else
+		// The second field of statm is the number of resident pages.
+		FILE* file = std::fopen("/proc/self/statm", "r");
+		if (file == nullptr)
+			return 0;
+
+		unsigned long long size = 0;
+		unsigned long long resident = 0;
+		int read = std::fscanf(file, "%llu %llu", &size, &resident);
+		std::fclose(file);
+		if (read != 2)
+			return 0;
+
+		return static_cast<size_t>(resident) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+	}
+
+	// Give memory freed by earlier benchmarks back to the OS, so it doesn't hide the growth of the next one.
+	void releaseFreeMemory()
+	{
+#if defined(__GLIBC__)
+		malloc_trim(0);
+#elif defined(_WIN32)
+		_heapmin();
+#endif
+	}
+
+	bool isEnabled(const std::string& name)
+	{
+		return filter.empty() || name.find(filter) != std::string::npos;
+	}
+
+	bool isAnyEnabled(std::initializer_list<const char*> names)
+	{
+		for (const char* name : names)
+		{
+			if (isEnabled(name))
+				return true;
+		}
+
+		return false;
+	}
+
+	std::vector<Entity*> getEntities(World* world)
+	{
+		std::vector<Entity*> ents;
+		ents.reserve(world->getCount());
+		for (Entity* ent : world->all())
+		{
+			ents.push_back(ent);
+		}
+
+		return ents;
+	}
+
+	/**
+	* Times a single piece of work. Only the time between start() and stop() is measured, so setup and teardown can
+	* happen around it. Memory is measured from when the timer is created, so create it before the setup whose memory
+	* should count towards the benchmark.
+	*/
+	class Timer
+	{
+	public:
+		Timer()
+		{
+			releaseFreeMemory();
+			startRSS = getCurrentRSS();
+		}
+
+		void start()
+		{
+			startAllocations = allocationCount;
+			startTime = Clock::now();
+		}
+
+		void stop()
+		{
+			auto endTime = Clock::now();
+			allocations += allocationCount - startAllocations;
+			nanoseconds += std::chrono::duration<double, std::nano>(endTime - startTime).count();
+
+			size_t rss = getCurrentRSS();
+			if (rss > startRSS)
+				rssGrowth = std::max(rssGrowth, rss - startRSS);
+		}
+
+		double nanoseconds = 0.0;
+		size_t allocations = 0;
+
+		// The largest growth of the resident set size seen at the end of a measured section.
+		size_t rssGrowth = 0;
+
+	private:
+		size_t startAllocations = 0;
+		size_t startRSS = 0;
+		Clock::time_point startTime;
+	};
+
+	void report(const std::string& name, size_t entities, size_t ops, const Timer& timer)
+	{
+		if (ops == 0)
+			ops = 1;
+
+		std::printf("%-40s %10zu %12zu %12.2f %10.3f %10.1f\n", name.c_str(), entities, ops,
+			timer.nanoseconds / ops, static_cast<double>(timer.allocations) / ops,
+			timer.rssGrowth / (1024.0 * 1024.0));
+		std::fflush(stdout);
+	}
+
+	/**
+	* Creates a world with count entities, all of which have A. B, C and D are each assigned to the same
+	* matchRatio fraction of entities, spread evenly over the world.
+	*/
+	World* createPopulatedWorld(size_t count, double matchRatio)
+	{
+		World* world = World::createWorld();
+		size_t step = matchRatio > 0.0 ? static_cast<size_t>(1.0 / matchRatio + 0.5) : 0;
+		for (size_t i = 0; i < count; ++i)
+		{
+			Entity* ent = world->create();
+			ent->assign<A>(1.f);
+			if (step != 0 && i % step == 0)
+			{
+				ent->assign<B>(1.f);
+				ent->assign<C>(1.f);
+				ent->assign<D>(1.f);
+			}
+		}
+
+		return world;
+	}
+
+	void benchCreateDestroy(size_t count)
+	{
+		if (isEnabled("create"))
+		{
+			Timer timer;
+			World* world = World::createWorld();
+			timer.start();
+			for (size_t i = 0; i < count; ++i)
+			{
+				world->create();
+			}
+			timer.stop();
+			world->destroyWorld();
+			report("create", count, count, timer);
+		}
+
+		if (isEnabled("create + assign<A,B>"))
+		{
+			Timer timer;
+			World* world = World::createWorld();
+			timer.start();
+			for (size_t i = 0; i < count; ++i)
+			{
+				Entity* ent = world->create();
+				ent->assign<A>(1.f);
+				ent->assign<B>(1.f);
+			}
+			timer.stop();
+			world->destroyWorld();
+			report("create + assign<A,B>", count, count, timer);
+		}
+
+		if (isEnabled("createMany<A,B>"))
+		{
+			Timer timer;
+			World* world = World::createWorld();
+			timer.start();
+			world->createMany(count, A(1.f), B(1.f));
+			timer.stop();
+			world->destroyWorld();
+			report("createMany<A,B>", count, count, timer);
+		}
+
+		if (isEnabled("destroy (deferred) + cleanup"))
+		{
+			Timer timer;
+			World* world = createPopulatedWorld(count, 0.0);
+			std::vector<Entity*> ents = getEntities(world);
+			timer.start();
+			for (Entity* ent : ents)
+			{
+				world->destroy(ent, false);
+			}
+			world->cleanup();
+			timer.stop();
+			world->destroyWorld();
+			report("destroy (deferred) + cleanup", count, count, timer);
+		}
+
+		if (isEnabled("destroy (immediate)"))
+		{
+			// Only a slice of the world is destroyed, so that this stays fast enough to run at every size when destroy
+			// is linear in the number of entities.
+			size_t destroyCount = std::min<size_t>(count, 1000);
+			Timer timer;
+			World* world = createPopulatedWorld(count, 0.0);
+			std::vector<Entity*> ents = getEntities(world);
+			std::mt19937 rng(1);
+			std::shuffle(ents.begin(), ents.end(), rng);
+			timer.start();
+			for (size_t i = 0; i < destroyCount; ++i)
+			{
+				world->destroy(ents[i], true);
+			}
+			timer.stop();
+			world->destroyWorld();
+			report("destroy (immediate)", count, destroyCount, timer);
+		}
+	}
+
+	void benchComponents(size_t count)
+	{
+		if (!isAnyEnabled({ "assign<A>", "assign<B> (second component)", "get<A>", "get<C> (missing)", "toggle <Tag>", "remove<A>" }))
+			return;
+
+		World* world = World::createWorld();
+		std::vector<Entity*> ents;
+		ents.reserve(count);
+		for (size_t i = 0; i < count; ++i)
+		{
+			ents.push_back(world->create());
+		}
+
+		Timer assignTimer;
+		assignTimer.start();
+		for (Entity* ent : ents)
+		{
+			ent->assign<A>(1.f);
+		}
+		assignTimer.stop();
+
+		Timer assignSecondTimer;
+		assignSecondTimer.start();
+		for (Entity* ent : ents)
+		{
+			ent->assign<B>(1.f);
+		}
+		assignSecondTimer.stop();
+
+		Timer getTimer;
+		float total = 0.f;
+		getTimer.start();
+		for (Entity* ent : ents)
+		{
+			total += ent->get<A>()->value;
+		}
+		getTimer.stop();
+		sink = total;
+
+		Timer getMissingTimer;
+		size_t found = 0;
+		getMissingTimer.start();
+		for (Entity* ent : ents)
+		{
+			if (ent->get<C>().isValid())
+				++found;
+		}
+		getMissingTimer.stop();
+		sink = static_cast<float>(found);
+
+		// Assign and remove a tag twice per entity.
+		Timer toggleTimer;
+		toggleTimer.start();
+		for (size_t pass = 0; pass < 2; ++pass)
+		{
+			for (Entity* ent : ents)
+			{
+				ent->assign<Tag>();
+			}
+
+			for (Entity* ent : ents)
+			{
+				ent->remove<Tag>();
+			}
+		}
+		toggleTimer.stop();
+
+		Timer removeTimer;
+		removeTimer.start();
+		for (Entity* ent : ents)
+		{
+			ent->remove<A>();
+		}
+		removeTimer.stop();
+
+		world->destroyWorld();
+
+		if (isEnabled("assign<A>"))
+			report("assign<A>", count, count, assignTimer);
+		if (isEnabled("assign<B> (second component)"))
+			report("assign<B> (second component)", count, count, assignSecondTimer);
+		if (isEnabled("get<A>"))
+			report("get<A>", count, count, getTimer);
+		if (isEnabled("get<C> (missing)"))
+			report("get<C> (missing)", count, count, getMissingTimer);
+		if (isEnabled("toggle <Tag>"))
+			report("toggle <Tag>", count, 4 * count, toggleTimer);
+		if (isEnabled("remove<A>"))
+			report("remove<A>", count, count, removeTimer);
+	}
+
+	void benchEach(size_t count)
+	{
+		static const double ratios[] = { 1.0, 0.5, 0.1 };
+		static const char* ratioNames[] = { "100%", "50%", "10%" };
+
+		for (size_t r = 0; r < sizeof(ratios) / sizeof(ratios[0]); ++r)
+		{
+			std::string suffix = std::string(" ") + ratioNames[r];
+			if (!isAnyEnabled({ "each<A>", "each<A> (handles)", "each<A> (std::function)" }) &&
+				!isEnabled("each<A,B>" + suffix) && !isEnabled("each<A,B,C,D>" + suffix) &&
+				!isEnabled("each<A,const B,const C,const D>" + suffix) && !isEnabled("each (range for) <A,B>" + suffix) &&
+				!isEnabled("eachChunk<A,const B>" + suffix) && !isEnabled("each<A,None<B>>" + suffix) &&
+				!isEnabled("each<A,Optional<const B>>" + suffix))
+				continue;
+
+			World* world = createPopulatedWorld(count, ratios[r]);
+			size_t matched = 0;
+
+			// A is on every entity, so each<A> is only run once.
+			if (r == 0 && isEnabled("each<A>"))
+			{
+				Timer timer;
+				timer.start();
+				world->each<A>([&](A& a) {
+					a.value += 1.f;
+				});
+				timer.stop();
+				report("each<A>", count, count, timer);
+			}
+
+			if (r == 0 && isEnabled("each<A> (handles)"))
+			{
+				Timer timer;
+				timer.start();
+				world->each<A>([&](Entity* ent, ComponentHandle<A> a) {
+					a->value += 1.f;
+				});
+				timer.stop();
+				report("each<A> (handles)", count, count, timer);
+			}
+
+			if (r == 0 && isEnabled("each<A> (std::function)"))
+			{
+				std::function<void(Entity*, ComponentHandle<A>)> func = [&](Entity* ent, ComponentHandle<A> a) {
+					a->value += 1.f;
+				};
+
+				Timer timer;
+				timer.start();
+				world->each<A>(func);
+				timer.stop();
+				report("each<A> (std::function)", count, count, timer);
+			}
+
+			if (isEnabled("each<A,B>" + suffix))
+			{
+				Timer timer;
+				matched = 0;
+				timer.start();
+				world->each<A, B>([&](A& a, B& b) {
+					a.value += b.value;
+					++matched;
+				});
+				timer.stop();
+				report("each<A,B>" + suffix, count, matched, timer);
+			}
+
+			if (isEnabled("each<A,B,C,D>" + suffix))
+			{
+				Timer timer;
+				matched = 0;
+				timer.start();
+				world->each<A, B, C, D>([&](A& a, B& b, C& c, D& d) {
+					a.value += b.value * c.value + d.value;
+					++matched;
+				});
+				timer.stop();
+				report("each<A,B,C,D>" + suffix, count, matched, timer);
+			}
+
+			// Same as above, but only A is stamped as changed.
+			if (isEnabled("each<A,const B,const C,const D>" + suffix))
+			{
+				Timer timer;
+				matched = 0;
+				timer.start();
+				world->each<A, const B, const C, const D>([&](A& a, const B& b, const C& c, const D& d) {
+					a.value += b.value * c.value + d.value;
+					++matched;
+				});
+				timer.stop();
+				report("each<A,const B,const C,const D>" + suffix, count, matched, timer);
+			}
+
+			if (isEnabled("each (range for) <A,B>" + suffix))
+			{
+				Timer timer;
+				matched = 0;
+				timer.start();
+				for (Entity* ent : world->each<A, B>())
+				{
+					ent->with<A, B>([&](A& a, B& b) {
+						a.value += b.value;
+					});
+					++matched;
+				}
+				timer.stop();
+				report("each (range for) <A,B>" + suffix, count, matched, timer);
+			}
+
+			if (isEnabled("eachChunk<A,const B>" + suffix))
+			{
+				Timer timer;
+				matched = 0;
+				timer.start();
+				world->eachChunk<A, const B>([&](size_t n, Entity* const* ents, A* a, const B* b) {
+					for (size_t i = 0; i < n; ++i)
+					{
+						a[i].value += b[i].value;
+					}
+					matched += n;
+				});
+				timer.stop();
+				report("eachChunk<A,const B>" + suffix, count, matched, timer);
+			}
+
+			// Every entity has to be looked at, even with 100% of them skipped, so this counts entities rather than matches.
+			if (isEnabled("each<A,None<B>>" + suffix))
+			{
+				Timer timer;
+				timer.start();
+				world->each<A, None<B>>([&](A& a) {
+					a.value += 1.f;
+				});
+				timer.stop();
+				report("each<A,None<B>>" + suffix, count, count, timer);
+			}
+
+			if (isEnabled("each<A,Optional<const B>>" + suffix))
+			{
+				Timer timer;
+				matched = 0;
+				timer.start();
+				world->each<A, Optional<const B>>([&](A& a, const B* b) {
+					if (b != nullptr)
+						a.value += b->value;
+					++matched;
+				});
+				timer.stop();
+				report("each<A,Optional<const B>>" + suffix, count, matched, timer);
+			}
+
+			world->destroyWorld();
+		}
+	}
+
+	void benchCommands(size_t count)
+	{
+		if (isEnabled("commands: create + assign<A,B>"))
+		{
+			Timer timer;
+			World* world = World::createWorld();
+			CommandBuffer* commands = world->getCommandBuffer();
+			timer.start();
+			for (size_t i = 0; i < count; ++i)
+			{
+				EntityHandle ent = commands->create();
+				commands->assign<A>(ent, 1.f);
+				commands->assign<B>(ent, 1.f);
+			}
+			commands->playback();
+			timer.stop();
+			world->destroyWorld();
+			report("commands: create + assign<A,B>", count, count, timer);
+		}
+
+		if (!isAnyEnabled({ "commands: assign<B>", "commands: remove<B>" }))
+			return;
+
+		World* world = createPopulatedWorld(count, 0.0);
+		std::vector<Entity*> ents = getEntities(world);
+		CommandBuffer* commands = world->getCommandBuffer();
+
+		Timer assignTimer;
+		assignTimer.start();
+		for (Entity* ent : ents)
+		{
+			commands->assign<B>(ent, 1.f);
+		}
+		commands->playback();
+		assignTimer.stop();
+
+		Timer removeTimer;
+		removeTimer.start();
+		for (Entity* ent : ents)
+		{
+			commands->remove<B>(ent);
+		}
+		commands->playback();
+		removeTimer.stop();
+
+		world->destroyWorld();
+
+		if (isEnabled("commands: assign<B>"))
+			report("commands: assign<B>", count, count, assignTimer);
+		if (isEnabled("commands: remove<B>"))
+			report("commands: remove<B>", count, count, removeTimer);
+	}
+
+	void benchSerialize(size_t count)
+	{
+		if (!isAnyEnabled({ "save <A,B>", "load <A,B>" }))
+			return;
+
+		WorldSerializer serializer;
+		serializer.registerComponent<A>("A");
+		serializer.registerComponent<B>("B");
+
+		World* world = createPopulatedWorld(count, 1.0);
+		std::stringstream stream;
+
+		Timer saveTimer;
+		saveTimer.start();
+		serializer.save(world, stream);
+		saveTimer.stop();
+		world->destroyWorld();
+
+		World* loaded = World::createWorld();
+		Timer loadTimer;
+		loadTimer.start();
+		serializer.load(loaded, stream);
+		loadTimer.stop();
+		loaded->destroyWorld();
+
+		if (isEnabled("save <A,B>"))
+			report("save <A,B>", count, count, saveTimer);
+		if (isEnabled("load <A,B>"))
+			report("load <A,B>", count, count, loadTimer);
+	}
+
+	void benchChanged(size_t count)
+	{
+		static const double ratios[] = { 0.0, 0.01, 1.0 };
+		static const char* ratioNames[] = { "none", "1%", "all" };
+
+		for (size_t r = 0; r < sizeof(ratios) / sizeof(ratios[0]); ++r)
+		{
+			std::string name = std::string("each<Changed<A>> (") + ratioNames[r] + " changed)";
+			if (!isEnabled(name))
+				continue;
+
+			World* world = createPopulatedWorld(count, 0.0);
+			std::vector<Entity*> ents = getEntities(world);
+			world->setChangeSince(world->advanceChangeTick());
+
+			size_t step = ratios[r] > 0.0 ? static_cast<size_t>(1.0 / ratios[r] + 0.5) : 0;
+			for (size_t i = 0; step != 0 && i < ents.size(); i += step)
+			{
+				ents[i]->markChanged<A>();
+			}
+
+			size_t matched = 0;
+			Timer timer;
+			timer.start();
+			world->each<Changed<const A>>([&](const A& a) {
+				++matched;
+			});
+			timer.stop();
+			world->destroyWorld();
+
+			report(name, count, matched, timer);
+		}
+	}
+
+	void benchQuery(size_t count)
+	{
+		static const double ratios[] = { 1.0, 0.1 };
+		static const char* ratioNames[] = { "100%", "10%" };
+
+		for (size_t r = 0; r < sizeof(ratios) / sizeof(ratios[0]); ++r)
+		{
+			std::string suffix = std::string(" ") + ratioNames[r];
+			if (!isEnabled("query<A,const B> (create)" + suffix) && !isEnabled("query<A,const B>::each" + suffix))
+				continue;
+
+			World* world = createPopulatedWorld(count, ratios[r]);
+
+			// The first call finds every matching entity, later calls return the same query.
+			Timer createTimer;
+			createTimer.start();
+			Query<A, const B>* query = world->query<A, const B>();
+			createTimer.stop();
+
+			if (isEnabled("query<A,const B> (create)" + suffix))
+				report("query<A,const B> (create)" + suffix, count, query->getCount(), createTimer);
+
+			if (isEnabled("query<A,const B>::each" + suffix))
+			{
+				Timer timer;
+				size_t matched = 0;
+				timer.start();
+				query->each([&](A& a, const B& b) {
+					a.value += b.value;
+					++matched;
+				});
+				timer.stop();
+				report("query<A,const B>::each" + suffix, count, matched, timer);
+			}
+
+			world->destroyWorld();
+		}
+	}
+
+	void benchParallel(size_t count)
+	{
+		if (!isAnyEnabled({ "parallelEach<A,B>", "parallelEach<A,B> (std::function)", "parallelEachChunk<A,const B>" }))
+			return;
+
+		World* world = createPopulatedWorld(count, 1.0);
+
+		// Start the thread pool outside of the timed section.
+		world->getThreadPool();
+
+		if (isEnabled("parallelEach<A,B>"))
+		{
+			Timer timer;
+			timer.start();
+			world->parallelEach<A, B>([&](A& a, B& b) {
+				a.value += b.value;
+			});
+			timer.stop();
+			report("parallelEach<A,B>", count, count, timer);
+		}
+
+		if (isEnabled("parallelEach<A,B> (std::function)"))
+		{
+			std::function<void(Entity*, ComponentHandle<A>, ComponentHandle<B>)> func = [&](Entity* ent, ComponentHandle<A> a, ComponentHandle<B> b) {
+				a->value += b->value;
+			};
+
+			Timer timer;
+			timer.start();
+			world->parallelEach<A, B>(func);
+			timer.stop();
+			report("parallelEach<A,B> (std::function)", count, count, timer);
+		}
+
+		if (isEnabled("parallelEachChunk<A,const B>"))
+		{
+			Timer timer;
+			std::atomic<size_t> matched(0);
+			timer.start();
+			world->parallelEachChunk<A, const B>([&](size_t n, Entity* const* ents, A* a, const B* b) {
+				for (size_t i = 0; i < n; ++i)
+				{
+					a[i].value += b[i].value;
+				}
+				matched += n;
+			});
+			timer.stop();
+			report("parallelEachChunk<A,const B>", count, matched, timer);
+		}
+
+		world->destroyWorld();
+	}
+
+	void benchTick(size_t count)
+	{
+		static const size_t ticks = 10;
+
+		for (int declared = 1; declared >= 0; --declared)
+		{
+			std::string name = declared ? "tick, 4 systems (scheduled)" : "tick, 4 systems (exclusive)";
+			if (!isEnabled(name))
+				continue;
+
+			World* world = createPopulatedWorld(count, 1.0);
+			world->registerSystem(new MoveSystem(declared != 0));
+			world->registerSystem(new ScaleSystem(declared != 0));
+			world->registerSystem(new DecaySystem(declared != 0));
+			SumSystem* sum = static_cast<SumSystem*>(world->registerSystem(new SumSystem(declared != 0)));
+
+			// The first tick builds the schedule and starts the thread pool.
+			world->tick(0.01f);
+
+			Timer timer;
+			timer.start();
+			for (size_t i = 0; i < ticks; ++i)
+			{
+				world->tick(0.01f);
+			}
+			timer.stop();
+			sink = sum->total;
+			world->destroyWorld();
+
+			report(name, count, ticks, timer);
+		}
+	}
+
+	void benchEmit(size_t count)
+	{
+		static const size_t subscriberCounts[] = { 0, 1, 8 };
+
+		for (size_t subscriberCount : subscriberCounts)
+		{
+			std::string name = "emit (" + std::to_string(subscriberCount) + " subscribers)";
+			if (!isEnabled(name))
+				continue;
+
+			World* world = World::createWorld();
+			std::vector<BenchSubscriber> subs(subscriberCount);
+			for (BenchSubscriber& sub : subs)
+			{
+				world->subscribe<BenchEvent>(&sub);
+			}
+
+			Timer timer;
+			timer.start();
+			for (size_t i = 0; i < count; ++i)
+			{
+				world->emit<BenchEvent>({ static_cast<int>(i) });
+			}
+			timer.stop();
+
+			for (BenchSubscriber& sub : subs)
+			{
+				world->unsubscribe<BenchEvent>(&sub);
+			}
+			world->destroyWorld();
+
+			report(name, count, count, timer);
+		}
+
+		for (size_t subscriberCount : subscriberCounts)
+		{
+			std::string name = "emit (" + std::to_string(subscriberCount) + " member function subscribers)";
+			if (subscriberCount == 0 || !isEnabled(name))
+				continue;
+
+			World* world = World::createWorld();
+			std::vector<BenchSubscriber> subs(subscriberCount);
+			for (BenchSubscriber& sub : subs)
+			{
+				world->subscribe<BenchEvent, BenchSubscriber, &BenchSubscriber::onEvent>(&sub);
+			}
+
+			Timer timer;
+			timer.start();
+			for (size_t i = 0; i < count; ++i)
+			{
+				world->emit<BenchEvent>({ static_cast<int>(i) });
+			}
+			timer.stop();
+
+			for (BenchSubscriber& sub : subs)
+			{
+				world->unsubscribeAll(&sub);
+			}
+			world->destroyWorld();
+
+			report(name, count, count, timer);
+		}
+
+		for (size_t subscriberCount : subscriberCounts)
+		{
+			std::string name = "enqueue + flush (" + std::to_string(subscriberCount) + " subscribers)";
+			if (!isEnabled(name))
+				continue;
+
+			World* world = World::createWorld();
+			std::vector<BenchSubscriber> subs(subscriberCount);
+			for (BenchSubscriber& sub : subs)
+			{
+				world->subscribe<BenchEvent>(&sub);
+			}
+
+			// Fill the queue once, so that the timed run doesn't measure the queue growing.
+			for (size_t i = 0; i < count; ++i)
+			{
+				world->enqueue<BenchEvent>({ static_cast<int>(i) });
+			}
+			world->flushEvents();
+
+			Timer timer;
+			timer.start();
+			for (size_t i = 0; i < count; ++i)
+			{
+				world->enqueue<BenchEvent>({ static_cast<int>(i) });
+			}
+			world->flushEvents();
+			timer.stop();
+
+			for (BenchSubscriber& sub : subs)
+			{
+				world->unsubscribe<BenchEvent>(&sub);
+			}
+			world->destroyWorld();
+
+			report(name, count, count, timer);
+		}
+	}
+
+	void benchCleanup(size_t count)
+	{
+		if (isEnabled("cleanup (nothing pending)"))
+		{
+			static const size_t calls = 1000;
+
+			World* world = createPopulatedWorld(count, 0.0);
+			Timer timer;
+			timer.start();
+			for (size_t i = 0; i < calls; ++i)
+			{
+				world->cleanup();
+			}
+			timer.stop();
+			world->destroyWorld();
+
+			report("cleanup (nothing pending)", count, calls, timer);
+		}
+
+		if (isEnabled("cleanup (1% churn)"))
+		{
+			// Every round destroys 1% of the world, replaces it with new entities and cleans up, like a frame
+			// of a game with steady spawning and despawning would.
+			static const size_t rounds = 100;
+			size_t churn = std::max<size_t>(count / 100, 1);
+
+			World* world = createPopulatedWorld(count, 0.0);
+			std::vector<Entity*> ents = getEntities(world);
+			std::mt19937 rng(1);
+
+			Timer timer;
+			for (size_t round = 0; round < rounds; ++round)
+			{
+				timer.start();
+				for (size_t i = 0; i < churn; ++i)
+				{
+					size_t victim = rng() % ents.size();
+					world->destroy(ents[victim], false);
+					Entity* ent = world->create();
+					ent->assign<A>(1.f);
+					ents[victim] = ent;
+				}
+				world->cleanup();
+				timer.stop();
+			}
+			world->destroyWorld();
+
+			report("cleanup (1% churn)", count, rounds * churn, timer);
+		}
+	}
+
+	void benchGetById(size_t count)
+	{
+		if (!isEnabled("getById"))
+			return;
+
+		World* world = createPopulatedWorld(count, 0.0);
+		std::vector<size_t> ids;
+		ids.reserve(count);
+		for (Entity* ent : world->all())
+		{
+			ids.push_back(ent->getEntityId());
+		}
+		std::mt19937 rng(1);
+		std::shuffle(ids.begin(), ids.end(), rng);
+
+		Timer timer;
+		size_t found = 0;
+		timer.start();
+		for (size_t id : ids)
+		{
+			if (world->getById(id) != nullptr)
+				++found;
+		}
+		timer.stop();
+		sink = static_cast<float>(found);
+		world->destroyWorld();
+
+		report("getById (random order)", count, count, timer);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	size_t maxEntities = 1000000;
+	if (argc > 1)
+		maxEntities = static_cast<size_t>(std::strtoull(argv[1], nullptr, 10));
+	if (argc > 2)
+		filter = argv[2];
+
+#ifdef ECS_ARCHETYPE_STORAGE
+	const char* storage = "archetype";
+#else
+	const char* storage = "sparse set";
+#endif
+
+	std::printf("EntityComponentSystem Benchmark (%s storage)\n", storage);
+	std::printf("%-40s %10s %12s %12s %10s %10s\n", "benchmark", "entities", "ops", "ns/op", "allocs/op", "+RSS MB");
+
+	for (size_t count = 10000; count <= maxEntities; count *= 10)
+	{
+		benchCreateDestroy(count);
+		benchComponents(count);
+		benchCommands(count);
+		benchSerialize(count);
+		benchEach(count);
+		benchChanged(count);
+		benchQuery(count);
+		benchParallel(count);
+		benchTick(count);
+		benchEmit(count);
+		benchCleanup(count);
+		benchGetById(count);
+	}
+
+	return 0;
+}
@@ -53,6 +53,24 @@ struct Rotation
 
 ECS_DEFINE_TYPE(Rotation);
 
+// Particles are stored as a structure of arrays, so that ParticleSystem can work on whole arrays of each field.
+struct Particle
+{
+	ECS_DECLARE_TYPE;
+
+	Particle(float x, float y, float vx, float vy) : x(x), y(y), vx(vx), vy(vy) {}
+	Particle() {}
+
+	float x;
+	float y;
+	float vx;
+	float vy;
+
+	typedef SoA<ECS_SOA_FIELD(Particle, x), ECS_SOA_FIELD(Particle, y), ECS_SOA_FIELD(Particle, vx), ECS_SOA_FIELD(Particle, vy)> SoAFields;
+};
+
+ECS_DEFINE_TYPE(Particle);
+
 struct SomeComponent
 {
 	ECS_DECLARE_TYPE;
@@ -139,6 +157,29 @@ public:
 	}
 };
 
+class ParticleSystem : public EntitySystem
+{
+public:
+	virtual ~ParticleSystem() {}
+
+	virtual void tick(class World* world, float deltaTime) override
+	{
+		// Plain loops over the field arrays, which the compiler can vectorize.
+		world->eachSoA<Particle>([&](size_t count, SoAArrays<Particle> particles) -> void {
+			float* x = particles[&Particle::x];
+			float* y = particles[&Particle::y];
+			const float* vx = particles[&Particle::vx];
+			const float* vy = particles[&Particle::vy];
+
+			for (size_t i = 0; i < count; ++i)
+			{
+				x[i] += vx[i] * deltaTime;
+				y[i] += vy[i] * deltaTime;
+			}
+		});
+	}
+};
+
 int main(int argc, char** argv)
 {
 	std::cout << "EntityComponentSystem Test" << std::endl
@@ -198,6 +239,17 @@ int main(int argc, char** argv)
 	world->cleanup();
 	std::cout << "After a cleanup, we have " << world->getCount() << " entities." << std::endl;
 
+	std::cout << "Moving particles..." << std::endl;
+
+	world->registerSystem(new ParticleSystem());
+
+	auto particle = world->create()->assign<Particle>(0.f, 0.f, 1.f, 2.f);
+	world->create()->assign<Particle>(5.f, 5.f, -1.f, 0.f);
+
+	world->tick(2.f);
+
+	std::cout << "After tick(2): particle(" << particle[&Particle::x] << ", " << particle[&Particle::y] << ")" << std::endl;
+
 	std::cout << "Destroying the world..." << std::endl;
 
 	world->destroyWorld();